@@ -0,0 +1,197 @@
+/*
+ * CRC32 and CRC32C using NEON vmull.p8 polynomial multiplication
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Based on crypto/crc32_generic.c and crypto/crc32c_generic.c.
+ */
+
+#include <linux/crc32.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+
+#include <crypto/internal/hash.h>
+
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+/*
+ * Folding needs at least 64 bytes. Below a few hundred bytes, the cost of
+ * preserving the NEON state and of the vmull.p8 based multiplications is
+ * not recovered, and the slice-by-8 tables of lib/crc32.c are faster.
+ */
+#define CRC32_NEON_MIN_LEN	256
+#define CRC32_NEON_CHUNK	16
+
+asmlinkage u32 crc32_neon_le(const u8 buf[], u32 len, u32 init_crc);
+asmlinkage u32 crc32c_neon_le(const u8 buf[], u32 len, u32 init_crc);
+
+static u32 crc32_neon_update(u32 crc, const u8 *data, size_t len,
+			     u32 (*neon)(const u8 [], u32, u32),
+			     u32 (*fallback)(u32, unsigned char const *, size_t))
+{
+	size_t l;
+
+	if (len >= CRC32_NEON_MIN_LEN && cpu_has_neon() && may_use_simd()) {
+		l = round_down(len, CRC32_NEON_CHUNK);
+		kernel_neon_begin();
+		crc = neon(data, l, crc);
+		kernel_neon_end();
+		data += l;
+		len -= l;
+	}
+	if (len > 0)
+		crc = fallback(crc, data, len);
+	return crc;
+}
+
+#if IS_BUILTIN(CONFIG_CRYPTO_CRC32_NEON) && IS_BUILTIN(CONFIG_CRC32)
+/*
+ * Override the weak lib/crc32.c versions, so that crc32_le() and
+ * __crc32c_le() users outside the crypto API benefit as well.
+ */
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_neon_update(crc, p, len, crc32_neon_le, crc32_le_base);
+}
+
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_neon_update(crc, p, len, crc32c_neon_le,
+				 __crc32c_le_base);
+}
+#endif
+
+static int crc32_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = 0;
+	return 0;
+}
+
+static int crc32c_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = ~0;
+	return 0;
+}
+
+static int crc32_setkey(struct crypto_shash *hash, const u8 *key,
+			unsigned int keylen)
+{
+	u32 *mctx = crypto_shash_ctx(hash);
+
+	if (keylen != sizeof(u32)) {
+		crypto_shash_set_flags(hash, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	*mctx = le32_to_cpup((__le32 *)key);
+	return 0;
+}
+
+static int crc32_init(struct shash_desc *desc)
+{
+	u32 *mctx = crypto_shash_ctx(desc->tfm);
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = *mctx;
+	return 0;
+}
+
+static int crc32_update(struct shash_desc *desc, const u8 *data,
+			unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_neon_update(*crc, data, length, crc32_neon_le,
+				 crc32_le_base);
+	return 0;
+}
+
+static int crc32c_update(struct shash_desc *desc, const u8 *data,
+			 unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_neon_update(*crc, data, length, crc32c_neon_le,
+				 __crc32c_le_base);
+	return 0;
+}
+
+static int crc32_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(*crc, out);
+	return 0;
+}
+
+static int crc32c_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(~*crc, out);
+	return 0;
+}
+
+static struct shash_alg crc32_neon_algs[] = { {
+	.setkey			= crc32_setkey,
+	.init			= crc32_init,
+	.update			= crc32_update,
+	.final			= crc32_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32_cra_init,
+	.base.cra_name		= "crc32",
+	.base.cra_driver_name	= "crc32-arm-neon",
+	.base.cra_priority	= 200,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+}, {
+	.setkey			= crc32_setkey,
+	.init			= crc32_init,
+	.update			= crc32c_update,
+	.final			= crc32c_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32c_cra_init,
+	.base.cra_name		= "crc32c",
+	.base.cra_driver_name	= "crc32c-arm-neon",
+	.base.cra_priority	= 200,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+} };
+
+static int __init crc32_neon_mod_init(void)
+{
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	return crypto_register_shashes(crc32_neon_algs,
+				       ARRAY_SIZE(crc32_neon_algs));
+}
+
+static void __exit crc32_neon_mod_exit(void)
+{
+	crypto_unregister_shashes(crc32_neon_algs,
+				  ARRAY_SIZE(crc32_neon_algs));
+}
+
+module_init(crc32_neon_mod_init);
+module_exit(crc32_neon_mod_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("CRC32 and CRC32C, NEON accelerated");
+MODULE_ALIAS_CRYPTO("crc32");
+MODULE_ALIAS_CRYPTO("crc32c");
@@ -0,0 +1,147 @@
+/*
+ * Poly1305 authenticator algorithm, RFC7539, ARM NEON accelerated
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Based on crypto/poly1305_generic.c.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/internal/hash.h>
+#include <crypto/poly1305.h>
+#include <linux/crypto.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+
+struct poly1305_neon_desc_ctx {
+	struct poly1305_desc_ctx base;
+	/* derived key u set? */
+	bool uset;
+	/* derived key u = r^2 */
+	u32 u[5];
+};
+
+asmlinkage void poly1305_2block_neon(u32 *h, const u8 *src, const u32 *r,
+				     unsigned int blocks, const u32 *u);
+
+static int poly1305_neon_init(struct shash_desc *desc)
+{
+	struct poly1305_neon_desc_ctx *nctx = shash_desc_ctx(desc);
+
+	nctx->uset = false;
+
+	return crypto_poly1305_init(desc);
+}
+
+/* u = r * r, partially reduced as in the generic block function */
+static void poly1305_neon_square(u32 *u, const u32 *r)
+{
+	u32 s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+	u64 d0, d1, d2, d3, d4;
+
+	d0 = (u64)r[0] * r[0] + (u64)r[1] * s4 + (u64)r[2] * s3 +
+	     (u64)r[3] * s2 + (u64)r[4] * s1;
+	d1 = (u64)r[0] * r[1] + (u64)r[1] * r[0] + (u64)r[2] * s4 +
+	     (u64)r[3] * s3 + (u64)r[4] * s2;
+	d2 = (u64)r[0] * r[2] + (u64)r[1] * r[1] + (u64)r[2] * r[0] +
+	     (u64)r[3] * s4 + (u64)r[4] * s3;
+	d3 = (u64)r[0] * r[3] + (u64)r[1] * r[2] + (u64)r[2] * r[1] +
+	     (u64)r[3] * r[0] + (u64)r[4] * s4;
+	d4 = (u64)r[0] * r[4] + (u64)r[1] * r[3] + (u64)r[2] * r[2] +
+	     (u64)r[3] * r[1] + (u64)r[4] * r[0];
+
+	d1 += d0 >> 26;               u[0] = d0 & 0x3ffffff;
+	d2 += d1 >> 26;               u[1] = d1 & 0x3ffffff;
+	d3 += d2 >> 26;               u[2] = d2 & 0x3ffffff;
+	d4 += d3 >> 26;               u[3] = d3 & 0x3ffffff;
+	u[0] += (u32)(d4 >> 26) * 5;  u[4] = d4 & 0x3ffffff;
+	u[1] += u[0] >> 26;           u[0] &= 0x3ffffff;
+}
+
+static int poly1305_neon_update(struct shash_desc *desc,
+				const u8 *src, unsigned int srclen)
+{
+	struct poly1305_neon_desc_ctx *nctx = shash_desc_ctx(desc);
+	struct poly1305_desc_ctx *dctx = &nctx->base;
+	unsigned int bytes, blocks;
+
+	if (unlikely(dctx->buflen)) {
+		bytes = min(srclen, POLY1305_BLOCK_SIZE - dctx->buflen);
+		crypto_poly1305_update(desc, src, bytes);
+		src += bytes;
+		srclen -= bytes;
+	}
+
+	if (unlikely(!dctx->sset)) {
+		bytes = crypto_poly1305_setdesckey(dctx, src, srclen);
+		src += srclen - bytes;
+		srclen = bytes;
+		/* a partial key is buffered by the generic code */
+		if (!dctx->sset)
+			return crypto_poly1305_update(desc, src, srclen);
+	}
+
+	blocks = srclen / (POLY1305_BLOCK_SIZE * 2);
+	if (blocks && may_use_simd()) {
+		if (unlikely(!nctx->uset)) {
+			poly1305_neon_square(nctx->u, dctx->r);
+			nctx->uset = true;
+		}
+
+		kernel_neon_begin();
+		poly1305_2block_neon(dctx->h, src, dctx->r, blocks, nctx->u);
+		kernel_neon_end();
+
+		src += blocks * POLY1305_BLOCK_SIZE * 2;
+		srclen -= blocks * POLY1305_BLOCK_SIZE * 2;
+	}
+
+	/* odd trailing block and partial data go through the generic code */
+	if (srclen)
+		return crypto_poly1305_update(desc, src, srclen);
+
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.digestsize	= POLY1305_DIGEST_SIZE,
+	.init		= poly1305_neon_init,
+	.update		= poly1305_neon_update,
+	.final		= crypto_poly1305_final,
+	.setkey		= crypto_poly1305_setkey,
+	.descsize	= sizeof(struct poly1305_neon_desc_ctx),
+	.base		= {
+		.cra_name		= "poly1305",
+		.cra_driver_name	= "poly1305-neon",
+		.cra_priority		= 200,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_blocksize		= POLY1305_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static int __init poly1305_neon_mod_init(void)
+{
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	return crypto_register_shash(&alg);
+}
+
+static void __exit poly1305_neon_mod_exit(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(poly1305_neon_mod_init);
+module_exit(poly1305_neon_mod_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Poly1305 authenticator, NEON accelerated");
+MODULE_ALIAS_CRYPTO("poly1305");
+MODULE_ALIAS_CRYPTO("poly1305-neon");
@@ -1,5 +1,5 @@
 /*
- * Just-In-Time compiler for BPF filters on 32bit ARM
+ * Just-In-Time compiler for eBPF filters on 32bit ARM
  *
  * Copyright (c) 2011 Mircea Gherzan <mgherzan@gmail.com>
  *
@@ -8,6 +8,9 @@
  * Free Software Foundation; version 2 of the License.
  */
 
+#define pr_fmt(fmt) "bpf_jit: " fmt
+
+#include <linux/bpf.h>
 #include <linux/bitops.h>
 #include <linux/compiler.h>
 #include <linux/errno.h>
@@ -16,6 +19,7 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/if_vlan.h>
+#include <linux/math64.h>
 
 #include <asm/cacheflush.h>
 #include <asm/hwcap.h>
@@ -23,121 +27,134 @@
 
 #include "bpf_jit_32.h"
 
+int bpf_jit_enable __read_mostly;
+
 /*
- * ABI:
+ * eBPF registers are 64 bits wide, so each of them is held in a pair of
+ * ARM registers. There are not enough ARM registers for all of them, so
+ * the less frequently used ones live in a scratch area on the stack and
+ * are loaded into the temporary pairs when an instruction needs them.
+ *
+ * Stack layout while a program runs:
  *
- * r0	scratch register
- * r4	BPF register A
- * r5	BPF register X
- * r6	pointer to the skb
- * r7	skb->data
- * r8	skb_headlen(skb)
+ *                        high
+ * original ARM_SP =>     +-----------------+
+ *                        | callee saved    | pushed by the prologue
+ * BPF_FP =>              +-----------------+ <= ARM_SP + STACK_SIZE
+ *                        | BPF program     |
+ *                        | stack           |
+ *                        +-----------------+ <= ARM_SP + SCRATCH_SIZE
+ *                        | stacked eBPF    |
+ *                        | registers       |
+ *                        +-----------------+
+ *                        | R5 | R4 | R3    | outgoing helper arguments
+ * current ARM_SP =>      +-----------------+
+ *                        low
+ *
+ * BPF_REG_3..BPF_REG_5 are kept at the bottom of the frame, which is
+ * exactly where the AAPCS expects the third to fifth 64-bit argument of
+ * a function call, so helper calls need no argument shuffling on the
+ * stack.
  */
+#define TMP_REG_1	(MAX_BPF_JIT_REG + 0)	/* first temporary pair */
+#define TMP_REG_2	(MAX_BPF_JIT_REG + 1)	/* second temporary pair */
+#define TCALL_CNT	(MAX_BPF_JIT_REG + 2)	/* tail call count */
+#define SKB_BUF		(MAX_BPF_JIT_REG + 3)	/* bpf_load_pointer() buffer */
 
-#define r_scratch	ARM_R0
-/* r1-r3 are (also) used for the unaligned loads on the non-ARMv7 slowpath */
-#define r_off		ARM_R1
-#define r_A		ARM_R4
-#define r_X		ARM_R5
-#define r_skb		ARM_R6
-#define r_skb_data	ARM_R7
-#define r_skb_hl	ARM_R8
+/* scratch slots are encoded as negative values in bpf2a32[] */
+#define STACK_OFFSET(k)	(-1 - (k))
 
-#define SCRATCH_SP_OFFSET	0
-#define SCRATCH_OFF(k)		(SCRATCH_SP_OFFSET + 4 * (k))
+#define SCRATCH_SIZE	96
+#define STACK_SIZE	(SCRATCH_SIZE + MAX_BPF_STACK)
 
-#define SEEN_MEM		((1 << BPF_MEMWORDS) - 1)
-#define SEEN_MEM_WORD(k)	(1 << (k))
-#define SEEN_X			(1 << BPF_MEMWORDS)
-#define SEEN_CALL		(1 << (BPF_MEMWORDS + 1))
-#define SEEN_SKB		(1 << (BPF_MEMWORDS + 2))
-#define SEEN_DATA		(1 << (BPF_MEMWORDS + 3))
+/* callee saved registers, r10 is left alone */
+#define CALLEE_MASK	(1 << ARM_R4 | 1 << ARM_R5 | 1 << ARM_R6 | \
+			 1 << ARM_R7 | 1 << ARM_R8 | 1 << ARM_R9 | \
+			 1 << ARM_FP)
+#define CALLEE_PUSH_MASK (CALLEE_MASK | 1 << ARM_LR)
+#define CALLEE_POP_MASK  (CALLEE_MASK | 1 << ARM_PC)
 
-#define FLAG_NEED_X_RESET	(1 << 0)
-#define FLAG_IMM_OVERFLOW	(1 << 1)
+#define CALLER_MASK	(1 << ARM_R0 | 1 << ARM_R1 | 1 << ARM_R2 | 1 << ARM_R3)
+
+/*
+ * Map eBPF registers to {hi, lo} pairs of ARM registers or stack
+ * scratch slots. R0 and R1 use the registers the AAPCS uses for the
+ * return value and the first argument of a function call.
+ */
+static const s8 bpf2a32[][2] = {
+	/* return value from in-kernel function, and exit value from eBPF */
+	[BPF_REG_0] = {ARM_R1, ARM_R0},
+	/* arguments from eBPF program to in-kernel function */
+	[BPF_REG_1] = {ARM_R3, ARM_R2},
+	[BPF_REG_2] = {STACK_OFFSET(28), STACK_OFFSET(24)},
+	[BPF_REG_3] = {STACK_OFFSET(4), STACK_OFFSET(0)},
+	[BPF_REG_4] = {STACK_OFFSET(12), STACK_OFFSET(8)},
+	[BPF_REG_5] = {STACK_OFFSET(20), STACK_OFFSET(16)},
+	/* callee saved registers that in-kernel function will preserve */
+	[BPF_REG_6] = {ARM_R5, ARM_R4},
+	[BPF_REG_7] = {STACK_OFFSET(36), STACK_OFFSET(32)},
+	[BPF_REG_8] = {STACK_OFFSET(44), STACK_OFFSET(40)},
+	[BPF_REG_9] = {STACK_OFFSET(52), STACK_OFFSET(48)},
+	/* read-only frame pointer to access stack */
+	[BPF_REG_FP] = {STACK_OFFSET(60), STACK_OFFSET(56)},
+	/* temporary registers for internal BPF JIT, suitable for ldrexd */
+	[TMP_REG_1] = {ARM_R7, ARM_R6},
+	[TMP_REG_2] = {ARM_R9, ARM_R8},
+	/* tail_call_cnt, only the low word is used */
+	[TCALL_CNT] = {STACK_OFFSET(68), STACK_OFFSET(64)},
+	/* temporary register for blinding constants */
+	[BPF_REG_AX] = {STACK_OFFSET(76), STACK_OFFSET(72)},
+	/* bounce buffer for bpf_load_pointer() */
+	[SKB_BUF] = {STACK_OFFSET(84), STACK_OFFSET(80)},
+};
 
 struct jit_ctx {
-	const struct bpf_prog *skf;
-	unsigned idx;
-	unsigned prologue_bytes;
-	int ret0_fp_idx;
-	u32 seen;
-	u32 flags;
+	const struct bpf_prog *prog;
+	unsigned int idx;
+	unsigned int prologue_bytes;
+	unsigned int epilogue_offset;
+	int tail_call_out;
 	u32 *offsets;
 	u32 *target;
-#if __LINUX_ARM_ARCH__ < 7
-	u16 epilogue_bytes;
-	u16 imm_count;
-	u32 *imms;
-#endif
 };
 
-int bpf_jit_enable __read_mostly;
-
-static inline int call_neg_helper(struct sk_buff *skb, int offset, void *ret,
-		      unsigned int size)
-{
-	void *ptr = bpf_internal_load_pointer_neg_helper(skb, offset, size);
-
-	if (!ptr)
-		return -EFAULT;
-	memcpy(ret, ptr, size);
-	return 0;
-}
-
-static u64 jit_get_skb_b(struct sk_buff *skb, int offset)
-{
-	u8 ret;
-	int err;
-
-	if (offset < 0)
-		err = call_neg_helper(skb, offset, &ret, 1);
-	else
-		err = skb_copy_bits(skb, offset, &ret, 1);
-
-	return (u64)err << 32 | ret;
-}
-
-static u64 jit_get_skb_h(struct sk_buff *skb, int offset)
+static inline bool is_stacked(s8 reg)
 {
-	u16 ret;
-	int err;
-
-	if (offset < 0)
-		err = call_neg_helper(skb, offset, &ret, 2);
-	else
-		err = skb_copy_bits(skb, offset, &ret, 2);
-
-	return (u64)err << 32 | ntohs(ret);
+	return reg < 0;
 }
 
-static u64 jit_get_skb_w(struct sk_buff *skb, int offset)
+static inline int stack_off(s8 reg)
 {
-	u32 ret;
-	int err;
-
-	if (offset < 0)
-		err = call_neg_helper(skb, offset, &ret, 4);
-	else
-		err = skb_copy_bits(skb, offset, &ret, 4);
-
-	return (u64)err << 32 | ntohl(ret);
+	return -1 - reg;
 }
 
 /*
  * Wrappers which handle both OABI and EABI and assures Thumb2 interworking
  * (where the assembly routines like __aeabi_uidiv could cause problems).
  */
-static u32 jit_udiv(u32 dividend, u32 divisor)
+static u32 jit_udiv32(u32 dividend, u32 divisor)
 {
 	return dividend / divisor;
 }
 
-static u32 jit_mod(u32 dividend, u32 divisor)
+static u32 jit_mod32(u32 dividend, u32 divisor)
 {
 	return dividend % divisor;
 }
 
+static u64 jit_udiv64(u64 dividend, u64 divisor)
+{
+	return div64_u64(dividend, divisor);
+}
+
+static u64 jit_mod64(u64 dividend, u64 divisor)
+{
+	u64 rem;
+
+	div64_u64_rem(dividend, divisor, &rem);
+	return rem;
+}
+
 static inline void _emit(int cond, u32 inst, struct jit_ctx *ctx)
 {
 	inst |= (cond << 28);
@@ -157,914 +174,1395 @@ static inline void emit(u32 inst, struct jit_ctx *ctx)
 	_emit(ARM_COND_AL, inst, ctx);
 }
 
-static u16 saved_regs(struct jit_ctx *ctx)
+static void jit_fill_hole(void *area, unsigned int size)
 {
-	u16 ret = 0;
+	u32 *ptr;
+	/* We are guaranteed to have aligned memory. */
+	for (ptr = area; size >= sizeof(u32); size -= sizeof(u32))
+		*ptr++ = __opcode_to_mem_arm(ARM_INST_UDF);
+}
 
-	if ((ctx->skf->len > 1) ||
-	    (ctx->skf->insns[0].code == (BPF_RET | BPF_A)))
-		ret |= 1 << r_A;
+static int16_t imm8m(u32 x)
+{
+	u32 rot;
 
-#ifdef CONFIG_FRAME_POINTER
-	ret |= (1 << ARM_FP) | (1 << ARM_IP) | (1 << ARM_LR) | (1 << ARM_PC);
+	for (rot = 0; rot < 16; rot++)
+		if ((x & ~ror32(0xff, 2 * rot)) == 0)
+			return rol32(x, 2 * rot) | (rot << 8);
+
+	return -1;
+}
+
+/*
+ * Move an immediate that's not an imm8m to a core register.
+ *
+ * The length of the sequence only depends on the value, which is the
+ * same in both passes, so no literal pool is needed on older cores.
+ */
+static inline void emit_mov_i_no8m(const u8 rd, u32 val, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 7
+	bool first = true;
+
+	do {
+		/* next 8-bit chunk starting at an even bit position */
+		u32 shift = __ffs(val) & ~1;
+		u32 chunk = (val >> shift) & 0xff;
+		u32 imm12 = (((32 - shift) / 2) & 0xf) << 8 | chunk;
+
+		if (first)
+			emit(ARM_MOV_I(rd, imm12), ctx);
+		else
+			emit(ARM_ORR_I(rd, rd, imm12), ctx);
+		first = false;
+		val &= ~(chunk << shift);
+	} while (val);
 #else
-	if (ctx->seen & SEEN_CALL)
-		ret |= 1 << ARM_LR;
+	emit(ARM_MOVW(rd, val & 0xffff), ctx);
+	if (val > 0xffff)
+		emit(ARM_MOVT(rd, val >> 16), ctx);
 #endif
-	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
-		ret |= 1 << r_skb;
-	if (ctx->seen & SEEN_DATA)
-		ret |= (1 << r_skb_data) | (1 << r_skb_hl);
-	if (ctx->seen & SEEN_X)
-		ret |= 1 << r_X;
-
-	return ret;
 }
 
-static inline int mem_words_used(struct jit_ctx *ctx)
+static inline void emit_mov_i(const u8 rd, u32 val, struct jit_ctx *ctx)
 {
-	/* yes, we do waste some stack space IF there are "holes" in the set" */
-	return fls(ctx->seen & SEEN_MEM);
+	int imm12 = imm8m(val);
+
+	if (imm12 >= 0)
+		emit(ARM_MOV_I(rd, imm12), ctx);
+	else if ((imm12 = imm8m(~val)) >= 0)
+		emit(ARM_MVN_I(rd, imm12), ctx);
+	else
+		emit_mov_i_no8m(rd, val, ctx);
 }
 
-static void jit_fill_hole(void *area, unsigned int size)
+/* rd = rn + val, rd may be equal to rn */
+static void emit_add_i(const u8 rd, const u8 rn, u32 val, struct jit_ctx *ctx)
 {
-	u32 *ptr;
-	/* We are guaranteed to have aligned memory. */
-	for (ptr = area; size >= sizeof(u32); size -= sizeof(u32))
-		*ptr++ = __opcode_to_mem_arm(ARM_INST_UDF);
+	int imm12 = imm8m(val);
+
+	if (imm12 >= 0) {
+		emit(ARM_ADD_I(rd, rn, imm12), ctx);
+	} else if ((imm12 = imm8m(-val)) >= 0) {
+		emit(ARM_SUB_I(rd, rn, imm12), ctx);
+	} else {
+		emit_mov_i_no8m(ARM_IP, val, ctx);
+		emit(ARM_ADD_R(rd, rn, ARM_IP), ctx);
+	}
 }
 
-static void build_prologue(struct jit_ctx *ctx)
+/* Compute the immediate value for a branch to the start of eBPF insn tgt. */
+static inline s32 b_imm(unsigned int tgt, struct jit_ctx *ctx)
 {
-	u16 reg_set = saved_regs(ctx);
-	u16 off;
+	if (ctx->target == NULL)
+		return 0;
 
-#ifdef CONFIG_FRAME_POINTER
-	emit(ARM_MOV_R(ARM_IP, ARM_SP), ctx);
-	emit(ARM_PUSH(reg_set), ctx);
-	emit(ARM_SUB_I(ARM_FP, ARM_IP, 4), ctx);
+	/* PC in ARM mode == address of the instruction + 8 */
+	return ctx->offsets[tgt] - (ctx->idx + 2);
+}
+
+static inline s32 epilogue_offset(struct jit_ctx *ctx)
+{
+	if (ctx->target == NULL)
+		return 0;
+
+	return ctx->epilogue_offset - (ctx->idx + 2);
+}
+
+static inline void emit_blx_r(u8 tgt_reg, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 5
+	emit(ARM_MOV_R(ARM_LR, ARM_PC), ctx);
+
+	if (elf_hwcap & HWCAP_THUMB)
+		emit(ARM_BX(tgt_reg), ctx);
+	else
+		emit(ARM_MOV_R(ARM_PC, tgt_reg), ctx);
 #else
-	if (reg_set)
-		emit(ARM_PUSH(reg_set), ctx);
+	emit(ARM_BLX_R(tgt_reg), ctx);
 #endif
+}
 
-	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
-		emit(ARM_MOV_R(r_skb, ARM_R0), ctx);
-
-	if (ctx->seen & SEEN_DATA) {
-		off = offsetof(struct sk_buff, data);
-		emit(ARM_LDR_I(r_skb_data, r_skb, off), ctx);
-		/* headlen = len - data_len */
-		off = offsetof(struct sk_buff, len);
-		emit(ARM_LDR_I(r_skb_hl, r_skb, off), ctx);
-		off = offsetof(struct sk_buff, data_len);
-		emit(ARM_LDR_I(r_scratch, r_skb, off), ctx);
-		emit(ARM_SUB_R(r_skb_hl, r_skb_hl, r_scratch), ctx);
+static inline void emit_call(u32 func, struct jit_ctx *ctx)
+{
+	emit_mov_i(ARM_IP, func, ctx);
+	emit_blx_r(ARM_IP, ctx);
+}
+
+/*
+ * Load a 32-bit half of an eBPF register, returning the ARM register
+ * that holds it: the mapped register itself or tmp for stacked ones.
+ */
+static s8 arm_bpf_get_reg32(s8 reg, s8 tmp, struct jit_ctx *ctx)
+{
+	if (is_stacked(reg)) {
+		emit(ARM_LDR_I(tmp, ARM_SP, stack_off(reg)), ctx);
+		reg = tmp;
 	}
+	return reg;
+}
 
-	if (ctx->flags & FLAG_NEED_X_RESET)
-		emit(ARM_MOV_I(r_X, 0), ctx);
+static const s8 *arm_bpf_get_reg64(const s8 *reg, const s8 *tmp,
+				   struct jit_ctx *ctx)
+{
+	if (is_stacked(reg[1])) {
+		emit(ARM_LDR_I(tmp[1], ARM_SP, stack_off(reg[1])), ctx);
+		emit(ARM_LDR_I(tmp[0], ARM_SP, stack_off(reg[0])), ctx);
+		reg = tmp;
+	}
+	return reg;
+}
 
-	/* do not leak kernel data to userspace */
-	if (bpf_needs_clear_a(&ctx->skf->insns[0]))
-		emit(ARM_MOV_I(r_A, 0), ctx);
+/* Write back a 32-bit half computed in src to its eBPF register. */
+static void arm_bpf_put_reg32(s8 reg, s8 src, struct jit_ctx *ctx)
+{
+	if (is_stacked(reg))
+		emit(ARM_STR_I(src, ARM_SP, stack_off(reg)), ctx);
+	else if (reg != src)
+		emit(ARM_MOV_R(reg, src), ctx);
+}
 
-	/* stack space for the BPF_MEM words */
-	if (ctx->seen & SEEN_MEM)
-		emit(ARM_SUB_I(ARM_SP, ARM_SP, mem_words_used(ctx) * 4), ctx);
+static void arm_bpf_put_reg64(const s8 *reg, const s8 *src,
+			      struct jit_ctx *ctx)
+{
+	arm_bpf_put_reg32(reg[1], src[1], ctx);
+	arm_bpf_put_reg32(reg[0], src[0], ctx);
 }
 
-static void build_epilogue(struct jit_ctx *ctx)
+static void emit_a32_mov_i(const s8 dst, const u32 val, struct jit_ctx *ctx)
 {
-	u16 reg_set = saved_regs(ctx);
+	if (is_stacked(dst)) {
+		emit_mov_i(ARM_IP, val, ctx);
+		emit(ARM_STR_I(ARM_IP, ARM_SP, stack_off(dst)), ctx);
+	} else {
+		emit_mov_i(dst, val, ctx);
+	}
+}
 
-	if (ctx->seen & SEEN_MEM)
-		emit(ARM_ADD_I(ARM_SP, ARM_SP, mem_words_used(ctx) * 4), ctx);
+static void emit_a32_mov_i64(const s8 *dst, const u64 val,
+			     struct jit_ctx *ctx)
+{
+	emit_a32_mov_i(dst[1], (u32)val, ctx);
+	emit_a32_mov_i(dst[0], val >> 32, ctx);
+}
 
-	reg_set &= ~(1 << ARM_LR);
+/* Sign extended 32-bit immediate, as used by ALU64 and JMP insns. */
+static inline void emit_a32_mov_se_i64(const s8 *dst, const s32 imm,
+				       struct jit_ctx *ctx)
+{
+	emit_a32_mov_i64(dst, (u64)(s64)imm, ctx);
+}
 
-#ifdef CONFIG_FRAME_POINTER
-	/* the first instruction of the prologue was: mov ip, sp */
-	reg_set &= ~(1 << ARM_IP);
-	reg_set |= (1 << ARM_SP);
-	emit(ARM_LDM(ARM_SP, reg_set), ctx);
-#else
-	if (reg_set) {
-		if (ctx->seen & SEEN_CALL)
-			reg_set |= 1 << ARM_PC;
-		emit(ARM_POP(reg_set), ctx);
+/* dst = dst op src, on one 32-bit half of a register pair */
+static void emit_alu_r(const u8 dst, const u8 src, const bool is64,
+		       const bool hi, const u8 op, struct jit_ctx *ctx)
+{
+	switch (op) {
+	case BPF_ADD:
+		if (!is64)
+			emit(ARM_ADD_R(dst, dst, src), ctx);
+		else if (hi)
+			emit(ARM_ADC_R(dst, dst, src), ctx);
+		else
+			emit(ARM_ADDS_R(dst, dst, src), ctx);
+		break;
+	case BPF_SUB:
+		if (!is64)
+			emit(ARM_SUB_R(dst, dst, src), ctx);
+		else if (hi)
+			emit(ARM_SBC_R(dst, dst, src), ctx);
+		else
+			emit(ARM_SUBS_R(dst, dst, src), ctx);
+		break;
+	case BPF_OR:
+		emit(ARM_ORR_R(dst, dst, src), ctx);
+		break;
+	case BPF_AND:
+		emit(ARM_AND_R(dst, dst, src), ctx);
+		break;
+	case BPF_XOR:
+		emit(ARM_EOR_R(dst, dst, src), ctx);
+		break;
+	case BPF_MUL:
+		/* before ARMv6 rd and rm must differ */
+		emit(ARM_MUL(ARM_IP, dst, src), ctx);
+		emit(ARM_MOV_R(dst, ARM_IP), ctx);
+		break;
+	case BPF_LSH:
+		emit(ARM_LSL_R(dst, dst, src), ctx);
+		break;
+	case BPF_RSH:
+		emit(ARM_LSR_R(dst, dst, src), ctx);
+		break;
+	case BPF_ARSH:
+		emit(ARM_ASR_R(dst, dst, src), ctx);
+		break;
 	}
-
-	if (!(ctx->seen & SEEN_CALL))
-		emit(ARM_BX(ARM_LR), ctx);
-#endif
 }
 
-static int16_t imm8m(u32 x)
+/* dst = dst op src, 32-bit ops clear the upper half of dst */
+static void emit_a32_alu_r64(const bool is64, const s8 *dst, const s8 *src,
+			     const u8 op, struct jit_ctx *ctx)
 {
-	u32 rot;
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
 
-	for (rot = 0; rot < 16; rot++)
-		if ((x & ~ror32(0xff, 2 * rot)) == 0)
-			return rol32(x, 2 * rot) | (rot << 8);
+	if (is64) {
+		const s8 *rd = arm_bpf_get_reg64(dst, tmp, ctx);
+		const s8 *rs = arm_bpf_get_reg64(src, tmp2, ctx);
 
-	return -1;
-}
+		emit_alu_r(rd[1], rs[1], true, false, op, ctx);
+		emit_alu_r(rd[0], rs[0], true, true, op, ctx);
+		arm_bpf_put_reg64(dst, rd, ctx);
+	} else {
+		s8 rd = arm_bpf_get_reg32(dst[1], tmp[1], ctx);
+		s8 rs = arm_bpf_get_reg32(src[1], tmp2[1], ctx);
 
-#if __LINUX_ARM_ARCH__ < 7
+		emit_alu_r(rd, rs, false, false, op, ctx);
+		arm_bpf_put_reg32(dst[1], rd, ctx);
+		emit_a32_mov_i(dst[0], 0, ctx);
+	}
+}
 
-static u16 imm_offset(u32 k, struct jit_ctx *ctx)
+/*
+ * dst = dst op imm for the ops that have a short immediate form. Returns
+ * false if imm doesn't fit, the caller then goes the register way.
+ */
+static bool emit_a32_alu_i64(const bool is64, const s8 *dst, const s32 imm,
+			     const u8 op, struct jit_ctx *ctx)
 {
-	unsigned i = 0, offset;
-	u16 imm;
-
-	/* on the "fake" run we just count them (duplicates included) */
-	if (ctx->target == NULL) {
-		ctx->imm_count++;
-		return 0;
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	/* upper half of the sign extended immediate */
+	const u32 imm_hi = (is64 && imm < 0) ? ~0U : 0;
+	int imm12 = imm8m(imm), neg12 = imm8m(-(u32)imm);
+	const s8 *rd;
+
+	switch (op) {
+	case BPF_ADD:
+	case BPF_SUB:
+		if (imm12 < 0 && neg12 < 0)
+			return false;
+		/* the 64-bit forms need the magnitude of the immediate */
+		if (is64 && (imm >= 0 ? imm12 : neg12) < 0)
+			return false;
+		break;
+	case BPF_AND:
+		if (imm12 < 0 && imm8m(~imm) < 0)
+			return false;
+		break;
+	case BPF_OR:
+	case BPF_XOR:
+		if (imm12 < 0)
+			return false;
+		break;
+	default:
+		return false;
 	}
 
-	while ((i < ctx->imm_count) && ctx->imms[i]) {
-		if (ctx->imms[i] == k)
+	if (!is64) {
+		s8 rd32 = arm_bpf_get_reg32(dst[1], tmp[1], ctx);
+
+		switch (op) {
+		case BPF_ADD:
+			if (imm12 >= 0)
+				emit(ARM_ADD_I(rd32, rd32, imm12), ctx);
+			else
+				emit(ARM_SUB_I(rd32, rd32, neg12), ctx);
+			break;
+		case BPF_SUB:
+			if (neg12 >= 0)
+				emit(ARM_ADD_I(rd32, rd32, neg12), ctx);
+			else
+				emit(ARM_SUB_I(rd32, rd32, imm12), ctx);
+			break;
+		case BPF_AND:
+			if (imm12 >= 0)
+				emit(ARM_AND_I(rd32, rd32, imm12), ctx);
+			else
+				emit(ARM_BIC_I(rd32, rd32, imm8m(~imm)), ctx);
 			break;
-		i++;
+		case BPF_OR:
+			emit(ARM_ORR_I(rd32, rd32, imm12), ctx);
+			break;
+		case BPF_XOR:
+			emit(ARM_EOR_I(rd32, rd32, imm12), ctx);
+			break;
+		}
+		arm_bpf_put_reg32(dst[1], rd32, ctx);
+		emit_a32_mov_i(dst[0], 0, ctx);
+		return true;
 	}
 
-	if (ctx->imms[i] == 0)
-		ctx->imms[i] = k;
+	rd = arm_bpf_get_reg64(dst, tmp, ctx);
+
+	switch (op) {
+	case BPF_ADD:
+	case BPF_SUB:
+		/* adding a negative value is subtracting its magnitude */
+		if ((op == BPF_ADD) == (imm >= 0)) {
+			emit(ARM_ADDS_I(rd[1], rd[1],
+					imm >= 0 ? imm12 : neg12), ctx);
+			emit(ARM_ADC_I(rd[0], rd[0], 0), ctx);
+		} else {
+			emit(ARM_SUBS_I(rd[1], rd[1],
+					imm >= 0 ? imm12 : neg12), ctx);
+			emit(ARM_SBC_I(rd[0], rd[0], 0), ctx);
+		}
+		break;
+	case BPF_AND:
+		if (imm12 >= 0)
+			emit(ARM_AND_I(rd[1], rd[1], imm12), ctx);
+		else
+			emit(ARM_BIC_I(rd[1], rd[1], imm8m(~imm)), ctx);
+		if (!imm_hi)
+			emit(ARM_MOV_I(rd[0], 0), ctx);
+		break;
+	case BPF_OR:
+		emit(ARM_ORR_I(rd[1], rd[1], imm12), ctx);
+		if (imm_hi)
+			emit(ARM_MVN_I(rd[0], 0), ctx);
+		break;
+	case BPF_XOR:
+		emit(ARM_EOR_I(rd[1], rd[1], imm12), ctx);
+		if (imm_hi)
+			emit(ARM_MVN_R(rd[0], rd[0]), ctx);
+		break;
+	}
+	arm_bpf_put_reg64(dst, rd, ctx);
+	return true;
+}
 
-	/* constants go just after the epilogue */
-	offset =  ctx->offsets[ctx->skf->len];
-	offset += ctx->prologue_bytes;
-	offset += ctx->epilogue_bytes;
-	offset += i * 4;
+/* dst = dst * src, low 64 bits of the product */
+static void emit_a32_mul_r64(const s8 *dst, const s8 *src,
+			     struct jit_ctx *ctx)
+{
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s8 *rd = arm_bpf_get_reg64(dst, tmp, ctx);
+	const s8 *rs = arm_bpf_get_reg64(src, tmp2, ctx);
+
+	/* hi = dst_hi * src_lo + dst_lo * src_hi + carry of lo * lo */
+	emit(ARM_MUL(ARM_IP, rd[0], rs[1]), ctx);
+	emit(ARM_MUL(ARM_LR, rd[1], rs[0]), ctx);
+	emit(ARM_ADD_R(ARM_LR, ARM_IP, ARM_LR), ctx);
+	emit(ARM_UMULL(ARM_IP, rd[0], rd[1], rs[1]), ctx);
+	emit(ARM_ADD_R(rd[0], ARM_LR, rd[0]), ctx);
+	emit(ARM_MOV_R(rd[1], ARM_IP), ctx);
+
+	arm_bpf_put_reg64(dst, rd, ctx);
+}
 
-	ctx->target[offset / 4] = k;
+/*
+ * dst = dst / src or dst % src. A zero divisor terminates the program
+ * with a return value of 0, like the interpreter does.
+ */
+static void emit_a32_udivmod(const bool is64, const s8 *dst, const s8 *src,
+			     const u8 op, struct jit_ctx *ctx)
+{
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s8 *rd, *rs;
+	u32 func;
+
+	if (is64) {
+		rd = arm_bpf_get_reg64(dst, tmp, ctx);
+		rs = arm_bpf_get_reg64(src, tmp2, ctx);
+		emit(ARM_ORRS_R(ARM_IP, rs[1], rs[0]), ctx);
+	} else {
+		rd = tmp;
+		rs = tmp2;
+		if (arm_bpf_get_reg32(dst[1], tmp[1], ctx) != tmp[1])
+			emit(ARM_MOV_R(tmp[1], dst[1]), ctx);
+		if (arm_bpf_get_reg32(src[1], tmp2[1], ctx) != tmp2[1])
+			emit(ARM_MOV_R(tmp2[1], src[1]), ctx);
+		emit(ARM_CMP_I(tmp2[1], 0), ctx);
+	}
+	_emit(ARM_COND_EQ, ARM_MOV_I(ARM_R0, 0), ctx);
+	_emit(ARM_COND_EQ, ARM_B(epilogue_offset(ctx)), ctx);
 
-	/* PC in ARM mode == address of the instruction + 8 */
-	imm = offset - (8 + ctx->idx * 4);
+#if __LINUX_ARM_ARCH__ == 7
+	if (!is64 && (elf_hwcap & HWCAP_IDIVA)) {
+		if (op == BPF_DIV) {
+			emit(ARM_UDIV(tmp[1], tmp[1], tmp2[1]), ctx);
+		} else {
+			emit(ARM_UDIV(ARM_IP, tmp[1], tmp2[1]), ctx);
+			emit(ARM_MLS(tmp[1], tmp2[1], ARM_IP, tmp[1]), ctx);
+		}
+		goto out;
+	}
+#endif
 
-	if (imm & ~0xfff) {
-		/*
-		 * literal pool is too far, signal it into flags. we
-		 * can only detect it on the second pass unfortunately.
-		 */
-		ctx->flags |= FLAG_IMM_OVERFLOW;
-		return 0;
+	/*
+	 * The operands may live in the argument registers, so gather them
+	 * in the temporaries first and preserve BPF R0/R1 across the call.
+	 */
+	if (rd != tmp) {
+		emit(ARM_MOV_R(tmp[1], rd[1]), ctx);
+		emit(ARM_MOV_R(tmp[0], rd[0]), ctx);
+	}
+	if (rs != tmp2) {
+		emit(ARM_MOV_R(tmp2[1], rs[1]), ctx);
+		emit(ARM_MOV_R(tmp2[0], rs[0]), ctx);
 	}
 
-	return imm;
-}
+	emit(ARM_PUSH(CALLER_MASK), ctx);
+	if (is64) {
+		emit(ARM_MOV_R(ARM_R0, tmp[1]), ctx);
+		emit(ARM_MOV_R(ARM_R1, tmp[0]), ctx);
+		emit(ARM_MOV_R(ARM_R2, tmp2[1]), ctx);
+		emit(ARM_MOV_R(ARM_R3, tmp2[0]), ctx);
+		func = op == BPF_DIV ? (u32)jit_udiv64 : (u32)jit_mod64;
+	} else {
+		emit(ARM_MOV_R(ARM_R0, tmp[1]), ctx);
+		emit(ARM_MOV_R(ARM_R1, tmp2[1]), ctx);
+		func = op == BPF_DIV ? (u32)jit_udiv32 : (u32)jit_mod32;
+	}
+	emit_call(func, ctx);
+	emit(ARM_MOV_R(tmp[1], ARM_R0), ctx);
+	if (is64)
+		emit(ARM_MOV_R(tmp[0], ARM_R1), ctx);
+	emit(ARM_POP(CALLER_MASK), ctx);
 
-#endif /* __LINUX_ARM_ARCH__ */
+#if __LINUX_ARM_ARCH__ == 7
+out:
+#endif
+	if (is64) {
+		arm_bpf_put_reg64(dst, tmp, ctx);
+	} else {
+		arm_bpf_put_reg32(dst[1], tmp[1], ctx);
+		emit_a32_mov_i(dst[0], 0, ctx);
+	}
+}
 
 /*
- * Move an immediate that's not an imm8m to a core register.
+ * 64-bit shifts by a register. ARM register specified shifts use the low
+ * byte of the shift register, so amounts of 32 or more, and "negative"
+ * amounts computed below, shift everything out.
  */
-static inline void emit_mov_i_no8m(int rd, u32 val, struct jit_ctx *ctx)
+static void emit_a32_shift_r64(const s8 *dst, const s8 *src, const u8 op,
+			       struct jit_ctx *ctx)
 {
-#if __LINUX_ARM_ARCH__ < 7
-	emit(ARM_LDR_I(rd, ARM_PC, imm_offset(val, ctx)), ctx);
-#else
-	emit(ARM_MOVW(rd, val & 0xffff), ctx);
-	if (val > 0xffff)
-		emit(ARM_MOVT(rd, val >> 16), ctx);
-#endif
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s8 *rd = arm_bpf_get_reg64(dst, tmp, ctx);
+	s8 rt = arm_bpf_get_reg32(src[1], tmp2[1], ctx);
+
+	/* the shift amount must survive the update of dst */
+	if (rt == rd[1]) {
+		emit(ARM_MOV_R(tmp2[1], rt), ctx);
+		rt = tmp2[1];
+	}
+
+	/* ip = n - 32, lr = 32 - n */
+	emit(ARM_SUB_I(ARM_IP, rt, 32), ctx);
+	emit(ARM_RSB_I(ARM_LR, rt, 32), ctx);
+
+	switch (op) {
+	case BPF_LSH:
+		emit(ARM_LSL_R(rd[0], rd[0], rt), ctx);
+		emit(ARM_ORR_SR(rd[0], rd[0], rd[1], SRTYPE_LSL, ARM_IP), ctx);
+		emit(ARM_ORR_SR(rd[0], rd[0], rd[1], SRTYPE_LSR, ARM_LR), ctx);
+		emit(ARM_LSL_R(rd[1], rd[1], rt), ctx);
+		break;
+	case BPF_RSH:
+		emit(ARM_LSR_R(rd[1], rd[1], rt), ctx);
+		emit(ARM_ORR_SR(rd[1], rd[1], rd[0], SRTYPE_LSL, ARM_LR), ctx);
+		emit(ARM_ORR_SR(rd[1], rd[1], rd[0], SRTYPE_LSR, ARM_IP), ctx);
+		emit(ARM_LSR_R(rd[0], rd[0], rt), ctx);
+		break;
+	case BPF_ARSH:
+		/* an arithmetic shift by >= 32 fills with the sign instead */
+		emit(ARM_CMP_I(ARM_IP, 0), ctx);
+		emit(ARM_LSR_R(rd[1], rd[1], rt), ctx);
+		emit(ARM_ORR_SR(rd[1], rd[1], rd[0], SRTYPE_LSL, ARM_LR), ctx);
+		_emit(ARM_COND_PL,
+		      ARM_ORR_SR(rd[1], rd[1], rd[0], SRTYPE_ASR, ARM_IP), ctx);
+		emit(ARM_ASR_R(rd[0], rd[0], rt), ctx);
+		break;
+	}
+
+	arm_bpf_put_reg64(dst, rd, ctx);
 }
 
-static inline void emit_mov_i(int rd, u32 val, struct jit_ctx *ctx)
+static void emit_a32_shift_i64(const s8 *dst, const u32 n, const u8 op,
+			       struct jit_ctx *ctx)
 {
-	int imm12 = imm8m(val);
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *rd;
 
-	if (imm12 >= 0)
-		emit(ARM_MOV_I(rd, imm12), ctx);
-	else
-		emit_mov_i_no8m(rd, val, ctx);
-}
+	if (n == 0)
+		return;
 
-#if __LINUX_ARM_ARCH__ < 6
+	rd = arm_bpf_get_reg64(dst, tmp, ctx);
+
+	/* immediate shifts by 0 encode shifts by 32 for LSR and ASR */
+	switch (op) {
+	case BPF_LSH:
+		if (n < 32) {
+			emit(ARM_LSL_I(rd[0], rd[0], n), ctx);
+			emit(ARM_ORR_SI(rd[0], rd[0], rd[1], SRTYPE_LSR, 32 - n),
+			     ctx);
+			emit(ARM_LSL_I(rd[1], rd[1], n), ctx);
+		} else {
+			emit(ARM_LSL_I(rd[0], rd[1], n - 32), ctx);
+			emit(ARM_MOV_I(rd[1], 0), ctx);
+		}
+		break;
+	case BPF_RSH:
+		if (n < 32) {
+			emit(ARM_LSR_I(rd[1], rd[1], n), ctx);
+			emit(ARM_ORR_SI(rd[1], rd[1], rd[0], SRTYPE_LSL, 32 - n),
+			     ctx);
+			emit(ARM_LSR_I(rd[0], rd[0], n), ctx);
+		} else {
+			if (n == 32)
+				emit(ARM_MOV_R(rd[1], rd[0]), ctx);
+			else
+				emit(ARM_LSR_I(rd[1], rd[0], n - 32), ctx);
+			emit(ARM_MOV_I(rd[0], 0), ctx);
+		}
+		break;
+	case BPF_ARSH:
+		if (n < 32) {
+			emit(ARM_LSR_I(rd[1], rd[1], n), ctx);
+			emit(ARM_ORR_SI(rd[1], rd[1], rd[0], SRTYPE_LSL, 32 - n),
+			     ctx);
+			emit(ARM_ASR_I(rd[0], rd[0], n), ctx);
+		} else {
+			if (n == 32)
+				emit(ARM_MOV_R(rd[1], rd[0]), ctx);
+			else
+				emit(ARM_ASR_I(rd[1], rd[0], n - 32), ctx);
+			emit(ARM_ASR_I(rd[0], rd[0], 31), ctx);
+		}
+		break;
+	}
 
-static void emit_load_be32(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
-{
-	_emit(cond, ARM_LDRB_I(ARM_R3, r_addr, 1), ctx);
-	_emit(cond, ARM_LDRB_I(ARM_R1, r_addr, 0), ctx);
-	_emit(cond, ARM_LDRB_I(ARM_R2, r_addr, 3), ctx);
-	_emit(cond, ARM_LSL_I(ARM_R3, ARM_R3, 16), ctx);
-	_emit(cond, ARM_LDRB_I(ARM_R0, r_addr, 2), ctx);
-	_emit(cond, ARM_ORR_S(ARM_R3, ARM_R3, ARM_R1, SRTYPE_LSL, 24), ctx);
-	_emit(cond, ARM_ORR_R(ARM_R3, ARM_R3, ARM_R2), ctx);
-	_emit(cond, ARM_ORR_S(r_res, ARM_R3, ARM_R0, SRTYPE_LSL, 8), ctx);
+	arm_bpf_put_reg64(dst, rd, ctx);
 }
 
-static void emit_load_be16(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
+static void emit_a32_shift_i32(const s8 *dst, const u32 n, const u8 op,
+			       struct jit_ctx *ctx)
 {
-	_emit(cond, ARM_LDRB_I(ARM_R1, r_addr, 0), ctx);
-	_emit(cond, ARM_LDRB_I(ARM_R2, r_addr, 1), ctx);
-	_emit(cond, ARM_ORR_S(r_res, ARM_R2, ARM_R1, SRTYPE_LSL, 8), ctx);
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	s8 rd = arm_bpf_get_reg32(dst[1], tmp[1], ctx);
+
+	if (n) {
+		switch (op) {
+		case BPF_LSH:
+			emit(ARM_LSL_I(rd, rd, n), ctx);
+			break;
+		case BPF_RSH:
+			emit(ARM_LSR_I(rd, rd, n), ctx);
+			break;
+		case BPF_ARSH:
+			emit(ARM_ASR_I(rd, rd, n), ctx);
+			break;
+		}
+	}
+
+	arm_bpf_put_reg32(dst[1], rd, ctx);
+	emit_a32_mov_i(dst[0], 0, ctx);
 }
 
-static inline void emit_swap16(u8 r_dst, u8 r_src, struct jit_ctx *ctx)
+static void emit_a32_neg64(const s8 *dst, struct jit_ctx *ctx)
 {
-	/* r_dst = (r_src << 8) | (r_src >> 8) */
-	emit(ARM_LSL_I(ARM_R1, r_src, 8), ctx);
-	emit(ARM_ORR_S(r_dst, ARM_R1, r_src, SRTYPE_LSR, 8), ctx);
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *rd = arm_bpf_get_reg64(dst, tmp, ctx);
 
-	/*
-	 * we need to mask out the bits set in r_dst[23:16] due to
-	 * the first shift instruction.
-	 *
-	 * note that 0x8ff is the encoded immediate 0x00ff0000.
-	 */
-	emit(ARM_BIC_I(r_dst, r_dst, 0x8ff), ctx);
-}
+	emit(ARM_RSBS_I(rd[1], rd[1], 0), ctx);
+	emit(ARM_RSC_I(rd[0], rd[0], 0), ctx);
 
-#else  /* ARMv6+ */
+	arm_bpf_put_reg64(dst, rd, ctx);
+}
 
-static void emit_load_be32(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
+/* rd = bswap32(rn), rd may be equal to rn */
+static inline void emit_rev32(const u8 rd, const u8 rn, struct jit_ctx *ctx)
 {
-	_emit(cond, ARM_LDR_I(r_res, r_addr, 0), ctx);
-#ifdef __LITTLE_ENDIAN
-	_emit(cond, ARM_REV(r_res, r_res), ctx);
+#if __LINUX_ARM_ARCH__ < 6
+	/* note that 0x8ff is the encoded immediate 0x00ff0000 */
+	emit(ARM_EOR_SI(ARM_IP, rn, rn, SRTYPE_ROR, 16), ctx);
+	emit(ARM_BIC_I(ARM_IP, ARM_IP, 0x8ff), ctx);
+	emit(ARM_MOV_SI(rd, rn, SRTYPE_ROR, 8), ctx);
+	emit(ARM_EOR_SI(rd, rd, ARM_IP, SRTYPE_LSR, 8), ctx);
+#else
+	emit(ARM_REV(rd, rn), ctx);
 #endif
 }
 
-static void emit_load_be16(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
+/* rd = bswap16(rn & 0xffff), zero extended */
+static inline void emit_rev16(const u8 rd, const u8 rn, struct jit_ctx *ctx)
 {
-	_emit(cond, ARM_LDRH_I(r_res, r_addr, 0), ctx);
-#ifdef __LITTLE_ENDIAN
-	_emit(cond, ARM_REV16(r_res, r_res), ctx);
+#if __LINUX_ARM_ARCH__ < 6
+	emit(ARM_AND_I(ARM_IP, rn, 0xff), ctx);
+	emit(ARM_LSR_I(rd, rn, 8), ctx);
+	emit(ARM_AND_I(rd, rd, 0xff), ctx);
+	emit(ARM_ORR_SI(rd, rd, ARM_IP, SRTYPE_LSL, 8), ctx);
+#else
+	emit(ARM_REV16(rd, rn), ctx);
+	emit(ARM_UXTH(rd, rd), ctx);
 #endif
 }
 
-static inline void emit_swap16(u8 r_dst __maybe_unused,
-			       u8 r_src __maybe_unused,
-			       struct jit_ctx *ctx __maybe_unused)
+/* rd = rn & 0xffff */
+static inline void emit_uxth(const u8 rd, const u8 rn, struct jit_ctx *ctx)
 {
-#ifdef __LITTLE_ENDIAN
-	emit(ARM_REV16(r_dst, r_src), ctx);
+#if __LINUX_ARM_ARCH__ < 6
+	emit(ARM_LSL_I(rd, rn, 16), ctx);
+	emit(ARM_LSR_I(rd, rd, 16), ctx);
+#else
+	emit(ARM_UXTH(rd, rn), ctx);
 #endif
 }
 
-#endif /* __LINUX_ARM_ARCH__ < 6 */
+static void emit_a32_endian(const s8 *dst, const u8 src, const s32 imm,
+			    struct jit_ctx *ctx)
+{
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *rd = arm_bpf_get_reg64(dst, tmp, ctx);
+
+	/* the JIT only runs on little endian kernels */
+	if (src == BPF_FROM_LE) {
+		switch (imm) {
+		case 16:
+			emit_uxth(rd[1], rd[1], ctx);
+			/* fall through */
+		case 32:
+			emit(ARM_MOV_I(rd[0], 0), ctx);
+			break;
+		case 64:
+			break;
+		}
+	} else {
+		switch (imm) {
+		case 16:
+			emit_rev16(rd[1], rd[1], ctx);
+			emit(ARM_MOV_I(rd[0], 0), ctx);
+			break;
+		case 32:
+			emit_rev32(rd[1], rd[1], ctx);
+			emit(ARM_MOV_I(rd[0], 0), ctx);
+			break;
+		case 64:
+			emit_rev32(ARM_LR, rd[1], ctx);
+			emit_rev32(rd[1], rd[0], ctx);
+			emit(ARM_MOV_R(rd[0], ARM_LR), ctx);
+			break;
+		}
+	}
 
+	arm_bpf_put_reg64(dst, rd, ctx);
+}
 
-/* Compute the immediate value for a PC-relative branch. */
-static inline u32 b_imm(unsigned tgt, struct jit_ctx *ctx)
+/*
+ * Fold out of range offsets into the base register. The word accesses
+ * reach +-4095, halfword ones only +-255.
+ */
+static s8 arm_bpf_ldst_base(s8 rn, s32 *off, const u8 sz,
+			    struct jit_ctx *ctx)
 {
-	u32 imm;
+	s32 off_max = sz == BPF_H ? 0xff : 0xfff;
 
-	if (ctx->target == NULL)
-		return 0;
-	/*
-	 * BPF allows only forward jumps and the offset of the target is
-	 * still the one computed during the first pass.
-	 */
-	imm  = ctx->offsets[tgt] + ctx->prologue_bytes - (ctx->idx * 4 + 8);
+	if (sz == BPF_DW)
+		off_max -= 4;
 
-	return imm >> 2;
+	if (*off < -off_max || *off > off_max) {
+		emit_add_i(ARM_IP, rn, *off, ctx);
+		*off = 0;
+		return ARM_IP;
+	}
+	return rn;
 }
 
-#define OP_IMM3(op, r1, r2, imm_val, ctx)				\
-	do {								\
-		imm12 = imm8m(imm_val);					\
-		if (imm12 < 0) {					\
-			emit_mov_i_no8m(r_scratch, imm_val, ctx);	\
-			emit(op ## _R((r1), (r2), r_scratch), ctx);	\
-		} else {						\
-			emit(op ## _I((r1), (r2), imm12), ctx);		\
-		}							\
-	} while (0)
-
-static inline void emit_err_ret(u8 cond, struct jit_ctx *ctx)
+/* dst = *(size *)(src + off) */
+static void emit_ldx_r(const s8 *dst, const s8 *src, s32 off, const u8 sz,
+		       struct jit_ctx *ctx)
 {
-	if (ctx->ret0_fp_idx >= 0) {
-		_emit(cond, ARM_B(b_imm(ctx->ret0_fp_idx, ctx)), ctx);
-		/* NOP to keep the size constant between passes */
-		emit(ARM_MOV_R(ARM_R0, ARM_R0), ctx);
-	} else {
-		_emit(cond, ARM_MOV_I(ARM_R0, 0), ctx);
-		_emit(cond, ARM_B(b_imm(ctx->skf->len, ctx)), ctx);
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *rd = is_stacked(dst[1]) ? tmp : dst;
+	s8 rm = arm_bpf_get_reg32(src[1], tmp[1], ctx);
+
+	rm = arm_bpf_ldst_base(rm, &off, sz, ctx);
+
+	switch (sz) {
+	case BPF_B:
+		emit(ARM_LDRB_I(rd[1], rm, off), ctx);
+		emit(ARM_MOV_I(rd[0], 0), ctx);
+		break;
+	case BPF_H:
+		emit(ARM_LDRH_I(rd[1], rm, off), ctx);
+		emit(ARM_MOV_I(rd[0], 0), ctx);
+		break;
+	case BPF_W:
+		emit(ARM_LDR_I(rd[1], rm, off), ctx);
+		emit(ARM_MOV_I(rd[0], 0), ctx);
+		break;
+	case BPF_DW:
+		/* don't clobber the base before the second load */
+		if (rm == rd[1]) {
+			emit(ARM_LDR_I(rd[0], rm, off + 4), ctx);
+			emit(ARM_LDR_I(rd[1], rm, off), ctx);
+		} else {
+			emit(ARM_LDR_I(rd[1], rm, off), ctx);
+			emit(ARM_LDR_I(rd[0], rm, off + 4), ctx);
+		}
+		break;
 	}
+
+	arm_bpf_put_reg64(dst, rd, ctx);
 }
 
-static inline void emit_blx_r(u8 tgt_reg, struct jit_ctx *ctx)
+/* *(size *)(dst + off) = src, where src is a register pair */
+static void emit_str_r(const s8 *dst, const s8 *rs, s32 off, const u8 sz,
+		       struct jit_ctx *ctx)
 {
-#if __LINUX_ARM_ARCH__ < 5
-	emit(ARM_MOV_R(ARM_LR, ARM_PC), ctx);
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	s8 rd = arm_bpf_get_reg32(dst[1], tmp[1], ctx);
+
+	rd = arm_bpf_ldst_base(rd, &off, sz, ctx);
+
+	switch (sz) {
+	case BPF_B:
+		emit(ARM_STRB_I(rs[1], rd, off), ctx);
+		break;
+	case BPF_H:
+		emit(ARM_STRH_I(rs[1], rd, off), ctx);
+		break;
+	case BPF_W:
+		emit(ARM_STR_I(rs[1], rd, off), ctx);
+		break;
+	case BPF_DW:
+		emit(ARM_STR_I(rs[1], rd, off), ctx);
+		emit(ARM_STR_I(rs[0], rd, off + 4), ctx);
+		break;
+	}
+}
 
-	if (elf_hwcap & HWCAP_THUMB)
-		emit(ARM_BX(tgt_reg), ctx);
-	else
-		emit(ARM_MOV_R(ARM_PC, tgt_reg), ctx);
+/* lock *(size *)(dst + off) += src */
+static int emit_a32_xadd(const s8 *dst, const s8 *src, s32 off, const u8 sz,
+			 struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ >= 7
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s8 *rs = arm_bpf_get_reg64(src, tmp2, ctx);
+	s8 rn = arm_bpf_get_reg32(dst[1], tmp[1], ctx);
+	unsigned int loop;
+
+	/* the exclusive accesses have no offset, keep the address in ip */
+	emit_add_i(ARM_IP, rn, off, ctx);
+
+	loop = ctx->idx;
+	if (sz == BPF_W) {
+		emit(ARM_LDREX(tmp[1], ARM_IP), ctx);
+		emit(ARM_ADD_R(tmp[1], tmp[1], rs[1]), ctx);
+		emit(ARM_STREX(ARM_LR, tmp[1], ARM_IP), ctx);
+	} else {
+		/* ldrexd/strexd operate on the even/odd pair r6/r7 */
+		emit(ARM_LDREXD(tmp[1], ARM_IP), ctx);
+		emit(ARM_ADDS_R(tmp[1], tmp[1], rs[1]), ctx);
+		emit(ARM_ADC_R(tmp[0], tmp[0], rs[0]), ctx);
+		emit(ARM_STREXD(ARM_LR, tmp[1], ARM_IP), ctx);
+	}
+	emit(ARM_CMP_I(ARM_LR, 0), ctx);
+	_emit(ARM_COND_NE, ARM_B(loop - (ctx->idx + 2)), ctx);
+	return 0;
 #else
-	emit(ARM_BLX_R(tgt_reg), ctx);
+	/* no exclusive doubleword access, leave it to the interpreter */
+	return -EFAULT;
 #endif
 }
 
-static inline void emit_udivmod(u8 rd, u8 rm, u8 rn, struct jit_ctx *ctx,
-				int bpf_op)
+/*
+ * Set the flags for dst <op> src so that the condition returned by
+ * bpf_cond_to_arm() holds iff the jump is to be taken.
+ */
+static void emit_a32_cmp_r64(const s8 *rd, const s8 *rs, const u8 op,
+			     struct jit_ctx *ctx)
 {
-#if __LINUX_ARM_ARCH__ == 7
-	if (elf_hwcap & HWCAP_IDIVA) {
-		if (bpf_op == BPF_DIV)
-			emit(ARM_UDIV(rd, rm, rn), ctx);
-		else {
-			emit(ARM_UDIV(ARM_R3, rm, rn), ctx);
-			emit(ARM_MLS(rd, rn, ARM_R3, rm), ctx);
-		}
-		return;
+	switch (op) {
+	case BPF_JEQ:
+	case BPF_JNE:
+	case BPF_JGT:
+	case BPF_JGE:
+		emit(ARM_CMP_R(rd[0], rs[0]), ctx);
+		_emit(ARM_COND_EQ, ARM_CMP_R(rd[1], rs[1]), ctx);
+		break;
+	case BPF_JSET:
+		emit(ARM_TST_R(rd[0], rs[0]), ctx);
+		_emit(ARM_COND_EQ, ARM_TST_R(rd[1], rs[1]), ctx);
+		break;
+	case BPF_JSGT:
+		/* dst > src <=> src - dst < 0 */
+		emit(ARM_CMP_R(rs[1], rd[1]), ctx);
+		emit(ARM_SBCS_R(ARM_IP, rs[0], rd[0]), ctx);
+		break;
+	case BPF_JSGE:
+		/* dst >= src <=> dst - src >= 0 */
+		emit(ARM_CMP_R(rd[1], rs[1]), ctx);
+		emit(ARM_SBCS_R(ARM_IP, rd[0], rs[0]), ctx);
+		break;
 	}
-#endif
+}
 
-	/*
-	 * For BPF_ALU | BPF_DIV | BPF_K instructions, rm is ARM_R4
-	 * (r_A) and rn is ARM_R0 (r_scratch) so load rn first into
-	 * ARM_R1 to avoid accidentally overwriting ARM_R0 with rm
-	 * before using it as a source for ARM_R1.
-	 *
-	 * For BPF_ALU | BPF_DIV | BPF_X rm is ARM_R4 (r_A) and rn is
-	 * ARM_R5 (r_X) so there is no particular register overlap
-	 * issues.
-	 */
-	if (rn != ARM_R1)
-		emit(ARM_MOV_R(ARM_R1, rn), ctx);
-	if (rm != ARM_R0)
-		emit(ARM_MOV_R(ARM_R0, rm), ctx);
-
-	ctx->seen |= SEEN_CALL;
-	emit_mov_i(ARM_R3, bpf_op == BPF_DIV ? (u32)jit_udiv : (u32)jit_mod,
-		   ctx);
-	emit_blx_r(ARM_R3, ctx);
-
-	if (rd != ARM_R0)
-		emit(ARM_MOV_R(rd, ARM_R0), ctx);
+static u8 bpf_cond_to_arm(const u8 op)
+{
+	switch (op) {
+	case BPF_JEQ:
+		return ARM_COND_EQ;
+	case BPF_JNE:
+	case BPF_JSET:
+		return ARM_COND_NE;
+	case BPF_JGT:
+		return ARM_COND_HI;
+	case BPF_JGE:
+		return ARM_COND_CS;
+	case BPF_JSGT:
+		return ARM_COND_LT;
+	case BPF_JSGE:
+		return ARM_COND_GE;
+	}
+	return ARM_COND_AL;
 }
 
-static inline void update_on_xread(struct jit_ctx *ctx)
+static int emit_bpf_tail_call(struct jit_ctx *ctx)
 {
-	if (!(ctx->seen & SEEN_X))
-		ctx->flags |= FLAG_NEED_X_RESET;
+	/* bpf_tail_call(void *prog_ctx, struct bpf_array *array, u64 index) */
+	const s8 *r2 = bpf2a32[BPF_REG_2];
+	const s8 *r3 = bpf2a32[BPF_REG_3];
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s8 *tcc = bpf2a32[TCALL_CNT];
+	const int idx0 = ctx->idx;
+#define cur_offset (ctx->idx - idx0)
+#define jmp_offset (ctx->tail_call_out - (cur_offset) - 2)
+	s8 r_array, r_index, r_index_hi, r_tcc;
+	u32 off;
+
+	/* if (index >= array->map.max_entries)
+	 *     goto out;
+	 */
+	r_array = arm_bpf_get_reg32(r2[1], tmp[1], ctx);
+	r_index = arm_bpf_get_reg32(r3[1], tmp2[1], ctx);
+	r_index_hi = arm_bpf_get_reg32(r3[0], tmp2[0], ctx);
+	off = offsetof(struct bpf_array, map.max_entries);
+	emit(ARM_LDR_I(tmp[0], r_array, off), ctx);
+	/* index is u64, any bit set in the upper half is out of range */
+	emit(ARM_CMP_I(r_index_hi, 0), ctx);
+	_emit(ARM_COND_EQ, ARM_CMP_R(r_index, tmp[0]), ctx);
+	_emit(ARM_COND_CS, ARM_B(jmp_offset), ctx);
+
+	/* if (tail_call_cnt > MAX_TAIL_CALL_CNT)
+	 *     goto out;
+	 * tail_call_cnt++;
+	 */
+	r_tcc = arm_bpf_get_reg32(tcc[1], tmp[0], ctx);
+	emit(ARM_CMP_I(r_tcc, MAX_TAIL_CALL_CNT), ctx);
+	_emit(ARM_COND_HI, ARM_B(jmp_offset), ctx);
+	emit(ARM_ADD_I(r_tcc, r_tcc, 1), ctx);
+	arm_bpf_put_reg32(tcc[1], r_tcc, ctx);
+
+	/* prog = array->ptrs[index];
+	 * if (prog == NULL)
+	 *     goto out;
+	 */
+	off = offsetof(struct bpf_array, ptrs);
+	emit_add_i(tmp[0], r_array, off, ctx);
+	emit(ARM_LDR_R_SI(tmp[0], tmp[0], r_index, SRTYPE_LSL, 2), ctx);
+	emit(ARM_CMP_I(tmp[0], 0), ctx);
+	_emit(ARM_COND_EQ, ARM_B(jmp_offset), ctx);
+
+	/* goto *(prog->bpf_func + prologue_size);
+	 *
+	 * All programs share the same prologue, the target skips it and
+	 * runs on the current frame with R1 still holding the context.
+	 */
+	off = offsetof(struct bpf_prog, bpf_func);
+	emit(ARM_LDR_I(tmp[0], tmp[0], off), ctx);
+	emit_add_i(tmp[0], tmp[0], ctx->prologue_bytes, ctx);
+	emit(ARM_MOV_R(ARM_PC, tmp[0]), ctx);
 
-	ctx->seen |= SEEN_X;
+	/* out: */
+	if (ctx->target == NULL)
+		ctx->tail_call_out = cur_offset;
+	if (cur_offset != ctx->tail_call_out) {
+		pr_err_once("tail_call out_offset = %d, expected %d!\n",
+			    cur_offset, ctx->tail_call_out);
+		return -1;
+	}
+	return 0;
+#undef cur_offset
+#undef jmp_offset
 }
 
-static int build_body(struct jit_ctx *ctx)
+static void build_prologue(struct jit_ctx *ctx)
 {
-	void *load_func[] = {jit_get_skb_b, jit_get_skb_h, jit_get_skb_w};
-	const struct bpf_prog *prog = ctx->skf;
-	const struct sock_filter *inst;
-	unsigned i, load_order, off, condt;
-	int imm12;
-	u32 k;
+	const s8 *r1 = bpf2a32[BPF_REG_1];
+	const s8 *fp = bpf2a32[BPF_REG_FP];
+	const s8 *tcc = bpf2a32[TCALL_CNT];
 
-	for (i = 0; i < prog->len; i++) {
-		u16 code;
+#ifdef CONFIG_FRAME_POINTER
+	emit(ARM_MOV_R(ARM_IP, ARM_SP), ctx);
+	emit(ARM_PUSH(CALLEE_PUSH_MASK | 1 << ARM_IP | 1 << ARM_PC), ctx);
+	emit(ARM_SUB_I(ARM_FP, ARM_IP, 4), ctx);
+#else
+	emit(ARM_PUSH(CALLEE_PUSH_MASK), ctx);
+#endif
 
-		inst = &(prog->insns[i]);
-		/* K as an immediate value operand */
-		k = inst->k;
-		code = bpf_anc_helper(inst);
+	/* stack space for the BPF stack and the stacked registers */
+	emit(ARM_SUB_I(ARM_SP, ARM_SP, imm8m(STACK_SIZE)), ctx);
 
-		/* compute offsets only in the fake pass */
-		if (ctx->target == NULL)
-			ctx->offsets[i] = ctx->idx * 4;
+	/* set up BPF prog stack base register */
+	emit(ARM_ADD_I(ARM_IP, ARM_SP, imm8m(STACK_SIZE)), ctx);
+	emit(ARM_STR_I(ARM_IP, ARM_SP, stack_off(fp[1])), ctx);
+	emit(ARM_MOV_I(ARM_IP, 0), ctx);
+	emit(ARM_STR_I(ARM_IP, ARM_SP, stack_off(fp[0])), ctx);
 
-		switch (code) {
-		case BPF_LD | BPF_IMM:
-			emit_mov_i(r_A, k, ctx);
-			break;
-		case BPF_LD | BPF_W | BPF_LEN:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
-			emit(ARM_LDR_I(r_A, r_skb,
-				       offsetof(struct sk_buff, len)), ctx);
-			break;
-		case BPF_LD | BPF_MEM:
-			/* A = scratch[k] */
-			ctx->seen |= SEEN_MEM_WORD(k);
-			emit(ARM_LDR_I(r_A, ARM_SP, SCRATCH_OFF(k)), ctx);
-			break;
-		case BPF_LD | BPF_W | BPF_ABS:
-			load_order = 2;
-			goto load;
-		case BPF_LD | BPF_H | BPF_ABS:
-			load_order = 1;
-			goto load;
-		case BPF_LD | BPF_B | BPF_ABS:
-			load_order = 0;
-load:
-			emit_mov_i(r_off, k, ctx);
-load_common:
-			ctx->seen |= SEEN_DATA | SEEN_CALL;
-
-			if (load_order > 0) {
-				emit(ARM_SUB_I(r_scratch, r_skb_hl,
-					       1 << load_order), ctx);
-				emit(ARM_CMP_R(r_scratch, r_off), ctx);
-				condt = ARM_COND_GE;
-			} else {
-				emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
-				condt = ARM_COND_HI;
-			}
-
-			/*
-			 * test for negative offset, only if we are
-			 * currently scheduled to take the fast
-			 * path. this will update the flags so that
-			 * the slowpath instruction are ignored if the
-			 * offset is negative.
-			 *
-			 * for loard_order == 0 the HI condition will
-			 * make loads at offset 0 take the slow path too.
-			 */
-			_emit(condt, ARM_CMP_I(r_off, 0), ctx);
-
-			_emit(condt, ARM_ADD_R(r_scratch, r_off, r_skb_data),
-			      ctx);
-
-			if (load_order == 0)
-				_emit(condt, ARM_LDRB_I(r_A, r_scratch, 0),
-				      ctx);
-			else if (load_order == 1)
-				emit_load_be16(condt, r_A, r_scratch, ctx);
-			else if (load_order == 2)
-				emit_load_be32(condt, r_A, r_scratch, ctx);
-
-			_emit(condt, ARM_B(b_imm(i + 1, ctx)), ctx);
-
-			/* the slowpath */
-			emit_mov_i(ARM_R3, (u32)load_func[load_order], ctx);
-			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
-			/* the offset is already in R1 */
-			emit_blx_r(ARM_R3, ctx);
-			/* check the result of skb_copy_bits */
-			emit(ARM_CMP_I(ARM_R1, 0), ctx);
-			emit_err_ret(ARM_COND_NE, ctx);
-			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
-			break;
-		case BPF_LD | BPF_W | BPF_IND:
-			load_order = 2;
-			goto load_ind;
-		case BPF_LD | BPF_H | BPF_IND:
-			load_order = 1;
-			goto load_ind;
-		case BPF_LD | BPF_B | BPF_IND:
-			load_order = 0;
-load_ind:
-			update_on_xread(ctx);
-			OP_IMM3(ARM_ADD, r_off, r_X, k, ctx);
-			goto load_common;
-		case BPF_LDX | BPF_IMM:
-			ctx->seen |= SEEN_X;
-			emit_mov_i(r_X, k, ctx);
-			break;
-		case BPF_LDX | BPF_W | BPF_LEN:
-			ctx->seen |= SEEN_X | SEEN_SKB;
-			emit(ARM_LDR_I(r_X, r_skb,
-				       offsetof(struct sk_buff, len)), ctx);
-			break;
-		case BPF_LDX | BPF_MEM:
-			ctx->seen |= SEEN_X | SEEN_MEM_WORD(k);
-			emit(ARM_LDR_I(r_X, ARM_SP, SCRATCH_OFF(k)), ctx);
-			break;
-		case BPF_LDX | BPF_B | BPF_MSH:
-			/* x = ((*(frame + k)) & 0xf) << 2; */
-			ctx->seen |= SEEN_X | SEEN_DATA | SEEN_CALL;
-			/* the interpreter should deal with the negative K */
-			if ((int)k < 0)
-				return -1;
-			/* offset in r1: we might have to take the slow path */
-			emit_mov_i(r_off, k, ctx);
-			emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
-
-			/* load in r0: common with the slowpath */
-			_emit(ARM_COND_HI, ARM_LDRB_R(ARM_R0, r_skb_data,
-						      ARM_R1), ctx);
-			/*
-			 * emit_mov_i() might generate one or two instructions,
-			 * the same holds for emit_blx_r()
-			 */
-			_emit(ARM_COND_HI, ARM_B(b_imm(i + 1, ctx) - 2), ctx);
-
-			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
-			/* r_off is r1 */
-			emit_mov_i(ARM_R3, (u32)jit_get_skb_b, ctx);
-			emit_blx_r(ARM_R3, ctx);
-			/* check the return value of skb_copy_bits */
-			emit(ARM_CMP_I(ARM_R1, 0), ctx);
-			emit_err_ret(ARM_COND_NE, ctx);
-
-			emit(ARM_AND_I(r_X, ARM_R0, 0x00f), ctx);
-			emit(ARM_LSL_I(r_X, r_X, 2), ctx);
-			break;
-		case BPF_ST:
-			ctx->seen |= SEEN_MEM_WORD(k);
-			emit(ARM_STR_I(r_A, ARM_SP, SCRATCH_OFF(k)), ctx);
-			break;
-		case BPF_STX:
-			update_on_xread(ctx);
-			ctx->seen |= SEEN_MEM_WORD(k);
-			emit(ARM_STR_I(r_X, ARM_SP, SCRATCH_OFF(k)), ctx);
-			break;
-		case BPF_ALU | BPF_ADD | BPF_K:
-			/* A += K */
-			OP_IMM3(ARM_ADD, r_A, r_A, k, ctx);
-			break;
-		case BPF_ALU | BPF_ADD | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_ADD_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_SUB | BPF_K:
-			/* A -= K */
-			OP_IMM3(ARM_SUB, r_A, r_A, k, ctx);
-			break;
-		case BPF_ALU | BPF_SUB | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_SUB_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_MUL | BPF_K:
-			/* A *= K */
-			emit_mov_i(r_scratch, k, ctx);
-			emit(ARM_MUL(r_A, r_A, r_scratch), ctx);
-			break;
-		case BPF_ALU | BPF_MUL | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_MUL(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_DIV | BPF_K:
-			if (k == 1)
-				break;
-			emit_mov_i(r_scratch, k, ctx);
-			emit_udivmod(r_A, r_A, r_scratch, ctx, BPF_DIV);
-			break;
-		case BPF_ALU | BPF_DIV | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_CMP_I(r_X, 0), ctx);
-			emit_err_ret(ARM_COND_EQ, ctx);
-			emit_udivmod(r_A, r_A, r_X, ctx, BPF_DIV);
-			break;
-		case BPF_ALU | BPF_MOD | BPF_K:
-			if (k == 1) {
-				emit_mov_i(r_A, 0, ctx);
-				break;
-			}
-			emit_mov_i(r_scratch, k, ctx);
-			emit_udivmod(r_A, r_A, r_scratch, ctx, BPF_MOD);
-			break;
-		case BPF_ALU | BPF_MOD | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_CMP_I(r_X, 0), ctx);
-			emit_err_ret(ARM_COND_EQ, ctx);
-			emit_udivmod(r_A, r_A, r_X, ctx, BPF_MOD);
-			break;
-		case BPF_ALU | BPF_OR | BPF_K:
-			/* A |= K */
-			OP_IMM3(ARM_ORR, r_A, r_A, k, ctx);
-			break;
-		case BPF_ALU | BPF_OR | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_ORR_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_XOR | BPF_K:
-			/* A ^= K; */
-			OP_IMM3(ARM_EOR, r_A, r_A, k, ctx);
-			break;
-		case BPF_ANC | SKF_AD_ALU_XOR_X:
-		case BPF_ALU | BPF_XOR | BPF_X:
-			/* A ^= X */
-			update_on_xread(ctx);
-			emit(ARM_EOR_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_AND | BPF_K:
-			/* A &= K */
-			OP_IMM3(ARM_AND, r_A, r_A, k, ctx);
-			break;
-		case BPF_ALU | BPF_AND | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_AND_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_LSH | BPF_K:
-			if (unlikely(k > 31))
-				return -1;
-			emit(ARM_LSL_I(r_A, r_A, k), ctx);
-			break;
-		case BPF_ALU | BPF_LSH | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_LSL_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_RSH | BPF_K:
-			if (unlikely(k > 31))
-				return -1;
-			if (k)
-				emit(ARM_LSR_I(r_A, r_A, k), ctx);
-			break;
-		case BPF_ALU | BPF_RSH | BPF_X:
-			update_on_xread(ctx);
-			emit(ARM_LSR_R(r_A, r_A, r_X), ctx);
-			break;
-		case BPF_ALU | BPF_NEG:
-			/* A = -A */
-			emit(ARM_RSB_I(r_A, r_A, 0), ctx);
-			break;
-		case BPF_JMP | BPF_JA:
-			/* pc += K */
-			emit(ARM_B(b_imm(i + k + 1, ctx)), ctx);
-			break;
-		case BPF_JMP | BPF_JEQ | BPF_K:
-			/* pc += (A == K) ? pc->jt : pc->jf */
-			condt  = ARM_COND_EQ;
-			goto cmp_imm;
-		case BPF_JMP | BPF_JGT | BPF_K:
-			/* pc += (A > K) ? pc->jt : pc->jf */
-			condt  = ARM_COND_HI;
-			goto cmp_imm;
-		case BPF_JMP | BPF_JGE | BPF_K:
-			/* pc += (A >= K) ? pc->jt : pc->jf */
-			condt  = ARM_COND_HS;
-cmp_imm:
-			imm12 = imm8m(k);
-			if (imm12 < 0) {
-				emit_mov_i_no8m(r_scratch, k, ctx);
-				emit(ARM_CMP_R(r_A, r_scratch), ctx);
-			} else {
-				emit(ARM_CMP_I(r_A, imm12), ctx);
-			}
-cond_jump:
-			if (inst->jt)
-				_emit(condt, ARM_B(b_imm(i + inst->jt + 1,
-						   ctx)), ctx);
-			if (inst->jf)
-				_emit(condt ^ 1, ARM_B(b_imm(i + inst->jf + 1,
-							     ctx)), ctx);
-			break;
-		case BPF_JMP | BPF_JEQ | BPF_X:
-			/* pc += (A == X) ? pc->jt : pc->jf */
-			condt   = ARM_COND_EQ;
-			goto cmp_x;
-		case BPF_JMP | BPF_JGT | BPF_X:
-			/* pc += (A > X) ? pc->jt : pc->jf */
-			condt   = ARM_COND_HI;
-			goto cmp_x;
-		case BPF_JMP | BPF_JGE | BPF_X:
-			/* pc += (A >= X) ? pc->jt : pc->jf */
-			condt   = ARM_COND_CS;
-cmp_x:
-			update_on_xread(ctx);
-			emit(ARM_CMP_R(r_A, r_X), ctx);
-			goto cond_jump;
-		case BPF_JMP | BPF_JSET | BPF_K:
-			/* pc += (A & K) ? pc->jt : pc->jf */
-			condt  = ARM_COND_NE;
-			/* not set iff all zeroes iff Z==1 iff EQ */
-
-			imm12 = imm8m(k);
-			if (imm12 < 0) {
-				emit_mov_i_no8m(r_scratch, k, ctx);
-				emit(ARM_TST_R(r_A, r_scratch), ctx);
-			} else {
-				emit(ARM_TST_I(r_A, imm12), ctx);
-			}
-			goto cond_jump;
-		case BPF_JMP | BPF_JSET | BPF_X:
-			/* pc += (A & X) ? pc->jt : pc->jf */
-			update_on_xread(ctx);
-			condt  = ARM_COND_NE;
-			emit(ARM_TST_R(r_A, r_X), ctx);
-			goto cond_jump;
-		case BPF_RET | BPF_A:
-			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
-			goto b_epilogue;
-		case BPF_RET | BPF_K:
-			if ((k == 0) && (ctx->ret0_fp_idx < 0))
-				ctx->ret0_fp_idx = i;
-			emit_mov_i(ARM_R0, k, ctx);
-b_epilogue:
-			if (i != ctx->skf->len - 1)
-				emit(ARM_B(b_imm(prog->len, ctx)), ctx);
-			break;
-		case BPF_MISC | BPF_TAX:
-			/* X = A */
-			ctx->seen |= SEEN_X;
-			emit(ARM_MOV_R(r_X, r_A), ctx);
-			break;
-		case BPF_MISC | BPF_TXA:
-			/* A = X */
-			update_on_xread(ctx);
-			emit(ARM_MOV_R(r_A, r_X), ctx);
-			break;
-		case BPF_ANC | SKF_AD_PROTOCOL:
-			/* A = ntohs(skb->protocol) */
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
-						  protocol) != 2);
-			off = offsetof(struct sk_buff, protocol);
-			emit(ARM_LDRH_I(r_scratch, r_skb, off), ctx);
-			emit_swap16(r_A, r_scratch, ctx);
-			break;
-		case BPF_ANC | SKF_AD_CPU:
-			/* r_scratch = current_thread_info() */
-			OP_IMM3(ARM_BIC, r_scratch, ARM_SP, THREAD_SIZE - 1, ctx);
-			/* A = current_thread_info()->cpu */
-			BUILD_BUG_ON(FIELD_SIZEOF(struct thread_info, cpu) != 4);
-			off = offsetof(struct thread_info, cpu);
-			emit(ARM_LDR_I(r_A, r_scratch, off), ctx);
+	/* initialize tail_call_cnt */
+	emit(ARM_STR_I(ARM_IP, ARM_SP, stack_off(tcc[1])), ctx);
+
+	/* move BPF_CTX to BPF_R1, tail calls enter after this */
+	emit(ARM_MOV_R(r1[1], ARM_R0), ctx);
+	emit(ARM_MOV_R(r1[0], ARM_IP), ctx);
+}
+
+static void build_epilogue(struct jit_ctx *ctx)
+{
+	/* the return value is already in r0 */
+	emit(ARM_ADD_I(ARM_SP, ARM_SP, imm8m(STACK_SIZE)), ctx);
+
+#ifdef CONFIG_FRAME_POINTER
+	/* the first instruction of the prologue was: mov ip, sp */
+	emit(ARM_LDM(ARM_SP, CALLEE_POP_MASK | 1 << ARM_SP), ctx);
+#else
+	emit(ARM_POP(CALLEE_POP_MASK), ctx);
+#endif
+}
+
+/* JITs an eBPF instruction.
+ * Returns:
+ * 0  - successfully JITed an 8-byte eBPF instruction.
+ * >0 - successfully JITed a 16-byte eBPF instruction.
+ * <0 - failed to JIT.
+ */
+static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
+{
+	const u8 code = insn->code;
+	const s8 *dst = bpf2a32[insn->dst_reg];
+	const s8 *src = bpf2a32[insn->src_reg];
+	const s8 *tmp = bpf2a32[TMP_REG_1];
+	const s8 *tmp2 = bpf2a32[TMP_REG_2];
+	const s16 off = insn->off;
+	const s32 imm = insn->imm;
+	const int i = insn - ctx->prog->insnsi;
+	const bool is64 = BPF_CLASS(code) == BPF_ALU64;
+	const s8 *rd, *rs;
+
+	switch (code) {
+	/* dst = src */
+	case BPF_ALU | BPF_MOV | BPF_X:
+		arm_bpf_put_reg32(dst[1],
+				  arm_bpf_get_reg32(src[1], tmp[1], ctx), ctx);
+		emit_a32_mov_i(dst[0], 0, ctx);
+		break;
+	case BPF_ALU64 | BPF_MOV | BPF_X:
+		rs = arm_bpf_get_reg64(src, tmp, ctx);
+		arm_bpf_put_reg64(dst, rs, ctx);
+		break;
+	/* dst = imm */
+	case BPF_ALU | BPF_MOV | BPF_K:
+		emit_a32_mov_i64(dst, (u32)imm, ctx);
+		break;
+	case BPF_ALU64 | BPF_MOV | BPF_K:
+		emit_a32_mov_se_i64(dst, imm, ctx);
+		break;
+	/* dst = dst OP src */
+	case BPF_ALU | BPF_ADD | BPF_X:
+	case BPF_ALU64 | BPF_ADD | BPF_X:
+	case BPF_ALU | BPF_SUB | BPF_X:
+	case BPF_ALU64 | BPF_SUB | BPF_X:
+	case BPF_ALU | BPF_AND | BPF_X:
+	case BPF_ALU64 | BPF_AND | BPF_X:
+	case BPF_ALU | BPF_OR | BPF_X:
+	case BPF_ALU64 | BPF_OR | BPF_X:
+	case BPF_ALU | BPF_XOR | BPF_X:
+	case BPF_ALU64 | BPF_XOR | BPF_X:
+	case BPF_ALU | BPF_MUL | BPF_X:
+	case BPF_ALU | BPF_LSH | BPF_X:
+	case BPF_ALU | BPF_RSH | BPF_X:
+	case BPF_ALU | BPF_ARSH | BPF_X:
+		emit_a32_alu_r64(is64, dst, src, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU64 | BPF_MUL | BPF_X:
+		emit_a32_mul_r64(dst, src, ctx);
+		break;
+	case BPF_ALU64 | BPF_LSH | BPF_X:
+	case BPF_ALU64 | BPF_RSH | BPF_X:
+	case BPF_ALU64 | BPF_ARSH | BPF_X:
+		emit_a32_shift_r64(dst, src, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU | BPF_DIV | BPF_X:
+	case BPF_ALU64 | BPF_DIV | BPF_X:
+	case BPF_ALU | BPF_MOD | BPF_X:
+	case BPF_ALU64 | BPF_MOD | BPF_X:
+		emit_a32_udivmod(is64, dst, src, BPF_OP(code), ctx);
+		break;
+	/* dst = dst OP imm */
+	case BPF_ALU | BPF_ADD | BPF_K:
+	case BPF_ALU64 | BPF_ADD | BPF_K:
+	case BPF_ALU | BPF_SUB | BPF_K:
+	case BPF_ALU64 | BPF_SUB | BPF_K:
+	case BPF_ALU | BPF_AND | BPF_K:
+	case BPF_ALU64 | BPF_AND | BPF_K:
+	case BPF_ALU | BPF_OR | BPF_K:
+	case BPF_ALU64 | BPF_OR | BPF_K:
+	case BPF_ALU | BPF_XOR | BPF_K:
+	case BPF_ALU64 | BPF_XOR | BPF_K:
+		if (emit_a32_alu_i64(is64, dst, imm, BPF_OP(code), ctx))
 			break;
-		case BPF_ANC | SKF_AD_IFINDEX:
-		case BPF_ANC | SKF_AD_HATYPE:
-			/* A = skb->dev->ifindex */
-			/* A = skb->dev->type */
-			ctx->seen |= SEEN_SKB;
-			off = offsetof(struct sk_buff, dev);
-			emit(ARM_LDR_I(r_scratch, r_skb, off), ctx);
-
-			emit(ARM_CMP_I(r_scratch, 0), ctx);
-			emit_err_ret(ARM_COND_EQ, ctx);
-
-			BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
-						  ifindex) != 4);
-			BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
-						  type) != 2);
-
-			if (code == (BPF_ANC | SKF_AD_IFINDEX)) {
-				off = offsetof(struct net_device, ifindex);
-				emit(ARM_LDR_I(r_A, r_scratch, off), ctx);
-			} else {
-				/*
-				 * offset of field "type" in "struct
-				 * net_device" is above what can be
-				 * used in the ldrh rd, [rn, #imm]
-				 * instruction, so load the offset in
-				 * a register and use ldrh rd, [rn, rm]
-				 */
-				off = offsetof(struct net_device, type);
-				emit_mov_i(ARM_R3, off, ctx);
-				emit(ARM_LDRH_R(r_A, r_scratch, ARM_R3), ctx);
-			}
+		/* fall through */
+	case BPF_ALU | BPF_MUL | BPF_K:
+		emit_a32_mov_se_i64(tmp2, imm, ctx);
+		emit_a32_alu_r64(is64, dst, tmp2, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU64 | BPF_MUL | BPF_K:
+		emit_a32_mov_se_i64(tmp2, imm, ctx);
+		emit_a32_mul_r64(dst, tmp2, ctx);
+		break;
+	case BPF_ALU | BPF_DIV | BPF_K:
+	case BPF_ALU | BPF_MOD | BPF_K:
+		emit_a32_mov_i64(tmp2, (u32)imm, ctx);
+		emit_a32_udivmod(false, dst, tmp2, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU64 | BPF_DIV | BPF_K:
+	case BPF_ALU64 | BPF_MOD | BPF_K:
+		emit_a32_mov_se_i64(tmp2, imm, ctx);
+		emit_a32_udivmod(true, dst, tmp2, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU | BPF_LSH | BPF_K:
+	case BPF_ALU | BPF_RSH | BPF_K:
+	case BPF_ALU | BPF_ARSH | BPF_K:
+		if (unlikely(imm > 31))
+			return -EINVAL;
+		emit_a32_shift_i32(dst, imm, BPF_OP(code), ctx);
+		break;
+	case BPF_ALU64 | BPF_LSH | BPF_K:
+	case BPF_ALU64 | BPF_RSH | BPF_K:
+	case BPF_ALU64 | BPF_ARSH | BPF_K:
+		if (unlikely(imm > 63))
+			return -EINVAL;
+		emit_a32_shift_i64(dst, imm, BPF_OP(code), ctx);
+		break;
+	/* dst = -dst */
+	case BPF_ALU | BPF_NEG:
+		rd = arm_bpf_get_reg64(dst, tmp, ctx);
+		emit(ARM_RSB_I(rd[1], rd[1], 0), ctx);
+		emit(ARM_MOV_I(rd[0], 0), ctx);
+		arm_bpf_put_reg64(dst, rd, ctx);
+		break;
+	case BPF_ALU64 | BPF_NEG:
+		emit_a32_neg64(dst, ctx);
+		break;
+	/* dst = BSWAP##imm(dst) */
+	case BPF_ALU | BPF_END | BPF_FROM_LE:
+	case BPF_ALU | BPF_END | BPF_FROM_BE:
+		emit_a32_endian(dst, BPF_SRC(code), imm, ctx);
+		break;
+	/* dst = imm64 */
+	case BPF_LD | BPF_IMM | BPF_DW:
+	{
+		const struct bpf_insn insn1 = insn[1];
+		u64 imm64;
+
+		imm64 = (u64)insn1.imm << 32 | (u32)imm;
+		emit_a32_mov_i64(dst, imm64, ctx);
+
+		return 1;
+	}
+	/* LDX: dst = *(size *)(src + off) */
+	case BPF_LDX | BPF_MEM | BPF_W:
+	case BPF_LDX | BPF_MEM | BPF_H:
+	case BPF_LDX | BPF_MEM | BPF_B:
+	case BPF_LDX | BPF_MEM | BPF_DW:
+		emit_ldx_r(dst, src, off, BPF_SIZE(code), ctx);
+		break;
+	/* ST: *(size *)(dst + off) = imm */
+	case BPF_ST | BPF_MEM | BPF_W:
+	case BPF_ST | BPF_MEM | BPF_H:
+	case BPF_ST | BPF_MEM | BPF_B:
+	case BPF_ST | BPF_MEM | BPF_DW:
+		emit_a32_mov_se_i64(tmp2, imm, ctx);
+		emit_str_r(dst, tmp2, off, BPF_SIZE(code), ctx);
+		break;
+	/* STX: *(size *)(dst + off) = src */
+	case BPF_STX | BPF_MEM | BPF_W:
+	case BPF_STX | BPF_MEM | BPF_H:
+	case BPF_STX | BPF_MEM | BPF_B:
+	case BPF_STX | BPF_MEM | BPF_DW:
+		rs = arm_bpf_get_reg64(src, tmp2, ctx);
+		emit_str_r(dst, rs, off, BPF_SIZE(code), ctx);
+		break;
+	/* STX XADD: lock *(u32 *)(dst + off) += src */
+	case BPF_STX | BPF_XADD | BPF_W:
+	/* STX XADD: lock *(u64 *)(dst + off) += src */
+	case BPF_STX | BPF_XADD | BPF_DW:
+		if (emit_a32_xadd(dst, src, off, BPF_SIZE(code), ctx))
+			goto notyet;
+		break;
+	/* R0 = ntohx(*(size *)(((struct sk_buff *)R6)->data + imm)) */
+	case BPF_LD | BPF_ABS | BPF_W:
+	case BPF_LD | BPF_ABS | BPF_H:
+	case BPF_LD | BPF_ABS | BPF_B:
+	/* R0 = ntohx(*(size *)(((struct sk_buff *)R6)->data + src + imm)) */
+	case BPF_LD | BPF_IND | BPF_W:
+	case BPF_LD | BPF_IND | BPF_H:
+	case BPF_LD | BPF_IND | BPF_B:
+	{
+		const s8 *r6 = bpf2a32[BPF_REG_6];	/* struct sk_buff * */
+		const s8 *buf = bpf2a32[SKB_BUF];
+		unsigned int size;
+
+		switch (BPF_SIZE(code)) {
+		case BPF_W:
+			size = 4;
 			break;
-		case BPF_ANC | SKF_AD_MARK:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
-			off = offsetof(struct sk_buff, mark);
-			emit(ARM_LDR_I(r_A, r_skb, off), ctx);
+		case BPF_H:
+			size = 2;
 			break;
-		case BPF_ANC | SKF_AD_RXHASH:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, hash) != 4);
-			off = offsetof(struct sk_buff, hash);
-			emit(ARM_LDR_I(r_A, r_skb, off), ctx);
+		case BPF_B:
+			size = 1;
 			break;
-		case BPF_ANC | SKF_AD_VLAN_TAG:
-		case BPF_ANC | SKF_AD_VLAN_TAG_PRESENT:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, vlan_tci) != 2);
-			off = offsetof(struct sk_buff, vlan_tci);
-			emit(ARM_LDRH_I(r_A, r_skb, off), ctx);
-			if (code == (BPF_ANC | SKF_AD_VLAN_TAG))
-				OP_IMM3(ARM_AND, r_A, r_A, ~VLAN_TAG_PRESENT, ctx);
-			else {
-				OP_IMM3(ARM_LSR, r_A, r_A, 12, ctx);
-				OP_IMM3(ARM_AND, r_A, r_A, 0x1, ctx);
-			}
+		default:
+			return -EINVAL;
+		}
+
+		/* the offset first, src may live in r0-r3 */
+		emit_mov_i(ARM_IP, imm, ctx);
+		if (BPF_MODE(code) == BPF_IND) {
+			s8 rt = arm_bpf_get_reg32(src[1], tmp[1], ctx);
+
+			emit(ARM_ADD_R(ARM_IP, ARM_IP, rt), ctx);
+		}
+		/* bpf_load_pointer(skb, k, size, buffer), clobbers R1-R5 */
+		emit(ARM_MOV_R(ARM_R0, r6[1]), ctx);
+		emit(ARM_MOV_R(ARM_R1, ARM_IP), ctx);
+		emit(ARM_MOV_I(ARM_R2, size), ctx);
+		emit(ARM_ADD_I(ARM_R3, ARM_SP, stack_off(buf[1])), ctx);
+		emit_call((u32)bpf_load_pointer, ctx);
+
+		/* a NULL pointer means the load failed: return 0 */
+		emit(ARM_CMP_I(ARM_R0, 0), ctx);
+		_emit(ARM_COND_EQ, ARM_B(epilogue_offset(ctx)), ctx);
+
+		switch (size) {
+		case 4:
+			emit(ARM_LDR_I(ARM_R0, ARM_R0, 0), ctx);
+			emit_rev32(ARM_R0, ARM_R0, ctx);
 			break;
-		case BPF_ANC | SKF_AD_PKTTYPE:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
-						  __pkt_type_offset[0]) != 1);
-			off = PKT_TYPE_OFFSET();
-			emit(ARM_LDRB_I(r_A, r_skb, off), ctx);
-			emit(ARM_AND_I(r_A, r_A, PKT_TYPE_MAX), ctx);
-#ifdef __BIG_ENDIAN_BITFIELD
-			emit(ARM_LSR_I(r_A, r_A, 5), ctx);
-#endif
+		case 2:
+			emit(ARM_LDRH_I(ARM_R0, ARM_R0, 0), ctx);
+			emit_rev16(ARM_R0, ARM_R0, ctx);
 			break;
-		case BPF_ANC | SKF_AD_QUEUE:
-			ctx->seen |= SEEN_SKB;
-			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
-						  queue_mapping) != 2);
-			BUILD_BUG_ON(offsetof(struct sk_buff,
-					      queue_mapping) > 0xff);
-			off = offsetof(struct sk_buff, queue_mapping);
-			emit(ARM_LDRH_I(r_A, r_skb, off), ctx);
+		case 1:
+			emit(ARM_LDRB_I(ARM_R0, ARM_R0, 0), ctx);
 			break;
-		case BPF_ANC | SKF_AD_PAY_OFFSET:
-			ctx->seen |= SEEN_SKB | SEEN_CALL;
+		}
+		emit(ARM_MOV_I(ARM_R1, 0), ctx);
+		break;
+	}
+	/* JUMP off */
+	case BPF_JMP | BPF_JA:
+		emit(ARM_B(b_imm(i + off + 1, ctx)), ctx);
+		break;
+	/* IF (dst COND src) JUMP off */
+	case BPF_JMP | BPF_JEQ | BPF_X:
+	case BPF_JMP | BPF_JGT | BPF_X:
+	case BPF_JMP | BPF_JGE | BPF_X:
+	case BPF_JMP | BPF_JNE | BPF_X:
+	case BPF_JMP | BPF_JSGT | BPF_X:
+	case BPF_JMP | BPF_JSGE | BPF_X:
+	case BPF_JMP | BPF_JSET | BPF_X:
+		rd = arm_bpf_get_reg64(dst, tmp, ctx);
+		rs = arm_bpf_get_reg64(src, tmp2, ctx);
+		goto emit_cond_jmp;
+	/* IF (dst COND imm) JUMP off */
+	case BPF_JMP | BPF_JEQ | BPF_K:
+	case BPF_JMP | BPF_JGT | BPF_K:
+	case BPF_JMP | BPF_JGE | BPF_K:
+	case BPF_JMP | BPF_JNE | BPF_K:
+	case BPF_JMP | BPF_JSGT | BPF_K:
+	case BPF_JMP | BPF_JSGE | BPF_K:
+	case BPF_JMP | BPF_JSET | BPF_K:
+		rd = arm_bpf_get_reg64(dst, tmp, ctx);
+		emit_a32_mov_se_i64(tmp2, imm, ctx);
+		rs = tmp2;
+emit_cond_jmp:
+		emit_a32_cmp_r64(rd, rs, BPF_OP(code), ctx);
+		_emit(bpf_cond_to_arm(BPF_OP(code)),
+		      ARM_B(b_imm(i + off + 1, ctx)), ctx);
+		break;
+	/* function call */
+	case BPF_JMP | BPF_CALL:
+	{
+		const s8 *r1 = bpf2a32[BPF_REG_1];
+		const s8 *r2 = bpf2a32[BPF_REG_2];
+		const u32 func = (u32)__bpf_call_base + (u32)imm;
 
-			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
-			emit_mov_i(ARM_R3, (unsigned int)skb_get_poff, ctx);
-			emit_blx_r(ARM_R3, ctx);
-			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
-			break;
-		case BPF_LDX | BPF_W | BPF_ABS:
-			/*
-			 * load a 32bit word from struct seccomp_data.
-			 * seccomp_check_filter() will already have checked
-			 * that k is 32bit aligned and lies within the
-			 * struct seccomp_data.
-			 */
-			ctx->seen |= SEEN_SKB;
-			emit(ARM_LDR_I(r_A, r_skb, k), ctx);
+		/*
+		 * The first two 64-bit arguments go in r0-r3, R3-R5 are
+		 * already in place at the bottom of the stack. The result
+		 * comes back in r0/r1, which is where BPF R0 lives.
+		 */
+		emit(ARM_MOV_R(ARM_R0, r1[1]), ctx);
+		emit(ARM_MOV_R(ARM_R1, r1[0]), ctx);
+		emit(ARM_LDR_I(ARM_R2, ARM_SP, stack_off(r2[1])), ctx);
+		emit(ARM_LDR_I(ARM_R3, ARM_SP, stack_off(r2[0])), ctx);
+		emit_call(func, ctx);
+		break;
+	}
+	/* tail call */
+	case BPF_JMP | BPF_CALL | BPF_X:
+		if (emit_bpf_tail_call(ctx))
+			return -EFAULT;
+		break;
+	/* function return */
+	case BPF_JMP | BPF_EXIT:
+		/* Optimization: when last instruction is EXIT,
+		 * simply fallthrough to epilogue.
+		 */
+		if (i == ctx->prog->len - 1)
 			break;
-		default:
-			return -1;
-		}
+		emit(ARM_B(epilogue_offset(ctx)), ctx);
+		break;
+notyet:
+		pr_info_once("*** NOT YET: opcode %02x ***\n", code);
+		return -EFAULT;
+	default:
+		pr_err_once("unknown opcode %02x\n", code);
+		return -EINVAL;
+	}
 
-		if (ctx->flags & FLAG_IMM_OVERFLOW)
-			/*
-			 * this instruction generated an overflow when
-			 * trying to access the literal pool, so
-			 * delegate this filter to the kernel interpreter.
-			 */
-			return -1;
+	return 0;
+}
+
+static int build_body(struct jit_ctx *ctx)
+{
+	const struct bpf_prog *prog = ctx->prog;
+	unsigned int i;
+
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &(prog->insnsi[i]);
+		int ret;
+
+		/* compute offsets only in the fake pass */
+		if (ctx->target == NULL)
+			ctx->offsets[i] = ctx->idx;
+
+		ret = build_insn(insn, ctx);
+		if (ret < 0)
+			return ret;
+		if (ret > 0) {
+			/* the second half of a 16-byte insn */
+			i++;
+			if (ctx->target == NULL)
+				ctx->offsets[i] = ctx->idx;
+		}
 	}
 
-	/* compute offsets only during the first pass */
 	if (ctx->target == NULL)
-		ctx->offsets[i] = ctx->idx * 4;
+		ctx->offsets[i] = ctx->idx;
 
 	return 0;
 }
 
+void bpf_jit_compile(struct bpf_prog *prog)
+{
+	/* Nothing to do here. We support Internal BPF. */
+}
 
-void bpf_jit_compile(struct bpf_prog *fp)
+struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 {
+	struct bpf_prog *tmp, *orig_prog = prog;
 	struct bpf_binary_header *header;
+	bool tmp_blinded = false;
 	struct jit_ctx ctx;
-	unsigned tmp_idx;
-	unsigned alloc_size;
-	u8 *target_ptr;
+	unsigned int image_size;
+	u8 *image_ptr;
 
-	if (!bpf_jit_enable)
-		return;
+	/* 64-bit values are handled as little endian register pairs */
+	if (!bpf_jit_enable || IS_ENABLED(CONFIG_CPU_BIG_ENDIAN))
+		return orig_prog;
 
-	memset(&ctx, 0, sizeof(ctx));
-	ctx.skf		= fp;
-	ctx.ret0_fp_idx = -1;
+	tmp = bpf_jit_blind_constants(prog);
+	/* If blinding was requested and we failed during blinding,
+	 * we must fall back to the interpreter.
+	 */
+	if (IS_ERR(tmp))
+		return orig_prog;
+	if (tmp != prog) {
+		tmp_blinded = true;
+		prog = tmp;
+	}
 
-	ctx.offsets = kzalloc(4 * (ctx.skf->len + 1), GFP_KERNEL);
-	if (ctx.offsets == NULL)
-		return;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.prog = prog;
 
-	/* fake pass to fill in the ctx->seen */
-	if (unlikely(build_body(&ctx)))
+	ctx.offsets = kcalloc(prog->len + 1, sizeof(u32), GFP_KERNEL);
+	if (ctx.offsets == NULL) {
+		prog = orig_prog;
 		goto out;
+	}
 
-	tmp_idx = ctx.idx;
+	/* 1. Initial fake pass to compute ctx->idx and the offsets. */
 	build_prologue(&ctx);
-	ctx.prologue_bytes = (ctx.idx - tmp_idx) * 4;
+	ctx.prologue_bytes = ctx.idx * 4;
 
-#if __LINUX_ARM_ARCH__ < 7
-	tmp_idx = ctx.idx;
+	if (build_body(&ctx)) {
+		prog = orig_prog;
+		goto out_off;
+	}
+
+	ctx.epilogue_offset = ctx.idx;
 	build_epilogue(&ctx);
-	ctx.epilogue_bytes = (ctx.idx - tmp_idx) * 4;
 
-	ctx.idx += ctx.imm_count;
-	if (ctx.imm_count) {
-		ctx.imms = kzalloc(4 * ctx.imm_count, GFP_KERNEL);
-		if (ctx.imms == NULL)
-			goto out;
+	/* Now we know the actual image size. */
+	image_size = sizeof(u32) * ctx.idx;
+	header = bpf_jit_binary_alloc(image_size, &image_ptr,
+				      sizeof(u32), jit_fill_hole);
+	if (header == NULL) {
+		prog = orig_prog;
+		goto out_off;
 	}
-#else
-	/* there's nothing after the epilogue on ARMv7 */
-	build_epilogue(&ctx);
-#endif
-	alloc_size = 4 * ctx.idx;
-	header = bpf_jit_binary_alloc(alloc_size, &target_ptr,
-				      4, jit_fill_hole);
-	if (header == NULL)
-		goto out;
 
-	ctx.target = (u32 *) target_ptr;
+	/* 2. Now, the actual pass. */
+	ctx.target = (u32 *)image_ptr;
 	ctx.idx = 0;
 
 	build_prologue(&ctx);
-	if (build_body(&ctx) < 0) {
-#if __LINUX_ARM_ARCH__ < 7
-		if (ctx.imm_count)
-			kfree(ctx.imms);
-#endif
+	if (build_body(&ctx)) {
 		bpf_jit_binary_free(header);
-		goto out;
+		prog = orig_prog;
+		goto out_off;
 	}
 	build_epilogue(&ctx);
 
 	flush_icache_range((u32)header, (u32)(ctx.target + ctx.idx));
 
-#if __LINUX_ARM_ARCH__ < 7
-	if (ctx.imm_count)
-		kfree(ctx.imms);
-#endif
-
 	if (bpf_jit_enable > 1)
 		/* there are 2 passes here */
-		bpf_jit_dump(fp->len, alloc_size, 2, ctx.target);
+		bpf_jit_dump(prog->len, image_size, 2, ctx.target);
 
 	set_memory_ro((unsigned long)header, header->pages);
-	fp->bpf_func = (void *)ctx.target;
-	fp->jited = 1;
-out:
+	prog->bpf_func = (void *)ctx.target;
+	prog->jited = 1;
+
+out_off:
 	kfree(ctx.offsets);
-	return;
+out:
+	if (tmp_blinded)
+		bpf_jit_prog_release_other(prog, prog == orig_prog ?
+					   tmp : orig_prog);
+	return prog;
 }
 
 void bpf_jit_free(struct bpf_prog *fp)
@@ -79,6 +79,26 @@ int crypto_aead_setauthsize(struct crypto_aead *tfm, unsigned int authsize)
 }
 EXPORT_SYMBOL_GPL(crypto_aead_setauthsize);
 
+void crypto_aead_encrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr)
+{
+	struct aead_alg *alg;
+	unsigned int i;
+
+	if (!nr)
+		return;
+
+	alg = crypto_aead_alg(crypto_aead_reqtfm(reqs[0]));
+	if (alg->encrypt_batch) {
+		alg->encrypt_batch(reqs, errs, nr);
+		return;
+	}
+
+	for (i = 0; i < nr; i++)
+		errs[i] = alg->encrypt(reqs[i]);
+}
+EXPORT_SYMBOL_GPL(crypto_aead_encrypt_batch);
+
 static void crypto_aead_exit_tfm(struct crypto_tfm *tfm)
 {
 	struct crypto_aead *aead = __crypto_aead_cast(tfm);
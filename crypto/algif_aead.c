@@ -34,14 +34,28 @@ struct aead_async_rsgl {
 	struct list_head list;
 };
 
+/*
+ * A complete cipher operation, queued by sendmsg/sendpage until recvmsg
+ * processes it. This allows user space to submit a batch of operations,
+ * e.g. with sendmmsg or splice, and to collect the results with recvmmsg
+ * or with one AIO read per operation.
+ */
+struct aead_op {
+	struct list_head list;
+	unsigned long used;
+	size_t assoclen;
+	unsigned int tsgls;
+	bool enc;
+	u8 *iv;
+	struct scatterlist tsgl[];
+};
+
 struct aead_async_req {
-	struct scatterlist *tsgl;
+	struct aead_op *op;
 	struct aead_async_rsgl first_rsgl;
 	struct list_head list;
 	struct kiocb *iocb;
 	struct sock *sk;
-	unsigned int tsgls;
-	char iv[];
 };
 
 struct aead_ctx {
@@ -49,6 +63,10 @@ struct aead_ctx {
 	struct aead_async_rsgl first_rsgl;
 	struct list_head list;
 
+	/* operations ready for recvmsg */
+	struct list_head ops;
+	unsigned long queued;
+
 	void *iv;
 
 	struct af_alg_completion completion;
@@ -59,6 +77,7 @@ struct aead_ctx {
 	bool more;
 	bool merge;
 	bool enc;
+	bool started;	/* sendmsg/sendpage began an operation */
 
 	size_t aead_assoclen;
 	struct aead_request aead_req;
@@ -70,7 +89,7 @@ static inline int aead_sndbuf(struct sock *sk)
 	struct aead_ctx *ctx = ask->private;
 
 	return max_t(int, max_t(int, sk->sk_sndbuf & PAGE_MASK, PAGE_SIZE) -
-			  ctx->used, 0);
+			  (ctx->used + ctx->queued), 0);
 }
 
 static inline bool aead_writable(struct sock *sk)
@@ -78,7 +97,9 @@ static inline bool aead_writable(struct sock *sk)
 	return PAGE_SIZE <= aead_sndbuf(sk);
 }
 
-static inline bool aead_sufficient_data(struct aead_ctx *ctx)
+static inline bool aead_sufficient_data(struct aead_ctx *ctx,
+					unsigned long used, size_t assoclen,
+					bool enc)
 {
 	unsigned as = crypto_aead_authsize(crypto_aead_reqtfm(&ctx->aead_req));
 
@@ -86,7 +107,7 @@ static inline bool aead_sufficient_data(struct aead_ctx *ctx)
 	 * The minimum amount of memory needed for an AEAD cipher is
 	 * the AAD and in case of decryption the tag.
 	 */
-	return ctx->used >= ctx->aead_assoclen + (ctx->enc ? 0 : as);
+	return used >= assoclen + (enc ? 0 : as);
 }
 
 static void aead_reset_ctx(struct aead_ctx *ctx)
@@ -98,6 +119,7 @@ static void aead_reset_ctx(struct aead_ctx *ctx)
 	ctx->used = 0;
 	ctx->more = 0;
 	ctx->merge = 0;
+	ctx->started = 0;
 }
 
 static void aead_put_sgl(struct sock *sk)
@@ -118,6 +140,76 @@ static void aead_put_sgl(struct sock *sk)
 	aead_reset_ctx(ctx);
 }
 
+/*
+ * Number of scatterlist entries allocated for an operation. An operation
+ * without data still gets one empty entry for its source.
+ */
+static inline unsigned int aead_op_nents(unsigned int tsgls)
+{
+	return max_t(unsigned int, tsgls, 1);
+}
+
+/*
+ * Move the operation collected by sendmsg/sendpage, including its page
+ * references, to the queue of operations ready for recvmsg.
+ */
+static int aead_queue_op(struct sock *sk)
+{
+	struct alg_sock *ask = alg_sk(sk);
+	struct aead_ctx *ctx = ask->private;
+	unsigned ivsize =
+		crypto_aead_ivsize(crypto_aead_reqtfm(&ctx->aead_req));
+	struct aead_sg_list *sgl = &ctx->tsgl;
+	struct aead_op *op;
+	unsigned int i;
+
+	op = sock_kmalloc(sk, sizeof(*op) + sizeof(op->tsgl[0]) *
+			      aead_op_nents(sgl->cur) + ivsize, GFP_KERNEL);
+	if (!op)
+		return -ENOMEM;
+
+	sg_init_table(op->tsgl, aead_op_nents(sgl->cur));
+	for (i = 0; i < sgl->cur; i++)
+		sg_set_page(&op->tsgl[i], sg_page(&sgl->sg[i]),
+			    sgl->sg[i].length, sgl->sg[i].offset);
+
+	op->tsgls = sgl->cur;
+	op->used = ctx->used;
+	op->assoclen = ctx->aead_assoclen;
+	op->enc = ctx->enc;
+	op->iv = (u8 *)&op->tsgl[aead_op_nents(op->tsgls)];
+	memcpy(op->iv, ctx->iv, ivsize);
+
+	list_add_tail(&op->list, &ctx->ops);
+	ctx->queued += op->used;
+	aead_reset_ctx(ctx);
+
+	return 0;
+}
+
+/* Release an operation that has been removed from the queue. */
+static void aead_free_op(struct sock *sk, struct aead_op *op)
+{
+	struct alg_sock *ask = alg_sk(sk);
+	struct aead_ctx *ctx = ask->private;
+	unsigned ivsize =
+		crypto_aead_ivsize(crypto_aead_reqtfm(&ctx->aead_req));
+	unsigned int i;
+
+	for (i = 0; i < op->tsgls; i++)
+		put_page(sg_page(&op->tsgl[i]));
+
+	memzero_explicit(op->iv, ivsize);
+	sock_kfree_s(sk, op, sizeof(*op) + sizeof(op->tsgl[0]) *
+			     aead_op_nents(op->tsgls) + ivsize);
+}
+
+static void aead_dequeue_op(struct aead_ctx *ctx, struct aead_op *op)
+{
+	list_del(&op->list);
+	ctx->queued -= op->used;
+}
+
 static void aead_wmem_wakeup(struct sock *sk)
 {
 	struct socket_wq *wq;
@@ -153,7 +245,7 @@ static int aead_wait_for_data(struct sock *sk, unsigned flags)
 			break;
 		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
 		timeout = MAX_SCHEDULE_TIMEOUT;
-		if (sk_wait_event(sk, &timeout, !ctx->more)) {
+		if (sk_wait_event(sk, &timeout, !list_empty(&ctx->ops))) {
 			err = 0;
 			break;
 		}
@@ -171,9 +263,7 @@ static void aead_data_wakeup(struct sock *sk)
 	struct aead_ctx *ctx = ask->private;
 	struct socket_wq *wq;
 
-	if (ctx->more)
-		return;
-	if (!ctx->used)
+	if (list_empty(&ctx->ops))
 		return;
 
 	rcu_read_lock();
@@ -186,6 +276,32 @@ static void aead_data_wakeup(struct sock *sk)
 	rcu_read_unlock();
 }
 
+/*
+ * Called when the last data of an operation has been sent. An operation
+ * without any data, e.g. encrypting empty AAD and plaintext into just
+ * the tag, is queued as well.
+ */
+static int aead_end_op(struct sock *sk)
+{
+	struct alg_sock *ask = alg_sk(sk);
+	struct aead_ctx *ctx = ask->private;
+	int err;
+
+	if (!ctx->started)
+		return 0;
+
+	if (!aead_sufficient_data(ctx, ctx->used, ctx->aead_assoclen,
+				  ctx->enc)) {
+		aead_put_sgl(sk);
+		return -EMSGSIZE;
+	}
+
+	err = aead_queue_op(sk);
+	if (err)
+		aead_put_sgl(sk);
+	return err;
+}
+
 static int aead_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 {
 	struct sock *sk = sock->sk;
@@ -222,9 +338,7 @@ static int aead_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 	}
 
 	lock_sock(sk);
-	if (!ctx->more && ctx->used)
-		goto unlock;
-
+	ctx->started = 1;
 	if (init) {
 		ctx->enc = enc;
 		if (con.iv)
@@ -306,10 +420,8 @@ static int aead_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 	err = 0;
 
 	ctx->more = msg->msg_flags & MSG_MORE;
-	if (!ctx->more && !aead_sufficient_data(ctx)) {
-		aead_put_sgl(sk);
-		err = -EMSGSIZE;
-	}
+	if (!ctx->more)
+		err = aead_end_op(sk);
 
 unlock:
 	aead_data_wakeup(sk);
@@ -334,9 +446,7 @@ static ssize_t aead_sendpage(struct socket *sock, struct page *page,
 		return -E2BIG;
 
 	lock_sock(sk);
-	if (!ctx->more && ctx->used)
-		goto unlock;
-
+	ctx->started = 1;
 	if (!size)
 		goto done;
 
@@ -358,10 +468,8 @@ static ssize_t aead_sendpage(struct socket *sock, struct page *page,
 
 done:
 	ctx->more = flags & MSG_MORE;
-	if (!ctx->more && !aead_sufficient_data(ctx)) {
-		aead_put_sgl(sk);
-		err = -EMSGSIZE;
-	}
+	if (!ctx->more)
+		err = aead_end_op(sk);
 
 unlock:
 	aead_data_wakeup(sk);
@@ -375,8 +483,7 @@ static ssize_t aead_sendpage(struct socket *sock, struct page *page,
 		 crypto_aead_reqsize(tfm))
 
  #define GET_REQ_SIZE(tfm) sizeof(struct aead_async_req) + \
-	crypto_aead_reqsize(tfm) + crypto_aead_ivsize(tfm) + \
-	sizeof(struct aead_request)
+	crypto_aead_reqsize(tfm) + sizeof(struct aead_request)
 
 static void aead_async_cb(struct crypto_async_request *_req, int err)
 {
@@ -384,10 +491,13 @@ static void aead_async_cb(struct crypto_async_request *_req, int err)
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
 	struct aead_async_req *areq = GET_ASYM_REQ(req, tfm);
 	struct sock *sk = areq->sk;
-	struct scatterlist *sg = areq->tsgl;
 	struct aead_async_rsgl *rsgl;
 	struct kiocb *iocb = areq->iocb;
-	unsigned int i, reqlen = GET_REQ_SIZE(tfm);
+	unsigned int reqlen = GET_REQ_SIZE(tfm);
+
+	/* a backlogged request has been started, wait for its completion */
+	if (err == -EINPROGRESS)
+		return;
 
 	list_for_each_entry(rsgl, &areq->list, list) {
 		af_alg_free_sg(&rsgl->sgl);
@@ -395,10 +505,8 @@ static void aead_async_cb(struct crypto_async_request *_req, int err)
 			sock_kfree_s(sk, rsgl, sizeof(*rsgl));
 	}
 
-	for (i = 0; i < areq->tsgls; i++)
-		put_page(sg_page(sg + i));
+	aead_free_op(sk, areq->op);
 
-	sock_kfree_s(sk, areq->tsgl, sizeof(*areq->tsgl) * areq->tsgls);
 	sock_kfree_s(sk, req, reqlen);
 	__sock_put(sk);
 	iocb->ki_complete(iocb, err, err);
@@ -413,27 +521,30 @@ static int aead_recvmsg_async(struct socket *sock, struct msghdr *msg,
 	struct crypto_aead *tfm = crypto_aead_reqtfm(&ctx->aead_req);
 	struct aead_async_req *areq;
 	struct aead_request *req = NULL;
-	struct aead_sg_list *sgl = &ctx->tsgl;
+	struct aead_op *op;
 	struct aead_async_rsgl *last_rsgl = NULL, *rsgl;
 	unsigned int as = crypto_aead_authsize(tfm);
-	unsigned int i, reqlen = GET_REQ_SIZE(tfm);
+	unsigned int reqlen = GET_REQ_SIZE(tfm);
 	int err = -ENOMEM;
 	unsigned long used;
 	size_t outlen = 0;
 	size_t usedpages = 0;
 
 	lock_sock(sk);
-	if (ctx->more) {
+	if (list_empty(&ctx->ops)) {
 		err = aead_wait_for_data(sk, flags);
 		if (err)
 			goto unlock;
 	}
 
-	if (!aead_sufficient_data(ctx))
+	op = list_first_entry(&ctx->ops, struct aead_op, list);
+	if (!aead_sufficient_data(ctx, op->used, op->assoclen, op->enc)) {
+		err = -EINVAL;
 		goto unlock;
+	}
 
-	used = ctx->used;
-	if (ctx->enc)
+	used = op->used;
+	if (op->enc)
 		outlen = used + as;
 	else
 		outlen = used - as;
@@ -447,25 +558,12 @@ static int aead_recvmsg_async(struct socket *sock, struct msghdr *msg,
 	INIT_LIST_HEAD(&areq->list);
 	areq->iocb = msg->msg_iocb;
 	areq->sk = sk;
-	memcpy(areq->iv, ctx->iv, crypto_aead_ivsize(tfm));
+	areq->op = op;
 	aead_request_set_tfm(req, tfm);
-	aead_request_set_ad(req, ctx->aead_assoclen);
+	aead_request_set_ad(req, op->assoclen);
 	aead_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
 				  aead_async_cb, req);
-	used -= ctx->aead_assoclen;
-
-	/* take over all tx sgls from ctx */
-	areq->tsgl = sock_kmalloc(sk, sizeof(*areq->tsgl) * sgl->cur,
-				  GFP_KERNEL);
-	if (unlikely(!areq->tsgl))
-		goto free;
-
-	sg_init_table(areq->tsgl, sgl->cur);
-	for (i = 0; i < sgl->cur; i++)
-		sg_set_page(&areq->tsgl[i], sg_page(&sgl->sg[i]),
-			    sgl->sg[i].length, sgl->sg[i].offset);
-
-	areq->tsgls = sgl->cur;
+	used -= op->assoclen;
 
 	/* create rx sgls */
 	while (outlen > usedpages && iov_iter_count(&msg->msg_iter)) {
@@ -504,24 +602,27 @@ static int aead_recvmsg_async(struct socket *sock, struct msghdr *msg,
 	/* ensure output buffer is sufficiently large */
 	if (usedpages < outlen) {
 		err = -EINVAL;
-		goto unlock;
+		goto free;
 	}
 
-	aead_request_set_crypt(req, areq->tsgl, areq->first_rsgl.sgl.sg, used,
-			       areq->iv);
-	err = ctx->enc ? crypto_aead_encrypt(req) : crypto_aead_decrypt(req);
+	aead_request_set_crypt(req, op->tsgl, areq->first_rsgl.sgl.sg, used,
+			       op->iv);
+	err = op->enc ? crypto_aead_encrypt(req) : crypto_aead_decrypt(req);
 	if (err) {
-		if (err == -EINPROGRESS) {
+		if (err == -EINPROGRESS || err == -EBUSY) {
+			/* the operation now belongs to the request */
 			sock_hold(sk);
 			err = -EIOCBQUEUED;
-			aead_reset_ctx(ctx);
+			aead_dequeue_op(ctx, op);
 			goto unlock;
 		} else if (err == -EBADMSG) {
-			aead_put_sgl(sk);
+			aead_dequeue_op(ctx, op);
+			aead_free_op(sk, op);
 		}
 		goto free;
 	}
-	aead_put_sgl(sk);
+	aead_dequeue_op(ctx, op);
+	aead_free_op(sk, op);
 
 free:
 	list_for_each_entry(rsgl, &areq->list, list) {
@@ -529,10 +630,7 @@ static int aead_recvmsg_async(struct socket *sock, struct msghdr *msg,
 		if (rsgl != &areq->first_rsgl)
 			sock_kfree_s(sk, rsgl, sizeof(*rsgl));
 	}
-	if (areq->tsgl)
-		sock_kfree_s(sk, areq->tsgl, sizeof(*areq->tsgl) * areq->tsgls);
-	if (req)
-		sock_kfree_s(sk, req, reqlen);
+	sock_kfree_s(sk, req, reqlen);
 unlock:
 	aead_wmem_wakeup(sk);
 	release_sock(sk);
@@ -545,9 +643,9 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 	struct alg_sock *ask = alg_sk(sk);
 	struct aead_ctx *ctx = ask->private;
 	unsigned as = crypto_aead_authsize(crypto_aead_reqtfm(&ctx->aead_req));
-	struct aead_sg_list *sgl = &ctx->tsgl;
 	struct aead_async_rsgl *last_rsgl = NULL;
 	struct aead_async_rsgl *rsgl, *tmp;
+	struct aead_op *op;
 	int err = -EINVAL;
 	unsigned long used = 0;
 	size_t outlen = 0;
@@ -570,14 +668,15 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 	 *	AEAD decryption output: plaintext
 	 */
 
-	if (ctx->more) {
+	if (list_empty(&ctx->ops)) {
 		err = aead_wait_for_data(sk, flags);
 		if (err)
 			goto unlock;
 	}
 
-	/* data length provided by caller via sendmsg/sendpage */
-	used = ctx->used;
+	/* oldest operation provided by caller via sendmsg/sendpage */
+	op = list_first_entry(&ctx->ops, struct aead_op, list);
+	used = op->used;
 
 	/*
 	 * Make sure sufficient data is present -- note, the same check is
@@ -588,7 +687,7 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 	 * the error message in sendmsg/sendpage and still call recvmsg. This
 	 * check here protects the kernel integrity.
 	 */
-	if (!aead_sufficient_data(ctx))
+	if (!aead_sufficient_data(ctx, op->used, op->assoclen, op->enc))
 		goto unlock;
 
 	/*
@@ -599,7 +698,7 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 	 * buffer provides the tag which is consumed resulting in only the
 	 * plaintext without a buffer for the tag returned to the caller.
 	 */
-	if (ctx->enc)
+	if (op->enc)
 		outlen = used + as;
 	else
 		outlen = used - as;
@@ -608,7 +707,7 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 	 * The cipher operation input data is reduced by the associated data
 	 * length as this data is processed separately later on.
 	 */
-	used -= ctx->aead_assoclen;
+	used -= op->assoclen;
 
 	/* convert iovecs of output buffers into scatterlists */
 	while (outlen > usedpages && iov_iter_count(&msg->msg_iter)) {
@@ -647,25 +746,27 @@ static int aead_recvmsg_sync(struct socket *sock, struct msghdr *msg, int flags)
 		goto unlock;
 	}
 
-	sg_mark_end(sgl->sg + sgl->cur - 1);
-	aead_request_set_crypt(&ctx->aead_req, sgl->sg, ctx->first_rsgl.sgl.sg,
-			       used, ctx->iv);
-	aead_request_set_ad(&ctx->aead_req, ctx->aead_assoclen);
+	aead_request_set_crypt(&ctx->aead_req, op->tsgl, ctx->first_rsgl.sgl.sg,
+			       used, op->iv);
+	aead_request_set_ad(&ctx->aead_req, op->assoclen);
 
-	err = af_alg_wait_for_completion(ctx->enc ?
+	err = af_alg_wait_for_completion(op->enc ?
 					 crypto_aead_encrypt(&ctx->aead_req) :
 					 crypto_aead_decrypt(&ctx->aead_req),
 					 &ctx->completion);
 
 	if (err) {
 		/* EBADMSG implies a valid cipher operation took place */
-		if (err == -EBADMSG)
-			aead_put_sgl(sk);
+		if (err == -EBADMSG) {
+			aead_dequeue_op(ctx, op);
+			aead_free_op(sk, op);
+		}
 
 		goto unlock;
 	}
 
-	aead_put_sgl(sk);
+	aead_dequeue_op(ctx, op);
+	aead_free_op(sk, op);
 	err = 0;
 
 unlock:
@@ -701,7 +802,7 @@ static unsigned int aead_poll(struct file *file, struct socket *sock,
 	sock_poll_wait(file, sk_sleep(sk), wait);
 	mask = 0;
 
-	if (!ctx->more)
+	if (!list_empty(&ctx->ops))
 		mask |= POLLIN | POLLRDNORM;
 
 	if (aead_writable(sk))
@@ -758,8 +859,13 @@ static void aead_sock_destruct(struct sock *sk)
 	struct aead_ctx *ctx = ask->private;
 	unsigned int ivlen = crypto_aead_ivsize(
 				crypto_aead_reqtfm(&ctx->aead_req));
+	struct aead_op *op, *tmp;
 
 	WARN_ON(atomic_read(&sk->sk_refcnt) != 0);
+	list_for_each_entry_safe(op, tmp, &ctx->ops, list) {
+		aead_dequeue_op(ctx, op);
+		aead_free_op(sk, op);
+	}
 	aead_put_sgl(sk);
 	sock_kzfree_s(sk, ctx->iv, ivlen);
 	sock_kfree_s(sk, ctx, ctx->len);
@@ -790,11 +896,14 @@ static int aead_accept_parent(void *private, struct sock *sk)
 	ctx->more = 0;
 	ctx->merge = 0;
 	ctx->enc = 0;
+	ctx->started = 0;
 	ctx->tsgl.cur = 0;
 	ctx->aead_assoclen = 0;
 	af_alg_init_completion(&ctx->completion);
 	sg_init_table(ctx->tsgl.sg, ALG_MAX_PAGES);
 	INIT_LIST_HEAD(&ctx->list);
+	INIT_LIST_HEAD(&ctx->ops);
+	ctx->queued = 0;
 
 	ask->private = ctx;
 
@@ -13,36 +13,315 @@
  */
 
 #include <linux/err.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
 #include <crypto/engine.h>
 #include <crypto/internal/hash.h>
 #include "internal.h"
 
 #define CRYPTO_ENGINE_MAX_QLEN 10
 
+static struct dentry *crypto_engine_debugfs_root;
+
+static unsigned int crypto_engine_req_len(struct crypto_async_request *req)
+{
+	switch (crypto_tfm_alg_type(req->tfm)) {
+	case CRYPTO_ALG_TYPE_AHASH:
+		return ahash_request_cast(req)->nbytes;
+	case CRYPTO_ALG_TYPE_ABLKCIPHER:
+		return ablkcipher_request_cast(req)->nbytes;
+	}
+	return 0;
+}
+
+/*
+ * Account a request handed back to its owner. With batching, the
+ * latency of a hardware submission is only known once its last request
+ * completed. Called with queue_lock held.
+ */
+static void crypto_engine_account(struct crypto_engine *engine,
+				  struct crypto_async_request *req, int err)
+{
+	struct crypto_engine_stats *stats = &engine->stats;
+	u64 lat;
+
+	stats->requests++;
+	stats->bytes += crypto_engine_req_len(req);
+	if (err)
+		stats->errors++;
+
+	if (engine->inflight)
+		return;
+
+	lat = ktime_to_ns(ktime_sub(ktime_get(), engine->submit_time));
+	stats->latency_total_ns += lat;
+	if (lat > stats->latency_max_ns)
+		stats->latency_max_ns = lat;
+}
+
+/*
+ * crypto_engine_enqueue - queue a request, keeping room for every transform
+ *
+ * A bulk user submitting with CRYPTO_TFM_REQ_MAY_BACKLOG can keep the
+ * queue full all the time, and every other user not allowed to backlog,
+ * like IPsec, would then only ever see -EBUSY. So the first request of
+ * a transform that has nothing queued ahead of the backlog is admitted
+ * even if the queue is full. This overcommits the queue by at most one
+ * request per transform. Called with queue_lock held.
+ */
+static int crypto_engine_enqueue(struct crypto_engine *engine,
+				 struct crypto_async_request *req)
+{
+	struct crypto_queue *queue = &engine->queue;
+	struct crypto_async_request *cur;
+
+	if (likely(queue->qlen < queue->max_qlen) ||
+	    (req->flags & CRYPTO_TFM_REQ_MAY_BACKLOG))
+		return crypto_enqueue_request(queue, req);
+
+	list_for_each_entry(cur, &queue->list, list) {
+		if (&cur->list == queue->backlog)
+			break;
+		if (cur->tfm == req->tfm)
+			return -EBUSY;
+	}
+
+	queue->qlen++;
+	list_add_tail(&req->list, queue->backlog);
+	return -EINPROGRESS;
+}
+
+/*
+ * crypto_engine_dequeue - take the next request to process
+ *
+ * Rather than the head of the queue, this takes the oldest request of a
+ * transform other than the one served last, if there is one among the
+ * first max_qlen entries, so that transforms sharing the engine are
+ * served in turn. Requests of a transform are still processed in the
+ * order they were queued. Called with queue_lock held.
+ */
+static struct crypto_async_request *
+crypto_engine_dequeue(struct crypto_engine *engine,
+		      struct crypto_async_request **backlog)
+{
+	struct crypto_queue *queue = &engine->queue;
+	struct crypto_async_request *req;
+	unsigned int scan = queue->max_qlen;
+
+	if (unlikely(!queue->qlen))
+		return NULL;
+
+	list_for_each_entry(req, &queue->list, list) {
+		if (req->tfm != engine->last_tfm || !--scan)
+			break;
+	}
+	if (&req->list == &queue->list || req->tfm == engine->last_tfm)
+		req = list_first_entry(&queue->list,
+				       struct crypto_async_request, list);
+
+	*backlog = crypto_get_backlog(queue);
+	if (queue->backlog != &queue->list)
+		queue->backlog = queue->backlog->next;
+
+	queue->qlen--;
+	list_del(&req->list);
+	engine->last_tfm = req->tfm;
+
+	return req;
+}
+
+static int crypto_prepare_request(struct crypto_engine *engine,
+				  struct crypto_async_request *req)
+{
+	switch (crypto_tfm_alg_type(req->tfm)) {
+	case CRYPTO_ALG_TYPE_AHASH:
+		if (!engine->prepare_hash_request)
+			return 0;
+		return engine->prepare_hash_request(engine,
+						    ahash_request_cast(req));
+	case CRYPTO_ALG_TYPE_ABLKCIPHER:
+		if (!engine->prepare_cipher_request)
+			return 0;
+		return engine->prepare_cipher_request(engine,
+					ablkcipher_request_cast(req));
+	}
+	return 0;
+}
+
+static int crypto_unprepare_request(struct crypto_engine *engine,
+				    struct crypto_async_request *req)
+{
+	switch (crypto_tfm_alg_type(req->tfm)) {
+	case CRYPTO_ALG_TYPE_AHASH:
+		if (!engine->unprepare_hash_request)
+			return 0;
+		return engine->unprepare_hash_request(engine,
+						      ahash_request_cast(req));
+	case CRYPTO_ALG_TYPE_ABLKCIPHER:
+		if (!engine->unprepare_cipher_request)
+			return 0;
+		return engine->unprepare_cipher_request(engine,
+					ablkcipher_request_cast(req));
+	}
+	return 0;
+}
+
+static int crypto_one_request(struct crypto_engine *engine,
+			      struct crypto_async_request *req)
+{
+	switch (crypto_tfm_alg_type(req->tfm)) {
+	case CRYPTO_ALG_TYPE_AHASH:
+		return engine->hash_one_request(engine,
+						ahash_request_cast(req));
+	case CRYPTO_ALG_TYPE_ABLKCIPHER:
+		return engine->cipher_one_request(engine,
+					ablkcipher_request_cast(req));
+	}
+	pr_err("failed to prepare request of unknown type\n");
+	return -EINVAL;
+}
+
+/*
+ * Complete a request of the current submission, which was not handed
+ * to the driver or that the driver is done with.
+ */
+static void crypto_engine_complete(struct crypto_engine *engine,
+				   struct crypto_async_request *req, int err)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	if (engine->do_batch) {
+		engine->inflight--;
+	} else {
+		engine->cur_req = NULL;
+		engine->cur_req_prepared = false;
+	}
+	crypto_engine_account(engine, req, err);
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	req->complete(req, err);
+
+	kthread_queue_work(&engine->kworker, &engine->pump_requests);
+}
+
+static void crypto_finalize_request(struct crypto_engine *engine,
+				    struct crypto_async_request *req, int err)
+{
+	unsigned long flags;
+	bool finalize_cur_req;
+	bool prepared;
+	int ret;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	if (engine->do_batch) {
+		/* every request of a batch was prepared before submission */
+		finalize_cur_req = true;
+		prepared = true;
+	} else {
+		finalize_cur_req = engine->cur_req == req;
+		prepared = engine->cur_req_prepared;
+	}
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (!finalize_cur_req) {
+		req->complete(req, err);
+		kthread_queue_work(&engine->kworker, &engine->pump_requests);
+		return;
+	}
+
+	if (prepared) {
+		ret = crypto_unprepare_request(engine, req);
+		if (ret)
+			pr_err("failed to unprepare request\n");
+	}
+
+	crypto_engine_complete(engine, req, err);
+}
+
+/**
+ * crypto_pump_batch - hand a batch of requests to the driver
+ * @engine: the hardware engine
+ * @batch: the requests dequeued for this submission
+ * @was_busy: the hardware is already prepared
+ *
+ * Every request of @batch is prepared and passed to the driver, which
+ * only queues it to the hardware, and do_batch() then starts the
+ * hardware on all of them at once. The driver finalizes each request
+ * as usual.
+ */
+static void crypto_pump_batch(struct crypto_engine *engine,
+			      struct list_head *batch, bool was_busy)
+{
+	struct crypto_async_request *req, *tmp;
+	bool submitted = false;
+	int ret = 0;
+
+	if (!was_busy && engine->prepare_crypt_hardware) {
+		ret = engine->prepare_crypt_hardware(engine);
+		if (ret)
+			pr_err("failed to prepare crypt hardware\n");
+	}
+
+	list_for_each_entry_safe(req, tmp, batch, list) {
+		int err = ret;
+
+		list_del(&req->list);
+
+		if (!err) {
+			err = crypto_prepare_request(engine, req);
+			if (err)
+				pr_err("failed to prepare request: %d\n", err);
+		}
+		if (err) {
+			crypto_engine_complete(engine, req, err);
+			continue;
+		}
+
+		err = crypto_one_request(engine, req);
+		if (err) {
+			pr_err("failed to process one request from queue\n");
+			crypto_finalize_request(engine, req, err);
+			continue;
+		}
+		submitted = true;
+	}
+
+	if (submitted) {
+		ret = engine->do_batch(engine);
+		if (ret)
+			pr_err("failed to start batch: %d\n", ret);
+	}
+
+	kthread_queue_work(&engine->kworker, &engine->pump_requests);
+}
+
 /**
- * crypto_pump_requests - dequeue one request from engine queue to process
+ * crypto_pump_requests - dequeue requests from engine queue to process
  * @engine: the hardware engine
  * @in_kthread: true if we are in the context of the request pump thread
  *
  * This function checks if there is any request in the engine queue that
  * needs processing and if so call out to the driver to initialize hardware
- * and handle each request.
+ * and handle each request. If the driver supports batching, up to
+ * max_batch requests are handed to it per hardware submission.
  */
 static void crypto_pump_requests(struct crypto_engine *engine,
 				 bool in_kthread)
 {
 	struct crypto_async_request *async_req, *backlog;
-	struct ahash_request *hreq;
-	struct ablkcipher_request *breq;
 	unsigned long flags;
 	bool was_busy = false;
-	int ret, rtype;
+	LIST_HEAD(batch);
+	unsigned int n;
+	int ret;
 
 	spin_lock_irqsave(&engine->queue_lock, flags);
 
 	/* Make sure we are not already running a request */
-	if (engine->cur_req)
+	if (engine->cur_req || engine->inflight)
 		goto out;
 
 	/* If another context is idling then defer */
@@ -76,15 +355,34 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 		goto out;
 	}
 
-	/* Get the fist request from the engine queue to handle */
-	backlog = crypto_get_backlog(&engine->queue);
-	async_req = crypto_dequeue_request(&engine->queue);
-	if (!async_req)
-		goto out;
+	if (engine->do_batch) {
+		for (n = 0; n < max(engine->max_batch, 1U); n++) {
+			async_req = crypto_engine_dequeue(engine, &backlog);
+			if (!async_req)
+				break;
+			if (backlog)
+				backlog->complete(backlog, -EINPROGRESS);
+			list_add_tail(&async_req->list, &batch);
+		}
+		if (!n)
+			goto out;
+		engine->inflight = n;
+	} else {
+		/* Get the fist request from the engine queue to handle */
+		async_req = crypto_engine_dequeue(engine, &backlog);
+		if (!async_req)
+			goto out;
+
+		engine->cur_req = async_req;
+		if (backlog)
+			backlog->complete(backlog, -EINPROGRESS);
+		n = 1;
+	}
 
-	engine->cur_req = async_req;
-	if (backlog)
-		backlog->complete(backlog, -EINPROGRESS);
+	engine->submit_time = ktime_get();
+	engine->stats.batches++;
+	if (n > engine->stats.max_batch)
+		engine->stats.max_batch = n;
 
 	if (engine->busy)
 		was_busy = true;
@@ -93,7 +391,11 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 
 	spin_unlock_irqrestore(&engine->queue_lock, flags);
 
-	rtype = crypto_tfm_alg_type(engine->cur_req->tfm);
+	if (engine->do_batch) {
+		crypto_pump_batch(engine, &batch, was_busy);
+		return;
+	}
+
 	/* Until here we get the request need to be encrypted successfully */
 	if (!was_busy && engine->prepare_crypt_hardware) {
 		ret = engine->prepare_crypt_hardware(engine);
@@ -103,57 +405,24 @@ static void crypto_pump_requests(struct crypto_engine *engine,
 		}
 	}
 
-	switch (rtype) {
-	case CRYPTO_ALG_TYPE_AHASH:
-		hreq = ahash_request_cast(engine->cur_req);
-		if (engine->prepare_hash_request) {
-			ret = engine->prepare_hash_request(engine, hreq);
-			if (ret) {
-				pr_err("failed to prepare request: %d\n", ret);
-				goto req_err;
-			}
-			engine->cur_req_prepared = true;
-		}
-		ret = engine->hash_one_request(engine, hreq);
-		if (ret) {
-			pr_err("failed to hash one request from queue\n");
-			goto req_err;
-		}
-		return;
-	case CRYPTO_ALG_TYPE_ABLKCIPHER:
-		breq = ablkcipher_request_cast(engine->cur_req);
-		if (engine->prepare_cipher_request) {
-			ret = engine->prepare_cipher_request(engine, breq);
-			if (ret) {
-				pr_err("failed to prepare request: %d\n", ret);
-				goto req_err;
-			}
-			engine->cur_req_prepared = true;
-		}
-		ret = engine->cipher_one_request(engine, breq);
-		if (ret) {
-			pr_err("failed to cipher one request from queue\n");
-			goto req_err;
-		}
-		return;
-	default:
-		pr_err("failed to prepare request of unknown type\n");
-		return;
+	ret = crypto_prepare_request(engine, async_req);
+	if (ret) {
+		pr_err("failed to prepare request: %d\n", ret);
+		goto req_err;
 	}
+	engine->cur_req_prepared = true;
 
-req_err:
-	switch (rtype) {
-	case CRYPTO_ALG_TYPE_AHASH:
-		hreq = ahash_request_cast(engine->cur_req);
-		crypto_finalize_hash_request(engine, hreq, ret);
-		break;
-	case CRYPTO_ALG_TYPE_ABLKCIPHER:
-		breq = ablkcipher_request_cast(engine->cur_req);
-		crypto_finalize_cipher_request(engine, breq, ret);
-		break;
+	ret = crypto_one_request(engine, async_req);
+	if (ret) {
+		pr_err("failed to process one request from queue\n");
+		goto req_err;
 	}
 	return;
 
+req_err:
+	crypto_finalize_request(engine, async_req, ret);
+	return;
+
 out:
 	spin_unlock_irqrestore(&engine->queue_lock, flags);
 }
@@ -186,7 +455,9 @@ int crypto_transfer_cipher_request(struct crypto_engine *engine,
 		return -ESHUTDOWN;
 	}
 
-	ret = ablkcipher_enqueue_request(&engine->queue, req);
+	ret = crypto_engine_enqueue(engine, &req->base);
+	if (crypto_queue_len(&engine->queue) > engine->stats.max_qlen)
+		engine->stats.max_qlen = crypto_queue_len(&engine->queue);
 
 	if (!engine->busy && need_pump)
 		kthread_queue_work(&engine->kworker, &engine->pump_requests);
@@ -228,7 +499,9 @@ int crypto_transfer_hash_request(struct crypto_engine *engine,
 		return -ESHUTDOWN;
 	}
 
-	ret = ahash_enqueue_request(&engine->queue, req);
+	ret = crypto_engine_enqueue(engine, &req->base);
+	if (crypto_queue_len(&engine->queue) > engine->stats.max_qlen)
+		engine->stats.max_qlen = crypto_queue_len(&engine->queue);
 
 	if (!engine->busy && need_pump)
 		kthread_queue_work(&engine->kworker, &engine->pump_requests);
@@ -260,31 +533,7 @@ EXPORT_SYMBOL_GPL(crypto_transfer_hash_request_to_engine);
 void crypto_finalize_cipher_request(struct crypto_engine *engine,
 				    struct ablkcipher_request *req, int err)
 {
-	unsigned long flags;
-	bool finalize_cur_req = false;
-	int ret;
-
-	spin_lock_irqsave(&engine->queue_lock, flags);
-	if (engine->cur_req == &req->base)
-		finalize_cur_req = true;
-	spin_unlock_irqrestore(&engine->queue_lock, flags);
-
-	if (finalize_cur_req) {
-		if (engine->cur_req_prepared &&
-		    engine->unprepare_cipher_request) {
-			ret = engine->unprepare_cipher_request(engine, req);
-			if (ret)
-				pr_err("failed to unprepare request\n");
-		}
-		spin_lock_irqsave(&engine->queue_lock, flags);
-		engine->cur_req = NULL;
-		engine->cur_req_prepared = false;
-		spin_unlock_irqrestore(&engine->queue_lock, flags);
-	}
-
-	req->base.complete(&req->base, err);
-
-	kthread_queue_work(&engine->kworker, &engine->pump_requests);
+	crypto_finalize_request(engine, &req->base, err);
 }
 EXPORT_SYMBOL_GPL(crypto_finalize_cipher_request);
 
@@ -297,31 +546,7 @@ EXPORT_SYMBOL_GPL(crypto_finalize_cipher_request);
 void crypto_finalize_hash_request(struct crypto_engine *engine,
 				  struct ahash_request *req, int err)
 {
-	unsigned long flags;
-	bool finalize_cur_req = false;
-	int ret;
-
-	spin_lock_irqsave(&engine->queue_lock, flags);
-	if (engine->cur_req == &req->base)
-		finalize_cur_req = true;
-	spin_unlock_irqrestore(&engine->queue_lock, flags);
-
-	if (finalize_cur_req) {
-		if (engine->cur_req_prepared &&
-		    engine->unprepare_hash_request) {
-			ret = engine->unprepare_hash_request(engine, req);
-			if (ret)
-				pr_err("failed to unprepare request\n");
-		}
-		spin_lock_irqsave(&engine->queue_lock, flags);
-		engine->cur_req = NULL;
-		engine->cur_req_prepared = false;
-		spin_unlock_irqrestore(&engine->queue_lock, flags);
-	}
-
-	req->base.complete(&req->base, err);
-
-	kthread_queue_work(&engine->kworker, &engine->pump_requests);
+	crypto_finalize_request(engine, &req->base, err);
 }
 EXPORT_SYMBOL_GPL(crypto_finalize_hash_request);
 
@@ -389,6 +614,42 @@ int crypto_engine_stop(struct crypto_engine *engine)
 }
 EXPORT_SYMBOL_GPL(crypto_engine_stop);
 
+static int crypto_engine_stats_show(struct seq_file *m, void *v)
+{
+	struct crypto_engine *engine = m->private;
+	struct crypto_engine_stats stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	stats = engine->stats;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	seq_printf(m, "requests:        %llu\n", stats.requests);
+	seq_printf(m, "bytes:           %llu\n", stats.bytes);
+	seq_printf(m, "errors:          %llu\n", stats.errors);
+	seq_printf(m, "batches:         %llu\n", stats.batches);
+	seq_printf(m, "max_batch:       %u\n", stats.max_batch);
+	seq_printf(m, "max_qlen:        %u\n", stats.max_qlen);
+	seq_printf(m, "latency_avg_ns:  %llu\n", stats.batches ?
+		   div64_u64(stats.latency_total_ns, stats.batches) : 0);
+	seq_printf(m, "latency_max_ns:  %llu\n", stats.latency_max_ns);
+
+	return 0;
+}
+
+static int crypto_engine_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, crypto_engine_stats_show, inode->i_private);
+}
+
+static const struct file_operations crypto_engine_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= crypto_engine_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 /**
  * crypto_engine_alloc_init - allocate crypto hardware engine structure and
  * initialize it.
@@ -415,6 +676,7 @@ struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
 	engine->busy = false;
 	engine->idling = false;
 	engine->cur_req_prepared = false;
+	engine->max_batch = 1;
 	engine->priv_data = dev;
 	snprintf(engine->name, sizeof(engine->name),
 		 "%s-engine", dev_name(dev));
@@ -437,6 +699,11 @@ struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
 		sched_setscheduler(engine->kworker_task, SCHED_FIFO, &param);
 	}
 
+	engine->debugfs = debugfs_create_dir(engine->name,
+					     crypto_engine_debugfs_root);
+	debugfs_create_file("stats", 0444, engine->debugfs, engine,
+			    &crypto_engine_stats_fops);
+
 	return engine;
 }
 EXPORT_SYMBOL_GPL(crypto_engine_alloc_init);
@@ -458,9 +725,25 @@ int crypto_engine_exit(struct crypto_engine *engine)
 	kthread_flush_worker(&engine->kworker);
 	kthread_stop(engine->kworker_task);
 
+	debugfs_remove_recursive(engine->debugfs);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(crypto_engine_exit);
 
+static int __init crypto_engine_init(void)
+{
+	crypto_engine_debugfs_root = debugfs_create_dir("crypto_engine", NULL);
+	return 0;
+}
+
+static void __exit crypto_engine_exit_module(void)
+{
+	debugfs_remove_recursive(crypto_engine_debugfs_root);
+}
+
+subsys_initcall(crypto_engine_init);
+module_exit(crypto_engine_exit_module);
+
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Crypto hardware engine framework");
@@ -378,7 +378,7 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 			    pm_message_t state, char *info)
 {
-	ktime_t calltime;
+	ktime_t calltime, proftime;
 	int error;
 
 	if (!cb)
@@ -388,7 +388,9 @@ static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 
 	pm_dev_dbg(dev, state, info);
 	trace_device_pm_callback_start(dev, info, state.event);
+	proftime = dpm_profile_start();
 	error = cb(dev);
+	dpm_profile_record(dev, proftime, error);
 	trace_device_pm_callback_end(dev, error);
 	suspend_report_result(cb, error);
 
@@ -549,6 +551,7 @@ void dpm_resume_noirq(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume_noirq"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_RESUME_NOIRQ);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 
@@ -592,6 +595,7 @@ void dpm_resume_noirq(pm_message_t state)
 	resume_device_irqs();
 	device_wakeup_disarm_wake_irqs();
 	cpuidle_resume();
+	dpm_profile_phase_end(DPM_PROFILE_RESUME_NOIRQ);
 	trace_suspend_resume(TPS("dpm_resume_noirq"), state.event, false);
 }
 
@@ -672,6 +676,7 @@ void dpm_resume_early(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume_early"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_RESUME_EARLY);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 
@@ -711,6 +716,7 @@ void dpm_resume_early(pm_message_t state)
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
 	dpm_show_time(starttime, state, "early");
+	dpm_profile_phase_end(DPM_PROFILE_RESUME_EARLY);
 	trace_suspend_resume(TPS("dpm_resume_early"), state.event, false);
 }
 
@@ -844,6 +850,7 @@ void dpm_resume(pm_message_t state)
 	ktime_t starttime = ktime_get();
 
 	trace_suspend_resume(TPS("dpm_resume"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_RESUME);
 	might_sleep();
 
 	mutex_lock(&dpm_list_mtx);
@@ -885,6 +892,7 @@ void dpm_resume(pm_message_t state)
 	dpm_show_time(starttime, state, NULL);
 
 	cpufreq_resume();
+	dpm_profile_phase_end(DPM_PROFILE_RESUME);
 	trace_suspend_resume(TPS("dpm_resume"), state.event, false);
 }
 
@@ -942,8 +950,10 @@ static void device_complete(struct device *dev, pm_message_t state)
 void dpm_complete(pm_message_t state)
 {
 	struct list_head list;
+	ktime_t proftime;
 
 	trace_suspend_resume(TPS("dpm_complete"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_COMPLETE);
 	might_sleep();
 
 	INIT_LIST_HEAD(&list);
@@ -957,7 +967,9 @@ void dpm_complete(pm_message_t state)
 		mutex_unlock(&dpm_list_mtx);
 
 		trace_device_pm_callback_start(dev, "", state.event);
+		proftime = dpm_profile_start();
 		device_complete(dev, state);
+		dpm_profile_record(dev, proftime, 0);
 		trace_device_pm_callback_end(dev, 0);
 
 		mutex_lock(&dpm_list_mtx);
@@ -968,6 +980,7 @@ void dpm_complete(pm_message_t state)
 
 	/* Allow device probing and trigger re-probing of deferred devices */
 	device_unblock_probing();
+	dpm_profile_phase_end(DPM_PROFILE_COMPLETE);
 	trace_suspend_resume(TPS("dpm_complete"), state.event, false);
 }
 
@@ -1110,6 +1123,7 @@ int dpm_suspend_noirq(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend_noirq"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_SUSPEND_NOIRQ);
 	cpuidle_pause();
 	device_wakeup_arm_wake_irqs();
 	suspend_device_irqs();
@@ -1151,6 +1165,7 @@ int dpm_suspend_noirq(pm_message_t state)
 	} else {
 		dpm_show_time(starttime, state, "noirq");
 	}
+	dpm_profile_phase_end(DPM_PROFILE_SUSPEND_NOIRQ);
 	trace_suspend_resume(TPS("dpm_suspend_noirq"), state.event, false);
 	return error;
 }
@@ -1254,6 +1269,7 @@ int dpm_suspend_late(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend_late"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_SUSPEND_LATE);
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
@@ -1292,6 +1308,7 @@ int dpm_suspend_late(pm_message_t state)
 	} else {
 		dpm_show_time(starttime, state, "late");
 	}
+	dpm_profile_phase_end(DPM_PROFILE_SUSPEND_LATE);
 	trace_suspend_resume(TPS("dpm_suspend_late"), state.event, false);
 	return error;
 }
@@ -1328,12 +1345,14 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 			  char *info)
 {
 	int error;
-	ktime_t calltime;
+	ktime_t calltime, proftime;
 
 	calltime = initcall_debug_start(dev);
 
 	trace_device_pm_callback_start(dev, info, state.event);
+	proftime = dpm_profile_start();
 	error = cb(dev, state);
+	dpm_profile_record(dev, proftime, error);
 	trace_device_pm_callback_end(dev, error);
 	suspend_report_result(cb, error);
 
@@ -1505,6 +1524,7 @@ int dpm_suspend(pm_message_t state)
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_suspend"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_SUSPEND);
 	might_sleep();
 
 	cpufreq_suspend();
@@ -1542,6 +1562,7 @@ int dpm_suspend(pm_message_t state)
 		dpm_save_failed_step(SUSPEND_SUSPEND);
 	} else
 		dpm_show_time(starttime, state, NULL);
+	dpm_profile_phase_end(DPM_PROFILE_SUSPEND);
 	trace_suspend_resume(TPS("dpm_suspend"), state.event, false);
 	return error;
 }
@@ -1623,9 +1644,11 @@ static int device_prepare(struct device *dev, pm_message_t state)
  */
 int dpm_prepare(pm_message_t state)
 {
+	ktime_t proftime;
 	int error = 0;
 
 	trace_suspend_resume(TPS("dpm_prepare"), state.event, true);
+	dpm_profile_phase_start(DPM_PROFILE_PREPARE);
 	might_sleep();
 
 	/*
@@ -1650,7 +1673,9 @@ int dpm_prepare(pm_message_t state)
 		mutex_unlock(&dpm_list_mtx);
 
 		trace_device_pm_callback_start(dev, "", state.event);
+		proftime = dpm_profile_start();
 		error = device_prepare(dev, state);
+		dpm_profile_record(dev, proftime, error);
 		trace_device_pm_callback_end(dev, error);
 
 		mutex_lock(&dpm_list_mtx);
@@ -1672,6 +1697,7 @@ int dpm_prepare(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
+	dpm_profile_phase_end(DPM_PROFILE_PREPARE);
 	trace_suspend_resume(TPS("dpm_prepare"), state.event, false);
 	return error;
 }
@@ -144,6 +144,45 @@ extern void device_pm_move_after(struct device *, struct device *);
 extern void device_pm_move_last(struct device *);
 extern void device_pm_check_callbacks(struct device *dev);
 
+/* drivers/base/power/profile.c */
+enum dpm_profile_phase {
+	DPM_PROFILE_PREPARE,
+	DPM_PROFILE_SUSPEND,
+	DPM_PROFILE_SUSPEND_LATE,
+	DPM_PROFILE_SUSPEND_NOIRQ,
+	DPM_PROFILE_RESUME_NOIRQ,
+	DPM_PROFILE_RESUME_EARLY,
+	DPM_PROFILE_RESUME,
+	DPM_PROFILE_COMPLETE,
+	DPM_PROFILE_NR_PHASES
+};
+
+#ifdef CONFIG_PM_SLEEP_PROFILE
+
+extern void dpm_profile_phase_start(enum dpm_profile_phase phase);
+extern void dpm_profile_phase_end(enum dpm_profile_phase phase);
+extern void dpm_profile_record(struct device *dev, ktime_t calltime,
+			       int error);
+
+static inline ktime_t dpm_profile_start(void)
+{
+	return ktime_get();
+}
+
+#else /* !CONFIG_PM_SLEEP_PROFILE */
+
+static inline void dpm_profile_phase_start(enum dpm_profile_phase phase) {}
+static inline void dpm_profile_phase_end(enum dpm_profile_phase phase) {}
+static inline void dpm_profile_record(struct device *dev, ktime_t calltime,
+				      int error) {}
+
+static inline ktime_t dpm_profile_start(void)
+{
+	return ktime_set(0, 0);
+}
+
+#endif /* !CONFIG_PM_SLEEP_PROFILE */
+
 #else /* !CONFIG_PM_SLEEP */
 
 static inline void device_pm_sleep_init(struct device *dev) {}
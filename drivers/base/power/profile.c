@@ -0,0 +1,309 @@
+/*
+ * drivers/base/power/profile.c - Device suspend/resume latency profiler
+ *
+ * This file is released under the GPLv2.
+ *
+ * Records how long the system sleep callbacks of every device take, in
+ * each phase of the suspend and resume sequences, into a ring buffer.
+ * The aggregated view of the last cycle shows where each phase spends
+ * its time: the callbacks run synchronously add up, while those run
+ * asynchronously overlap. Long synchronous callbacks are listed as
+ * candidates for asynchronous suspend/resume.
+ *
+ * The data are available in debugfs under pm_profile/.
+ */
+
+#include <linux/async.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "power.h"
+
+#define DPM_PROFILE_ENTRIES	512
+#define DPM_PROFILE_NAME_LEN	32
+#define DPM_PROFILE_CANDIDATES	16
+
+struct dpm_profile_entry {
+	unsigned int cycle;
+	u8 phase;
+	bool async;
+	int error;
+	u32 start_us;		/* relative to the start of the phase */
+	u32 duration_us;
+	char name[DPM_PROFILE_NAME_LEN];
+};
+
+struct dpm_profile_phase_stats {
+	unsigned int cycle;
+	ktime_t start;
+	u32 duration_us;
+	u32 sync_us;
+	unsigned int nr_sync;
+	unsigned int nr_async;
+	u32 max_async_us;
+	char max_async_name[DPM_PROFILE_NAME_LEN];
+	u32 last_end_us;
+	char last_name[DPM_PROFILE_NAME_LEN];
+};
+
+static const char * const dpm_profile_phase_names[DPM_PROFILE_NR_PHASES] = {
+	[DPM_PROFILE_PREPARE]		= "prepare",
+	[DPM_PROFILE_SUSPEND]		= "suspend",
+	[DPM_PROFILE_SUSPEND_LATE]	= "suspend_late",
+	[DPM_PROFILE_SUSPEND_NOIRQ]	= "suspend_noirq",
+	[DPM_PROFILE_RESUME_NOIRQ]	= "resume_noirq",
+	[DPM_PROFILE_RESUME_EARLY]	= "resume_early",
+	[DPM_PROFILE_RESUME]		= "resume",
+	[DPM_PROFILE_COMPLETE]		= "complete",
+};
+
+static DEFINE_SPINLOCK(dpm_profile_lock);
+static struct dpm_profile_entry dpm_profile_ring[DPM_PROFILE_ENTRIES];
+static unsigned int dpm_profile_head;	/* total number of entries added */
+static struct dpm_profile_phase_stats dpm_profile_phases[DPM_PROFILE_NR_PHASES];
+static enum dpm_profile_phase dpm_profile_cur;
+static unsigned int dpm_profile_cycle;
+
+static u32 dpm_profile_us(ktime_t start, ktime_t end)
+{
+	s64 us = ktime_us_delta(end, start);
+
+	return clamp_t(s64, us, 0, U32_MAX);
+}
+
+/**
+ * dpm_profile_phase_start - Note the start of a system sleep phase.
+ * @phase: The phase being started.
+ *
+ * A new cycle starts with the prepare phase.
+ */
+void dpm_profile_phase_start(enum dpm_profile_phase phase)
+{
+	struct dpm_profile_phase_stats *ps = &dpm_profile_phases[phase];
+	unsigned long flags;
+
+	spin_lock_irqsave(&dpm_profile_lock, flags);
+	if (phase == DPM_PROFILE_PREPARE)
+		dpm_profile_cycle++;
+	dpm_profile_cur = phase;
+	memset(ps, 0, sizeof(*ps));
+	ps->cycle = dpm_profile_cycle;
+	ps->start = ktime_get();
+	spin_unlock_irqrestore(&dpm_profile_lock, flags);
+}
+
+/**
+ * dpm_profile_phase_end - Note the end of a system sleep phase.
+ * @phase: The phase being completed.
+ */
+void dpm_profile_phase_end(enum dpm_profile_phase phase)
+{
+	struct dpm_profile_phase_stats *ps = &dpm_profile_phases[phase];
+
+	ps->duration_us = dpm_profile_us(ps->start, ktime_get());
+}
+
+/**
+ * dpm_profile_record - Record the execution of a device PM callback.
+ * @dev: Device whose callback has been run.
+ * @calltime: Time the callback was started at, from dpm_profile_start().
+ * @error: Value returned by the callback.
+ */
+void dpm_profile_record(struct device *dev, ktime_t calltime, int error)
+{
+	ktime_t now = ktime_get();
+	struct dpm_profile_phase_stats *ps;
+	struct dpm_profile_entry *e;
+	unsigned long flags;
+	u32 end_us;
+
+	spin_lock_irqsave(&dpm_profile_lock, flags);
+
+	ps = &dpm_profile_phases[dpm_profile_cur];
+	e = &dpm_profile_ring[dpm_profile_head++ % DPM_PROFILE_ENTRIES];
+
+	e->cycle = dpm_profile_cycle;
+	e->phase = dpm_profile_cur;
+	e->async = current_is_async();
+	e->error = error;
+	e->start_us = dpm_profile_us(ps->start, calltime);
+	e->duration_us = dpm_profile_us(calltime, now);
+	strlcpy(e->name, dev_name(dev), sizeof(e->name));
+
+	if (e->async) {
+		ps->nr_async++;
+		if (e->duration_us >= ps->max_async_us) {
+			ps->max_async_us = e->duration_us;
+			memcpy(ps->max_async_name, e->name, sizeof(e->name));
+		}
+	} else {
+		ps->nr_sync++;
+		ps->sync_us += e->duration_us;
+	}
+
+	end_us = e->start_us + e->duration_us;
+	if (end_us >= ps->last_end_us) {
+		ps->last_end_us = end_us;
+		memcpy(ps->last_name, e->name, sizeof(e->name));
+	}
+
+	spin_unlock_irqrestore(&dpm_profile_lock, flags);
+}
+
+static void dpm_profile_print_us(struct seq_file *m, u32 us)
+{
+	seq_printf(m, "%u.%03u", us / 1000, us % 1000);
+}
+
+static int dpm_profile_devices_show(struct seq_file *m, void *unused)
+{
+	unsigned int i, first;
+	unsigned long flags;
+
+	seq_puts(m, "cycle\tphase\t\tmode\tstart_ms\tduration_ms\terror\tdevice\n");
+
+	spin_lock_irqsave(&dpm_profile_lock, flags);
+	first = dpm_profile_head > DPM_PROFILE_ENTRIES ?
+		dpm_profile_head - DPM_PROFILE_ENTRIES : 0;
+	for (i = first; i != dpm_profile_head; i++) {
+		struct dpm_profile_entry *e =
+			&dpm_profile_ring[i % DPM_PROFILE_ENTRIES];
+
+		seq_printf(m, "%u\t%-14s\t%s\t", e->cycle,
+			   dpm_profile_phase_names[e->phase],
+			   e->async ? "async" : "sync");
+		dpm_profile_print_us(m, e->start_us);
+		seq_puts(m, "\t\t");
+		dpm_profile_print_us(m, e->duration_us);
+		seq_printf(m, "\t\t%d\t%s\n", e->error, e->name);
+	}
+	spin_unlock_irqrestore(&dpm_profile_lock, flags);
+
+	return 0;
+}
+
+/*
+ * Lists the longest synchronous callbacks of the last cycle, the devices
+ * for which switching to asynchronous suspend/resume may shorten the
+ * critical path.
+ */
+static void dpm_profile_show_candidates(struct seq_file *m)
+{
+	struct dpm_profile_entry *top[DPM_PROFILE_CANDIDATES];
+	unsigned int i, j, first, nr = 0;
+
+	first = dpm_profile_head > DPM_PROFILE_ENTRIES ?
+		dpm_profile_head - DPM_PROFILE_ENTRIES : 0;
+	for (i = first; i != dpm_profile_head; i++) {
+		struct dpm_profile_entry *e =
+			&dpm_profile_ring[i % DPM_PROFILE_ENTRIES];
+
+		if (e->cycle != dpm_profile_cycle || e->async ||
+		    e->phase == DPM_PROFILE_PREPARE ||
+		    e->phase == DPM_PROFILE_COMPLETE || !e->duration_us)
+			continue;
+
+		/* insertion into the sorted top list */
+		for (j = nr; j > 0 && top[j - 1]->duration_us < e->duration_us; j--)
+			if (j < DPM_PROFILE_CANDIDATES)
+				top[j] = top[j - 1];
+		if (j < DPM_PROFILE_CANDIDATES) {
+			top[j] = e;
+			if (nr < DPM_PROFILE_CANDIDATES)
+				nr++;
+		}
+	}
+
+	seq_puts(m, "\nasync candidates (longest sync callbacks):\n");
+	for (i = 0; i < nr; i++) {
+		seq_printf(m, "  %-14s ", dpm_profile_phase_names[top[i]->phase]);
+		dpm_profile_print_us(m, top[i]->duration_us);
+		seq_printf(m, " ms  %s\n", top[i]->name);
+	}
+}
+
+static int dpm_profile_summary_show(struct seq_file *m, void *unused)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&dpm_profile_lock, flags);
+
+	seq_printf(m, "cycle %u\n", dpm_profile_cycle);
+	for (i = 0; i < DPM_PROFILE_NR_PHASES; i++) {
+		struct dpm_profile_phase_stats *ps = &dpm_profile_phases[i];
+
+		if (!ps->cycle)
+			continue;
+
+		seq_printf(m, "%-14s total ", dpm_profile_phase_names[i]);
+		dpm_profile_print_us(m, ps->duration_us);
+		seq_printf(m, " ms, %u sync ", ps->nr_sync);
+		dpm_profile_print_us(m, ps->sync_us);
+		seq_printf(m, " ms, %u async", ps->nr_async);
+		if (ps->nr_async) {
+			seq_puts(m, " (longest ");
+			dpm_profile_print_us(m, ps->max_async_us);
+			seq_printf(m, " ms %s)", ps->max_async_name);
+		}
+		if (ps->last_name[0]) {
+			seq_puts(m, ", last to finish ");
+			seq_printf(m, "%s at ", ps->last_name);
+			dpm_profile_print_us(m, ps->last_end_us);
+			seq_puts(m, " ms");
+		}
+		if (ps->cycle != dpm_profile_cycle)
+			seq_printf(m, " [cycle %u]", ps->cycle);
+		seq_putc(m, '\n');
+	}
+
+	dpm_profile_show_candidates(m);
+
+	spin_unlock_irqrestore(&dpm_profile_lock, flags);
+	return 0;
+}
+
+static int dpm_profile_devices_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_profile_devices_show, NULL);
+}
+
+static const struct file_operations dpm_profile_devices_fops = {
+	.open		= dpm_profile_devices_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int dpm_profile_summary_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_profile_summary_show, NULL);
+}
+
+static const struct file_operations dpm_profile_summary_fops = {
+	.open		= dpm_profile_summary_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dpm_profile_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("pm_profile", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("devices", 0444, dir, NULL,
+			    &dpm_profile_devices_fops);
+	debugfs_create_file("summary", 0444, dir, NULL,
+			    &dpm_profile_summary_fops);
+	return 0;
+}
+late_initcall(dpm_profile_debugfs_init);
@@ -437,6 +437,21 @@ static int crng_init = 0;
 #define crng_ready() (likely(crng_init > 0))
 static int crng_init_cnt = 0;
 #define CRNG_INIT_CNT_THRESH (2*CHACHA20_KEY_SIZE)
+
+/*
+ * Once the crng is initialized from the input pool, every CPU generates
+ * its output from a key of its own, taken from the crng of its node.
+ * The key is rekeyed whenever a crng is reseeded, which bumps
+ * crng_generation, and at least every CRNG_RESEED_INTERVAL.
+ */
+struct crng_percpu {
+	__u32		key[CHACHA20_KEY_SIZE / sizeof(__u32)];
+	unsigned long	generation;
+	unsigned long	init_time;
+};
+
+static DEFINE_PER_CPU(struct crng_percpu, crng_percpu);
+static unsigned long crng_generation = 1;
 static void _extract_crng(struct crng_state *crng,
 			  __u8 out[CHACHA20_BLOCK_SIZE]);
 static void _crng_backtrack_protect(struct crng_state *crng,
@@ -846,6 +861,7 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	}
 	memzero_explicit(&buf, sizeof(buf));
 	crng->init_time = jiffies;
+	WRITE_ONCE(crng_generation, crng_generation + 1);
 	if (crng == &primary_crng && crng_init < 2) {
 		crng_init = 2;
 		process_random_ready_list();
@@ -934,12 +950,139 @@ static void crng_backtrack_protect(__u8 tmp[CHACHA20_BLOCK_SIZE], int used)
 	_crng_backtrack_protect(crng, tmp, used);
 }
 
+/*
+ * crng_make_state - set up a ChaCha20 state from the key of this CPU
+ *
+ * Fills @chacha_state for the exclusive use of the caller, and @out with
+ * up to 32 bytes of output, so that small requests need a single block.
+ * The key of the CPU is replaced with the first half of the same block,
+ * so the state of the caller and its past output can no longer be
+ * recovered from it. Only the local CPU is touched, with interrupts
+ * disabled; the crng of the node is only used when rekeying, and is
+ * backtrack protected right after the new key is drawn.
+ */
+static void crng_make_state(__u32 chacha_state[16], __u8 *out, size_t len)
+{
+	struct crng_percpu *pcpu;
+	__u8 block[CHACHA20_BLOCK_SIZE];
+	unsigned long flags;
+
+	BUG_ON(len > CHACHA20_BLOCK_SIZE - CHACHA20_KEY_SIZE);
+
+	local_irq_save(flags);
+	pcpu = this_cpu_ptr(&crng_percpu);
+
+	if (unlikely(pcpu->generation != READ_ONCE(crng_generation) ||
+		     time_after(jiffies, pcpu->init_time +
+				CRNG_RESEED_INTERVAL))) {
+		pcpu->generation = READ_ONCE(crng_generation);
+		pcpu->init_time = jiffies;
+		extract_crng(block);
+		memcpy(pcpu->key, block, CHACHA20_KEY_SIZE);
+		/* Keys already handed out must not be recoverable */
+		crng_backtrack_protect(block, CHACHA20_KEY_SIZE);
+		memzero_explicit(block, sizeof(block));
+	}
+
+	memcpy(&chacha_state[0], "expand 32-byte k", 16);
+	memcpy(&chacha_state[4], pcpu->key, CHACHA20_KEY_SIZE);
+	memset(&chacha_state[12], 0, sizeof(__u32) * 4);
+	chacha20_block(chacha_state, block);
+	memcpy(pcpu->key, block, CHACHA20_KEY_SIZE);
+	local_irq_restore(flags);
+
+	memcpy(out, block + CHACHA20_KEY_SIZE, len);
+	memzero_explicit(block, sizeof(block));
+}
+
+static void crng_next_block(__u32 chacha_state[16], __u8 *out)
+{
+	chacha20_block(chacha_state, out);
+	if (chacha_state[12] == 0)
+		chacha_state[13]++;
+}
+
+/*
+ * Fill @buf from the per-CPU crng. Requests up to 32 bytes cost a single
+ * ChaCha20 block and no shared lock.
+ */
+static void extract_crng_percpu(void *buf, size_t nbytes)
+{
+	__u32 chacha_state[16];
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	size_t len = min_t(size_t, nbytes,
+			   CHACHA20_BLOCK_SIZE - CHACHA20_KEY_SIZE);
+
+	crng_make_state(chacha_state, buf, len);
+	buf += len;
+	nbytes -= len;
+
+	while (nbytes >= CHACHA20_BLOCK_SIZE) {
+		crng_next_block(chacha_state, buf);
+		buf += CHACHA20_BLOCK_SIZE;
+		nbytes -= CHACHA20_BLOCK_SIZE;
+	}
+
+	if (nbytes > 0) {
+		crng_next_block(chacha_state, tmp);
+		memcpy(buf, tmp, nbytes);
+		memzero_explicit(tmp, sizeof(tmp));
+	}
+	memzero_explicit(chacha_state, sizeof(chacha_state));
+}
+
+static ssize_t extract_crng_user_percpu(void __user *buf, size_t nbytes)
+{
+	__u32 chacha_state[16];
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	ssize_t ret = 0, i;
+	int large_request = (nbytes > 256);
+
+	i = min_t(size_t, nbytes, CHACHA20_BLOCK_SIZE - CHACHA20_KEY_SIZE);
+	crng_make_state(chacha_state, tmp, i);
+	if (copy_to_user(buf, tmp, i)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	nbytes -= i;
+	buf += i;
+	ret += i;
+
+	while (nbytes) {
+		if (large_request && need_resched()) {
+			if (signal_pending(current))
+				break;
+			schedule();
+		}
+
+		crng_next_block(chacha_state, tmp);
+		i = min_t(size_t, nbytes, CHACHA20_BLOCK_SIZE);
+		if (copy_to_user(buf, tmp, i)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		nbytes -= i;
+		buf += i;
+		ret += i;
+	}
+
+out:
+	memzero_explicit(chacha_state, sizeof(chacha_state));
+	memzero_explicit(tmp, sizeof(tmp));
+
+	return ret;
+}
+
 static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 {
 	ssize_t ret = 0, i = CHACHA20_BLOCK_SIZE;
 	__u8 tmp[CHACHA20_BLOCK_SIZE];
 	int large_request = (nbytes > 256);
 
+	if (crng_init > 1)
+		return extract_crng_user_percpu(buf, nbytes);
+
 	while (nbytes) {
 		if (large_request && need_resched()) {
 			if (signal_pending(current)) {
@@ -1510,6 +1653,12 @@ void get_random_bytes(void *buf, int nbytes)
 #endif
 	trace_get_random_bytes(nbytes, _RET_IP_);
 
+	if (crng_init > 1) {
+		if (nbytes > 0)
+			extract_crng_percpu(buf, nbytes);
+		return;
+	}
+
 	while (nbytes >= CHACHA20_BLOCK_SIZE) {
 		extract_crng(buf);
 		buf += CHACHA20_BLOCK_SIZE;
@@ -2066,7 +2215,11 @@ unsigned long get_random_long(void)
 
 	batch = &get_cpu_var(batched_entropy_long);
 	if (batch->position % ARRAY_SIZE(batch->entropy_long) == 0) {
-		extract_crng((u8 *)batch->entropy_long);
+		if (crng_init > 1)
+			extract_crng_percpu(batch->entropy_long,
+					    sizeof(batch->entropy_long));
+		else
+			extract_crng((u8 *)batch->entropy_long);
 		batch->position = 0;
 	}
 	ret = batch->entropy_long[batch->position++];
@@ -2092,7 +2245,11 @@ unsigned int get_random_int(void)
 
 	batch = &get_cpu_var(batched_entropy_int);
 	if (batch->position % ARRAY_SIZE(batch->entropy_int) == 0) {
-		extract_crng((u8 *)batch->entropy_int);
+		if (crng_init > 1)
+			extract_crng_percpu(batch->entropy_int,
+					    sizeof(batch->entropy_int));
+		else
+			extract_crng((u8 *)batch->entropy_int);
 		batch->position = 0;
 	}
 	ret = batch->entropy_int[batch->position++];
@@ -0,0 +1,382 @@
+/*
+ * irqtimer.c - the timer and interrupt predicting idle governor
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/module.h>
+
+/*
+ * Concepts behind the irqtimer governor
+ *
+ * An idle period ends either with the next timer event, which is known
+ * exactly, or with an interrupt. Many interrupt sources on embedded and
+ * network-driven systems are periodic or close to it: WLAN beacons,
+ * link polling, UART bursts at a fixed baud rate. For those the time
+ * of the next arrival can be predicted from the previous ones.
+ *
+ * The governor keeps, for each CPU, a small table of the interrupt
+ * sources that were handled on it, with the time of the last arrival
+ * and a running average of the inter-arrival time. A source whose
+ * recent intervals stayed close to that average is considered
+ * predictable, and its next expected arrival competes with the next
+ * timer event for the end of the idle period.
+ *
+ * The prediction is then checked against the observed sleep length.
+ * When the CPU keeps being woken up well before the predicted time, by
+ * something neither the timers nor the table account for (IPIs, bursty
+ * sources), the prediction is capped by the recent length of those
+ * short sleeps until the pattern goes away.
+ */
+
+#define IRQT_SOURCES		8
+/* a source that has been quiet for that long is forgotten */
+#define IRQT_MAX_INTERVAL_US	USEC_PER_SEC
+/* intervals within 1/IRQT_JITTER_DIV of the average are regular */
+#define IRQT_JITTER_DIV		4
+#define IRQT_SCORE_MAX		8
+#define IRQT_SCORE_MIN		3
+/* number of early wakeups out of the last 8 to cap the prediction */
+#define IRQT_EARLY_MIN		5
+
+struct irqt_source {
+	unsigned int irq;
+	u64 last_ns;
+	unsigned int avg_us;
+	int score;
+};
+
+struct irqt_device {
+	struct irqt_source sources[IRQT_SOURCES];
+
+	int last_state_idx;
+	int needs_update;
+
+	unsigned int next_timer_us;
+	unsigned int predicted_us;
+	unsigned int early_us;
+	u8 early_history;
+
+	/* prediction statistics, see the debugfs file */
+	u64 hits;
+	u64 early;
+	u64 late;
+	u64 irq_predictions;
+};
+
+static DEFINE_PER_CPU(struct irqt_device, irqt_devices);
+
+DEFINE_STATIC_KEY_FALSE(cpuidle_irq_record_key);
+
+static inline unsigned int irqt_ns_to_us(u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	return min_t(u64, us, UINT_MAX);
+}
+
+/**
+ * __cpuidle_irq_record - records the arrival of an interrupt on this CPU
+ * @irq: the interrupt number
+ *
+ * Called from hard interrupt context by cpuidle_irq_record().
+ */
+void __cpuidle_irq_record(unsigned int irq)
+{
+	struct irqt_device *data = this_cpu_ptr(&irqt_devices);
+	struct irqt_source *s, *victim = NULL;
+	u64 now = local_clock();
+	unsigned int delta_us;
+	int i;
+
+	for (i = 0; i < IRQT_SOURCES; i++) {
+		s = &data->sources[i];
+		if (s->last_ns && s->irq == irq)
+			goto found;
+		if (!victim || s->last_ns < victim->last_ns)
+			victim = s;
+	}
+
+	/* replace the source that has been quiet for the longest time */
+	victim->irq = irq;
+	victim->last_ns = now;
+	victim->avg_us = 0;
+	victim->score = 0;
+	return;
+
+found:
+	delta_us = irqt_ns_to_us(now - s->last_ns);
+	s->last_ns = now;
+
+	if (delta_us > IRQT_MAX_INTERVAL_US) {
+		s->avg_us = 0;
+		s->score = 0;
+		return;
+	}
+
+	if (!s->avg_us) {
+		s->avg_us = delta_us;
+		return;
+	}
+
+	if (abs((int)delta_us - (int)s->avg_us) <= s->avg_us / IRQT_JITTER_DIV)
+		s->score = min(s->score + 1, IRQT_SCORE_MAX);
+	else
+		s->score = max(s->score - 2, 0);
+
+	s->avg_us = s->avg_us - s->avg_us / 4 + delta_us / 4;
+}
+
+/*
+ * Returns the time until the next expected arrival of a predictable
+ * interrupt, or UINT_MAX when there is none.
+ */
+static unsigned int irqt_next_irq_us(struct irqt_device *data)
+{
+	unsigned int next_us = UINT_MAX;
+	u64 now = local_clock();
+	int i;
+
+	for (i = 0; i < IRQT_SOURCES; i++) {
+		struct irqt_source *s = &data->sources[i];
+		unsigned int since_us, until_us;
+
+		if (!s->avg_us || s->score < IRQT_SCORE_MIN)
+			continue;
+
+		since_us = irqt_ns_to_us(now - s->last_ns);
+		if (since_us < s->avg_us)
+			until_us = s->avg_us - since_us;
+		else if (since_us < 2 * s->avg_us)
+			/* late, expect it within the jitter window */
+			until_us = s->avg_us / IRQT_JITTER_DIV;
+		else
+			/* the source has most likely stopped */
+			continue;
+
+		next_us = min(next_us, until_us);
+	}
+
+	return next_us;
+}
+
+static void irqt_update(struct cpuidle_driver *drv, struct cpuidle_device *dev);
+
+/**
+ * irqt_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int irqt_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct irqt_device *data = this_cpu_ptr(&irqt_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int irq_us;
+	int i;
+
+	if (data->needs_update) {
+		irqt_update(drv, dev);
+		data->needs_update = 0;
+	}
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	data->next_timer_us = ktime_to_us(tick_nohz_get_sleep_length());
+	data->predicted_us = data->next_timer_us;
+
+	irq_us = irqt_next_irq_us(data);
+	if (irq_us < data->predicted_us) {
+		data->predicted_us = irq_us;
+		data->irq_predictions++;
+	}
+
+	if (hweight8(data->early_history) >= IRQT_EARLY_MIN)
+		data->predicted_us = min(data->predicted_us, data->early_us);
+
+	if (CPUIDLE_DRIVER_STATE_START > 0) {
+		struct cpuidle_state *s = &drv->states[CPUIDLE_DRIVER_STATE_START];
+
+		/*
+		 * Default to C1 (hlt), not to busy polling, unless the
+		 * wakeup is expected really soon or C1's exit latency
+		 * exceeds the user configured limit.
+		 */
+		if (data->predicted_us > max_t(unsigned int, 20,
+					       s->target_residency) &&
+		    latency_req > s->exit_latency && !s->disabled &&
+		    !dev->states_usage[CPUIDLE_DRIVER_STATE_START].disable)
+			data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+		else
+			data->last_state_idx = CPUIDLE_DRIVER_STATE_START - 1;
+	} else {
+		data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+	}
+
+	/*
+	 * Find the idle state with the lowest power while satisfying
+	 * our constraints.
+	 */
+	for (i = data->last_state_idx + 1; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		if (s->disabled || su->disable)
+			continue;
+		if (s->target_residency > data->predicted_us)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+
+		data->last_state_idx = i;
+	}
+
+	return data->last_state_idx;
+}
+
+/**
+ * irqt_reflect - records that data structures need update
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ *
+ * NOTE: it's important to be fast here because this operation will add to
+ *       the overall exit latency.
+ */
+static void irqt_reflect(struct cpuidle_device *dev, int index)
+{
+	struct irqt_device *data = this_cpu_ptr(&irqt_devices);
+
+	data->last_state_idx = index;
+	data->needs_update = 1;
+}
+
+/**
+ * irqt_update - checks the last prediction against the observed sleep
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void irqt_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct irqt_device *data = this_cpu_ptr(&irqt_devices);
+	struct cpuidle_state *target;
+	unsigned int measured_us;
+	bool early = false;
+
+	if (data->last_state_idx < 0)
+		return;
+
+	target = &drv->states[data->last_state_idx];
+	measured_us = cpuidle_get_last_residency(dev);
+
+	/* Deduct exit latency, as the menu governor does */
+	if (measured_us > 2 * target->exit_latency)
+		measured_us -= target->exit_latency;
+	else
+		measured_us /= 2;
+
+	if (measured_us < data->predicted_us / 2) {
+		/* woken up by something we did not expect */
+		data->early++;
+		early = true;
+		if (data->early_us)
+			data->early_us = data->early_us -
+					 data->early_us / 4 + measured_us / 4;
+		else
+			data->early_us = measured_us;
+	} else if (measured_us > 2 * data->predicted_us &&
+		   data->predicted_us < data->next_timer_us) {
+		/* the expected interrupt did not come */
+		data->late++;
+	} else {
+		data->hits++;
+	}
+
+	data->early_history = (data->early_history << 1) | early;
+}
+
+/**
+ * irqt_enable_device - scans a CPU's states and does setup
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int irqt_enable_device(struct cpuidle_driver *drv,
+			      struct cpuidle_device *dev)
+{
+	struct irqt_device *data = &per_cpu(irqt_devices, dev->cpu);
+
+	memset(data, 0, sizeof(struct irqt_device));
+	data->last_state_idx = -1;
+
+	if (!static_key_enabled(&cpuidle_irq_record_key))
+		static_branch_enable(&cpuidle_irq_record_key);
+
+	return 0;
+}
+
+static struct cpuidle_governor irqt_governor = {
+	.name =		"irqtimer",
+	.rating =	10,
+	.enable =	irqt_enable_device,
+	.select =	irqt_select,
+	.reflect =	irqt_reflect,
+	.owner =	THIS_MODULE,
+};
+
+#ifdef CONFIG_DEBUG_FS
+static int irqt_stats_show(struct seq_file *m, void *unused)
+{
+	int cpu;
+
+	seq_puts(m, "cpu\thits\tearly\tlate\tirq_predictions\n");
+	for_each_online_cpu(cpu) {
+		struct irqt_device *data = &per_cpu(irqt_devices, cpu);
+
+		seq_printf(m, "%d\t%llu\t%llu\t%llu\t%llu\n", cpu,
+			   data->hits, data->early, data->late,
+			   data->irq_predictions);
+	}
+	return 0;
+}
+
+static int irqt_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irqt_stats_show, NULL);
+}
+
+static const struct file_operations irqt_stats_fops = {
+	.open		= irqt_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init irqt_debugfs_init(void)
+{
+	debugfs_create_file("cpuidle_irqtimer_stats", 0444, NULL, NULL,
+			    &irqt_stats_fops);
+	return 0;
+}
+late_initcall(irqt_debugfs_init);
+#endif
+
+/**
+ * init_irqt - initializes the governor
+ */
+static int __init init_irqt(void)
+{
+	return cpuidle_register_governor(&irqt_governor);
+}
+
+postcore_initcall(init_irqt);
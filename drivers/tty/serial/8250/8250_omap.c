@@ -109,7 +109,6 @@ struct omap8250_priv {
 	u32 latency;
 	u32 calc_latency;
 	struct pm_qos_request pm_qos_request;
-	struct work_struct qos_work;
 	struct uart_8250_dma omap8250_dma;
 	spinlock_t rx_dma_lock;
 	bool rx_dma_broken;
@@ -476,7 +475,7 @@ static void omap_8250_set_termios(struct uart_port *port,
 	priv->calc_latency = USEC_PER_SEC * 64 * 8 / baud;
 	priv->latency = priv->calc_latency;
 
-	schedule_work(&priv->qos_work);
+	pm_qos_update_request_atomic(&priv->pm_qos_request, priv->latency);
 
 	/* Don't rewrite B0 */
 	if (tty_termios_baud_rate(termios))
@@ -557,14 +556,6 @@ static void omap_serial_fill_features_erratas(struct uart_8250_port *up,
 	}
 }
 
-static void omap8250_uart_qos_work(struct work_struct *work)
-{
-	struct omap8250_priv *priv;
-
-	priv = container_of(work, struct omap8250_priv, qos_work);
-	pm_qos_update_request(&priv->pm_qos_request, priv->latency);
-}
-
 #ifdef CONFIG_SERIAL_8250_DMA
 static int omap_8250_dma_handle_irq(struct uart_port *port);
 #endif
@@ -660,9 +651,7 @@ static int omap_8250_startup(struct uart_port *port)
 static void omap_8250_shutdown(struct uart_port *port)
 {
 	struct uart_8250_port *up = up_to_u8250p(port);
-	struct omap8250_priv *priv = port->private_data;
 
-	flush_work(&priv->qos_work);
 	if (up->dma)
 		omap_8250_rx_dma_flush(up);
 
@@ -1233,7 +1222,6 @@ static int omap8250_probe(struct platform_device *pdev)
 	priv->calc_latency = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE;
 	pm_qos_add_request(&priv->pm_qos_request, PM_QOS_CPU_DMA_LATENCY,
 			   priv->latency);
-	INIT_WORK(&priv->qos_work, omap8250_uart_qos_work);
 
 	spin_lock_init(&priv->rx_dma_lock);
 
@@ -1342,7 +1330,6 @@ static int omap8250_suspend(struct device *dev)
 	pm_runtime_mark_last_busy(dev);
 	pm_runtime_put_autosuspend(dev);
 
-	flush_work(&priv->qos_work);
 	return 0;
 }
 
@@ -1443,7 +1430,7 @@ static int omap8250_runtime_suspend(struct device *dev)
 		omap_8250_rx_dma_flush(up);
 
 	priv->latency = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE;
-	schedule_work(&priv->qos_work);
+	pm_qos_update_request_atomic(&priv->pm_qos_request, priv->latency);
 
 	return 0;
 }
@@ -1466,7 +1453,7 @@ static int omap8250_runtime_resume(struct device *dev)
 		omap_8250_rx_dma(up);
 
 	priv->latency = priv->calc_latency;
-	schedule_work(&priv->qos_work);
+	pm_qos_update_request_atomic(&priv->pm_qos_request, priv->latency);
 	return 0;
 }
 #endif
@@ -115,6 +115,9 @@ struct aead_request {
  * @setkey: see struct skcipher_alg
  * @encrypt: see struct skcipher_alg
  * @decrypt: see struct skcipher_alg
+ * @encrypt_batch: Encrypt a vector of requests for this transformation in
+ *		   one go, storing the result of each as @encrypt would
+ *		   return it. Optional, see crypto_aead_encrypt_batch().
  * @geniv: see struct skcipher_alg
  * @ivsize: see struct skcipher_alg
  * @chunksize: see struct skcipher_alg
@@ -131,7 +134,8 @@ struct aead_request {
  *	  @init.
  * @base: Definition of a generic crypto cipher algorithm.
  *
- * All fields except @ivsize is mandatory and must be filled.
+ * All fields except @ivsize and @encrypt_batch are mandatory and must be
+ * filled.
  */
 struct aead_alg {
 	int (*setkey)(struct crypto_aead *tfm, const u8 *key,
@@ -139,6 +143,8 @@ struct aead_alg {
 	int (*setauthsize)(struct crypto_aead *tfm, unsigned int authsize);
 	int (*encrypt)(struct aead_request *req);
 	int (*decrypt)(struct aead_request *req);
+	void (*encrypt_batch)(struct aead_request **reqs, int *errs,
+			      unsigned int nr);
 	int (*init)(struct crypto_aead *tfm);
 	void (*exit)(struct crypto_aead *tfm);
 
@@ -330,6 +336,21 @@ static inline int crypto_aead_encrypt(struct aead_request *req)
 	return crypto_aead_alg(crypto_aead_reqtfm(req))->encrypt(req);
 }
 
+/**
+ * crypto_aead_encrypt_batch() - encrypt a vector of plaintexts
+ * @reqs: requests to encrypt, all for the same transformation
+ * @errs: result of each request
+ * @nr: number of requests
+ *
+ * Submits the requests together to transformations which implement
+ * encrypt_batch and one by one with crypto_aead_encrypt() to all others.
+ * The result of each request is what crypto_aead_encrypt() would return
+ * for it; requests that return -EINPROGRESS complete through their
+ * callback.
+ */
+void crypto_aead_encrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr);
+
 /**
  * crypto_aead_decrypt() - decrypt ciphertext
  * @req: reference to the ablkcipher_request handle that holds all information
@@ -16,10 +16,34 @@
 #include <linux/list.h>
 #include <linux/kernel.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <crypto/algapi.h>
 #include <crypto/hash.h>
 
 #define ENGINE_NAME_LEN	30
+
+/*
+ * struct crypto_engine_stats - crypto engine statistics
+ * @requests: requests completed
+ * @bytes: bytes processed by the completed requests
+ * @errors: requests completed with an error
+ * @batches: hardware submissions
+ * @max_batch: largest number of requests in one submission
+ * @max_qlen: highest number of queued requests seen
+ * @latency_total_ns: sum of the submission to completion times
+ * @latency_max_ns: highest submission to completion time
+ */
+struct crypto_engine_stats {
+	u64			requests;
+	u64			bytes;
+	u64			errors;
+	u64			batches;
+	unsigned int		max_batch;
+	unsigned int		max_qlen;
+	u64			latency_total_ns;
+	u64			latency_max_ns;
+};
+
 /*
  * struct crypto_engine - crypto hardware engine
  * @name: the engine name
@@ -43,11 +67,20 @@
  * @prepare_hash_request: do some prepare if need before handle the current request
  * @unprepare_hash_request: undo any work done by prepare_hash_request()
  * @hash_one_request: do hash for current request
+ * @do_batch: if set, up to @max_batch requests are passed to the
+ * *_one_request() callbacks, which only queue them to the hardware, and
+ * this is then called once to execute all of them
+ * @max_batch: maximum number of requests per call to @do_batch
  * @kworker: thread struct for request pump
  * @kworker_task: pointer to task for request pump kworker thread
  * @pump_requests: work struct for scheduling work to the request pump
  * @priv_data: the engine private data
  * @cur_req: the current request which is on processing
+ * @inflight: number of requests of the current batch not finalized yet
+ * @last_tfm: transform of the request dequeued last
+ * @submit_time: time the current request or batch was dequeued
+ * @stats: engine statistics, protected by @queue_lock
+ * @debugfs: debugfs directory of the engine
  */
 struct crypto_engine {
 	char			name[ENGINE_NAME_LEN];
@@ -77,6 +110,8 @@ struct crypto_engine {
 				  struct ablkcipher_request *req);
 	int (*hash_one_request)(struct crypto_engine *engine,
 				struct ahash_request *req);
+	int (*do_batch)(struct crypto_engine *engine);
+	unsigned int		max_batch;
 
 	struct kthread_worker           kworker;
 	struct task_struct              *kworker_task;
@@ -84,6 +119,11 @@ struct crypto_engine {
 
 	void				*priv_data;
 	struct crypto_async_request	*cur_req;
+	unsigned int			inflight;
+	struct crypto_tfm		*last_tfm;
+	ktime_t				submit_time;
+	struct crypto_engine_stats	stats;
+	struct dentry			*debugfs;
 };
 
 int crypto_transfer_cipher_request(struct crypto_engine *engine,
@@ -312,6 +312,17 @@ static inline struct bpf_prog *bpf_prog_inc(struct bpf_prog *prog)
 }
 #endif /* CONFIG_BPF_SYSCALL */
 
+#ifdef CONFIG_BPF_STREAM_PARSER
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type);
+#else
+static inline int sock_map_prog(struct bpf_map *map,
+				struct bpf_prog *prog,
+				u32 type)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 /* verifier prototypes for helper functions called from eBPF programs */
 extern const struct bpf_func_proto bpf_map_lookup_elem_proto;
 extern const struct bpf_func_proto bpf_map_update_elem_proto;
@@ -14,6 +14,7 @@
 #include <linux/percpu.h>
 #include <linux/list.h>
 #include <linux/hrtimer.h>
+#include <linux/jump_label.h>
 
 #define CPUIDLE_STATE_MAX	10
 #define CPUIDLE_NAME_LEN	16
@@ -246,6 +247,19 @@ static inline int cpuidle_register_governor(struct cpuidle_governor *gov)
 {return 0;}
 #endif
 
+#ifdef CONFIG_CPU_IDLE_GOV_IRQTIMER
+DECLARE_STATIC_KEY_FALSE(cpuidle_irq_record_key);
+extern void __cpuidle_irq_record(unsigned int irq);
+
+static inline void cpuidle_irq_record(unsigned int irq)
+{
+	if (static_branch_unlikely(&cpuidle_irq_record_key))
+		__cpuidle_irq_record(irq);
+}
+#else
+static inline void cpuidle_irq_record(unsigned int irq) { }
+#endif
+
 #ifdef CONFIG_ARCH_HAS_CPU_RELAX
 #define CPUIDLE_DRIVER_STATE_START	1
 #else
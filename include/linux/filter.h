@@ -498,6 +498,53 @@ static inline u32 bpf_prog_run_clear_cb(const struct bpf_prog *prog,
 	return BPF_PROG_RUN(prog, skb);
 }
 
+/* sk_skb programs run on skbs handed out by a strparser, which keeps
+ * its own state at the start of the qdisc_skb_cb data area. The window
+ * of the current message and the redirect target selected by the
+ * program are therefore kept at the end of skb->cb.
+ */
+struct sk_skb_cb {
+	u32 off;
+	u32 len;
+	u32 key;
+	struct bpf_map *map;
+};
+
+static inline struct sk_skb_cb *sk_skb_cb(const struct sk_buff *skb)
+{
+	BUILD_BUG_ON(offsetof(struct qdisc_skb_cb, data) + 16 >
+		     FIELD_SIZEOF(struct sk_buff, cb) -
+		     sizeof(struct sk_skb_cb));
+
+	return (struct sk_skb_cb *)((void *)skb->cb +
+				    FIELD_SIZEOF(struct sk_buff, cb) -
+				    sizeof(struct sk_skb_cb));
+}
+
+/* Context of BPF_PROG_TYPE_CGROUP_SOCK_ADDR programs, @uaddr points
+ * to the kernel copy of the address passed to bind()/connect().
+ */
+struct bpf_sock_addr_kern {
+	struct sock *sk;
+	struct sockaddr *uaddr;
+	/* Spill slot for convert_ctx_access(): a store into *uaddr needs
+	 * a third register besides src and dst.
+	 */
+	u64 tmp_reg;
+};
+
+/* Context of BPF_PROG_TYPE_SOCK_OPS programs, @sk may be a request
+ * sock for ops run before the connection is established.
+ */
+struct bpf_sock_ops_kern {
+	struct	sock *sk;
+	u32	op;
+	union {
+		u32 reply;
+		u32 replylong[4];
+	};
+};
+
 static inline u32 bpf_prog_run_xdp(const struct bpf_prog *prog,
 				   struct xdp_buff *xdp)
 {
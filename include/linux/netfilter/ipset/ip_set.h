@@ -15,10 +15,12 @@
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/x_tables.h>
+#include <linux/percpu.h>
 #include <linux/stringify.h>
 #include <linux/vmalloc.h>
 #include <net/netlink.h>
 #include <uapi/linux/netfilter/ipset/ip_set.h>
+#include <asm/local64.h>
 
 #define _IP_SET_MODULE_DESC(a, b, c)		\
 	MODULE_DESCRIPTION(a " type of IP sets, revisions " b "-" c)
@@ -70,6 +72,13 @@ enum ip_set_extension {
 #define SET_WITH_SKBINFO(s)	((s)->extensions & IPSET_EXT_SKBINFO)
 #define SET_WITH_FORCEADD(s)	((s)->flags & IPSET_CREATE_FLAG_FORCEADD)
 
+/* Kernel internal command flag, never accepted from userspace:
+ * the add is called under rcu_read_lock_bh() without the set lock and
+ * may only refresh an existing element. -ENOENT asks for a locked retry.
+ */
+#define IPSET_FLAG_BIT_UNLOCKED	IPSET_FLAG_CMD_MAX
+#define IPSET_FLAG_UNLOCKED	(1 << IPSET_FLAG_BIT_UNLOCKED)
+
 /* Extension id, in size order */
 enum ip_set_ext_id {
 	IPSET_EXT_ID_COUNTER = 0,
@@ -103,8 +112,19 @@ struct ip_set_ext {
 	char *comment;
 };
 
+struct ip_set_counter_pcpu {
+	local64_t bytes;
+	local64_t packets;
+};
+
+struct ip_set_counter_rcu {
+	struct rcu_head rcu;
+	struct ip_set_counter_pcpu __percpu *pcpu;
+};
+
 struct ip_set_counter {
-	atomic64_t bytes;
+	struct ip_set_counter_rcu __rcu *c;
+	atomic64_t bytes;	/* base added to the per-CPU sums */
 	atomic64_t packets;
 };
 
@@ -167,6 +187,9 @@ struct ip_set_type_variant {
 
 	/* Low level add/del/test functions */
 	ipset_adtfn adt[IPSET_ADT_MAX];
+	/* Kernelspace add may look up an existing element without the
+	 * set lock first, see IPSET_FLAG_UNLOCKED */
+	bool unlocked_add;
 
 	/* When adding entries and set is full, try to resize the set */
 	int (*resize)(struct ip_set *set, bool retried);
@@ -266,6 +289,9 @@ ip_set_ext_destroy(struct ip_set *set, void *data)
 	/* Check that the extension is enabled for the set and
 	 * call it's destroy function for its extension part in data.
 	 */
+	if (SET_WITH_COUNTER(set))
+		ip_set_extensions[IPSET_EXT_ID_COUNTER].destroy(
+			ext_counter(data, set));
 	if (SET_WITH_COMMENT(set))
 		ip_set_extensions[IPSET_EXT_ID_COMMENT].destroy(
 			ext_comment(data, set));
@@ -294,28 +320,92 @@ ip_set_put_flags(struct sk_buff *skb, struct ip_set *set)
 	return nla_put_net32(skb, IPSET_ATTR_CADT_FLAGS, htonl(cadt_flags));
 }
 
+/* Counters are per-CPU and summed up when read. The per-CPU part is
+ * allocated with the element and referenced under rcu_read_lock_bh() from
+ * the packet path and with the set lock held otherwise.
+ */
+static inline struct ip_set_counter_rcu *
+ip_set_counter_deref(const struct ip_set_counter *counter)
+{
+	return rcu_dereference_raw(counter->c);
+}
+
 static inline void
 ip_set_add_bytes(u64 bytes, struct ip_set_counter *counter)
 {
-	atomic64_add((long long)bytes, &(counter)->bytes);
+	struct ip_set_counter_rcu *c = ip_set_counter_deref(counter);
+
+	if (likely(c))
+		local64_add(bytes, &this_cpu_ptr(c->pcpu)->bytes);
 }
 
 static inline void
 ip_set_add_packets(u64 packets, struct ip_set_counter *counter)
 {
-	atomic64_add((long long)packets, &(counter)->packets);
+	struct ip_set_counter_rcu *c = ip_set_counter_deref(counter);
+
+	if (likely(c))
+		local64_add(packets, &this_cpu_ptr(c->pcpu)->packets);
+}
+
+static inline u64
+ip_set_sum_bytes(const struct ip_set_counter *counter)
+{
+	struct ip_set_counter_rcu *c = ip_set_counter_deref(counter);
+	u64 bytes = 0;
+	int cpu;
+
+	if (unlikely(!c))
+		return 0;
+	for_each_possible_cpu(cpu)
+		bytes += local64_read(&per_cpu_ptr(c->pcpu, cpu)->bytes);
+	return bytes;
+}
+
+static inline u64
+ip_set_sum_packets(const struct ip_set_counter *counter)
+{
+	struct ip_set_counter_rcu *c = ip_set_counter_deref(counter);
+	u64 packets = 0;
+	int cpu;
+
+	if (unlikely(!c))
+		return 0;
+	for_each_possible_cpu(cpu)
+		packets += local64_read(&per_cpu_ptr(c->pcpu, cpu)->packets);
+	return packets;
 }
 
 static inline u64
 ip_set_get_bytes(const struct ip_set_counter *counter)
 {
-	return (u64)atomic64_read(&(counter)->bytes);
+	return (u64)atomic64_read(&counter->bytes) +
+	       ip_set_sum_bytes(counter);
 }
 
 static inline u64
 ip_set_get_packets(const struct ip_set_counter *counter)
 {
-	return (u64)atomic64_read(&(counter)->packets);
+	return (u64)atomic64_read(&counter->packets) +
+	       ip_set_sum_packets(counter);
+}
+
+/* The per-CPU counters are only ever added to by their own CPU, so a new
+ * value is set by moving the base instead. It needs no lock: packets
+ * counted while the value is set end up on top of it.
+ */
+static inline void
+ip_set_init_counter(struct ip_set_counter *counter,
+		    const struct ip_set_ext *ext)
+{
+	if (ext->bytes != ULLONG_MAX)
+		atomic64_set(&counter->bytes,
+			     (long long)(ext->bytes -
+					 ip_set_sum_bytes(counter)));
+	if (ext->packets != ULLONG_MAX)
+		atomic64_set(&counter->packets,
+			     (long long)(ext->packets -
+					 ip_set_sum_packets(counter)));
 }
 
 static inline void
@@ -382,15 +472,8 @@ ip_set_put_counter(struct sk_buff *skb, struct ip_set_counter *counter)
 			     IPSET_ATTR_PAD);
 }
 
-static inline void
-ip_set_init_counter(struct ip_set_counter *counter,
-		    const struct ip_set_ext *ext)
-{
-	if (ext->bytes != ULLONG_MAX)
-		atomic64_set(&(counter)->bytes, (long long)(ext->bytes));
-	if (ext->packets != ULLONG_MAX)
-		atomic64_set(&(counter)->packets, (long long)(ext->packets));
-}
+extern int ip_set_alloc_counter(struct ip_set_counter *counter);
+extern void ip_set_counter_free(struct ip_set_counter *counter);
 
 /* Netlink CB args */
 enum {
@@ -2,6 +2,7 @@
 #define _NET_IPCOMP_H
 
 #include <linux/types.h>
+#include <linux/atomic.h>
 
 #define IPCOMP_SCRATCH_SIZE     65400
 
@@ -10,6 +11,8 @@ struct crypto_comp;
 struct ipcomp_data {
 	u16 threshold;
 	struct crypto_comp * __percpu *tfms;
+	atomic_t skip;		/* packets to send uncompressed */
+	atomic_t backoff;	/* skip after the next incompressible one */
 };
 
 struct ip_comp_hdr;
@@ -246,6 +246,9 @@ struct nft_expr;
  *	@deactivate: deactivate element in the next generation
  *	@remove: remove element from set
  *	@walk: iterate over all set elemeennts
+ *	@commit_prepare: prepare the next generation of a set whose elements
+ *			 changed, before that generation becomes current
+ *	@commit: update the set once the new generation is current
  *	@privsize: function to return size of set private data
  *	@init: initialize private data of new set instance
  *	@destroy: destroy private data of set instance
@@ -283,6 +286,10 @@ struct nft_set_ops {
 	void				(*walk)(const struct nft_ctx *ctx,
 						const struct nft_set *set,
 						struct nft_set_iter *iter);
+	void				(*commit_prepare)(const struct net *net,
+							  const struct nft_set *set);
+	void				(*commit)(const struct net *net,
+						  const struct nft_set *set);
 
 	unsigned int			(*privsize)(const struct nlattr * const nla[]);
 	bool				(*estimate)(const struct nft_set_desc *desc,
@@ -307,6 +314,7 @@ void nft_unregister_set(struct nft_set_ops *ops);
  *
  *	@list: table set list node
  *	@bindings: list of set bindings
+ *	@pending_update: list node of sets to update on commit
  * 	@name: name of the set
  * 	@ktype: key type (numeric type defined by userspace, not used in the kernel)
  * 	@dtype: data type (verdict or numeric type defined by userspace)
@@ -328,6 +336,7 @@ void nft_unregister_set(struct nft_set_ops *ops);
 struct nft_set {
 	struct list_head		list;
 	struct list_head		bindings;
+	struct list_head		pending_update;
 	char				name[NFT_SET_MAXNAMELEN];
 	u32				ktype;
 	u32				dtype;
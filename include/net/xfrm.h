@@ -371,6 +371,11 @@ struct xfrm_type {
 	void			(*destructor)(struct xfrm_state *);
 	int			(*input)(struct xfrm_state *, struct sk_buff *skb);
 	int			(*output)(struct xfrm_state *, struct sk_buff *pskb);
+	/* Like output for up to XFRM_OUTPUT_BATCH skbs, optional */
+	void			(*output_batch)(struct xfrm_state *,
+						struct sk_buff **skbs,
+						int *errs, unsigned int nr);
+#define XFRM_OUTPUT_BATCH	16
 	int			(*reject)(struct xfrm_state *, struct sk_buff *,
 					  const struct flowi *);
 	int			(*hdr_offset)(struct xfrm_state *, struct sk_buff *, u8 **);
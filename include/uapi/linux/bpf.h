@@ -73,6 +73,8 @@ enum bpf_cmd {
 	BPF_PROG_LOAD,
 	BPF_OBJ_PIN,
 	BPF_OBJ_GET,
+	BPF_PROG_ATTACH,
+	BPF_PROG_DETACH,
 };
 
 enum bpf_map_type {
@@ -85,6 +87,10 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_PERCPU_ARRAY,
 	BPF_MAP_TYPE_STACK_TRACE,
 	BPF_MAP_TYPE_CGROUP_ARRAY,
+	BPF_MAP_TYPE_LRU_HASH,
+	BPF_MAP_TYPE_LRU_PERCPU_HASH,
+	/* Numbered as upstream, the gaps are types not supported here */
+	BPF_MAP_TYPE_SOCKMAP = 15,
 };
 
 enum bpf_prog_type {
@@ -96,8 +102,34 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_TRACEPOINT,
 	BPF_PROG_TYPE_XDP,
 	BPF_PROG_TYPE_PERF_EVENT,
+	/* Numbered as upstream, the gaps are types not supported here */
+	BPF_PROG_TYPE_CGROUP_SOCK = 9,
+	BPF_PROG_TYPE_SOCK_OPS = 13,
+	BPF_PROG_TYPE_SK_SKB,
+	BPF_PROG_TYPE_CGROUP_SOCK_ADDR = 18,
 };
 
+/* Numbered as upstream, the gaps are types not supported here */
+enum bpf_attach_type {
+	BPF_CGROUP_INET_SOCK_CREATE = 2,
+	BPF_CGROUP_SOCK_OPS,
+	BPF_SK_SKB_STREAM_PARSER,
+	BPF_SK_SKB_STREAM_VERDICT,
+	BPF_CGROUP_INET4_BIND = 8,
+	BPF_CGROUP_INET6_BIND,
+	BPF_CGROUP_INET4_CONNECT,
+	BPF_CGROUP_INET6_CONNECT,
+	__MAX_BPF_ATTACH_TYPE
+};
+
+#define MAX_BPF_ATTACH_TYPE __MAX_BPF_ATTACH_TYPE
+
+/* If BPF_F_ALLOW_OVERRIDE flag is used in BPF_PROG_ATTACH command
+ * to the given target_fd cgroup the descendent cgroup will be able to
+ * override effective bpf program that was inherited from this cgroup
+ */
+#define BPF_F_ALLOW_OVERRIDE	(1U << 0)
+
 #define BPF_PSEUDO_MAP_FD	1
 
 /* flags for BPF_MAP_UPDATE_ELEM command */
@@ -106,6 +138,13 @@ enum bpf_prog_type {
 #define BPF_EXIST	2 /* update existing element */
 
 #define BPF_F_NO_PREALLOC	(1U << 0)
+/* Instead of having one common LRU list in the
+ * BPF_MAP_TYPE_LRU_[PERCPU_]HASH map, use a percpu LRU list
+ * which can scale and perform better.
+ * Note, the LRU nodes (including free nodes) cannot be moved
+ * across different LRU lists.
+ */
+#define BPF_F_NO_COMMON_LRU	(1U << 1)
 
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
@@ -141,6 +180,13 @@ union bpf_attr {
 		__aligned_u64	pathname;
 		__u32		bpf_fd;
 	};
+
+	struct { /* anonymous struct used by BPF_PROG_ATTACH/DETACH commands */
+		__u32		target_fd;	/* container object to attach to */
+		__u32		attach_bpf_fd;	/* eBPF program to attach */
+		__u32		attach_type;
+		__u32		attach_flags;
+	};
 } __attribute__((aligned(8)));
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -426,6 +472,34 @@ enum bpf_func_id {
 	 */
 	BPF_FUNC_set_hash_invalid,
 
+	/* Numbered as upstream, the gaps are helpers not supported here */
+
+	/**
+	 * bpf_setsockopt(bpf_socket, level, optname, optval, optlen)
+	 * Calls setsockopt on the socket of a sock_ops program. Supports
+	 * a subset of SOL_SOCKET options and, for TCP, TCP_CONGESTION,
+	 * TCP_BPF_IW and TCP_BPF_SNDCWND_CLAMP.
+	 * @bpf_socket: pointer to bpf_sock_ops
+	 * @level: SOL_SOCKET or SOL_TCP
+	 * @optname: option name
+	 * @optval: pointer to option value
+	 * @optlen: length of optval in bytes
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_setsockopt = 49,
+
+	/**
+	 * bpf_sk_redirect_map(skb, map, key, flags)
+	 * Redirect skb to a sock in map using key as a lookup key for the
+	 * sock in map.
+	 * @skb: pointer to skb
+	 * @map: pointer to sockmap
+	 * @key: key to lookup sock in map
+	 * @flags: reserved, must be zero
+	 * Return: SK_PASS on success, SK_DROP on error
+	 */
+	BPF_FUNC_sk_redirect_map = 52,
+
 	__BPF_FUNC_MAX_ID,
 };
 
@@ -513,6 +587,99 @@ enum xdp_action {
 	XDP_TX,
 };
 
+/* User return codes for SK_SKB verdict programs. SK_PASS after a
+ * successful bpf_sk_redirect_map() transmits the message on the selected
+ * sock. Any other return value drops the message.
+ */
+enum sk_action {
+	SK_DROP = 0,
+	SK_PASS,
+};
+
+/* user accessible mirror of in-kernel sock, seen by
+ * BPF_PROG_TYPE_CGROUP_SOCK programs at socket creation.
+ * bound_dev_if, mark and priority can be written, a return value
+ * of 0 rejects the socket with -EPERM.
+ */
+struct bpf_sock {
+	__u32 bound_dev_if;
+	__u32 family;
+	__u32 type;
+	__u32 protocol;
+	__u32 mark;
+	__u32 priority;
+};
+
+/* User bpf_sock_addr struct to access socket fields and sockaddr struct
+ * passed by user and intended to be used by socket (e.g. to bind to,
+ * depends on attach type). A return value of 0 rejects the call
+ * with -EPERM.
+ */
+struct bpf_sock_addr {
+	__u32 user_family;	/* Allows 4-byte read, but no write. */
+	__u32 user_ip4;		/* Allows 4-byte read and write.
+				 * Stored in network byte order.
+				 */
+	__u32 user_ip6[4];	/* Allows 4-byte read and write.
+				 * Stored in network byte order.
+				 */
+	__u32 user_port;	/* Allows 4-byte read and write.
+				 * Stored in network byte order.
+				 */
+	__u32 family;		/* Allows 4-byte read, but no write */
+	__u32 type;		/* Allows 4-byte read, but no write */
+	__u32 protocol;		/* Allows 4-byte read, but no write */
+};
+
+/* User bpf_sock_ops struct to access socket values and specify request ops
+ * and their replies.
+ * Some of these fields are in network (big endian) byte order and may
+ * need to be converted before use.
+ * New fields can only be added at the end of this structure
+ */
+struct bpf_sock_ops {
+	__u32 op;
+	union {
+		__u32 reply;
+		__u32 replylong[4];
+	};
+	__u32 family;
+	__u32 remote_ip4;	/* Stored in network byte order */
+	__u32 local_ip4;	/* Stored in network byte order */
+	__u32 remote_ip6[4];	/* Stored in network byte order */
+	__u32 local_ip6[4];	/* Stored in network byte order */
+	__u32 remote_port;	/* Stored in network byte order */
+	__u32 local_port;	/* stored in host byte order */
+};
+
+/* List of known BPF sock_ops operators.
+ * New entries can only be added at the end
+ */
+enum {
+	BPF_SOCK_OPS_VOID,
+	BPF_SOCK_OPS_TIMEOUT_INIT,	/* Should return SYN-RTO value to use or
+					 * -1 if default value should be used
+					 */
+	BPF_SOCK_OPS_RWND_INIT,		/* Should return initial advertized
+					 * window (in packets) or -1 if default
+					 * value should be used
+					 */
+	BPF_SOCK_OPS_TCP_CONNECT_CB,	/* Calls BPF program right before an
+					 * active connection is initialized
+					 */
+	BPF_SOCK_OPS_ACTIVE_ESTABLISHED_CB,	/* Calls BPF program when an
+						 * active connection is
+						 * established
+						 */
+	BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB,	/* Calls BPF program when a
+						 * passive connection is
+						 * established
+						 */
+};
+
+#define TCP_BPF_IW		1001	/* Set TCP initial congestion window */
+#define TCP_BPF_SNDCWND_CLAMP	1002	/* Set sndcwnd_clamp */
+
 /* user accessible metadata for XDP packet hook
  * new fields must be added to the end of this structure
  */
@@ -2,6 +2,8 @@
 #define _NFNETLINK_QUEUE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
+#include <linux/kernel.h>
 #include <linux/netfilter/nfnetlink.h>
 
 enum nfqnl_msg_types {
@@ -124,4 +126,56 @@ enum nfqnl_attr_config {
 /* csum not validated (incoming device doesn't support hw checksum, etc.) */
 #define NFQA_SKB_CSUM_NOTVERIFIED (1 << 2)
 
+/* Memory mapped packet ring, set up on /dev/nfqueue for a bound queue.
+ *
+ * The ring is frame_nr frames of frame_size bytes each. A frame starts
+ * with struct nfqnl_ring_frame, the packet data follows at offset
+ * NFQNL_RING_HDRLEN. The kernel fills frames in ring order and hands them
+ * over with status NFQNL_RING_USER. Userspace stores the verdict, sets
+ * the status to NFQNL_RING_VERDICT, and has all pending verdicts applied
+ * at once by NFQNL_RING_IOC_VERDICT. Fields are in host byte order.
+ * Conntrack, bridge, uid/gid and security context information is only
+ * sent in netlink messages; netlink verdicts by packet id still work
+ * and give the frame of the packet back to the kernel, which may reuse it
+ * right away.
+ */
+enum nfqnl_ring_status {
+	NFQNL_RING_UNUSED,		/* owned by the kernel */
+	NFQNL_RING_USER,		/* packet for userspace */
+	NFQNL_RING_VERDICT,		/* verdict for the kernel */
+};
+
+struct nfqnl_ring_frame {
+	__u32	status;			/* enum nfqnl_ring_status */
+	__u32	packet_id;
+	__u32	len;			/* length of the packet */
+	__u32	cap_len;		/* bytes of it in the frame */
+	__u32	mark;			/* nfmark, new one on verdict */
+	__u32	indev;			/* ifindex or 0 */
+	__u32	outdev;			/* ifindex or 0 */
+	__u32	skbinfo;		/* NFQA_SKB_* flags */
+	__u32	verdict;
+	__be16	hw_protocol;
+	__u8	hook;
+	__u8	flags;			/* NFQNL_RING_F_* */
+};
+
+/* Set the packet mark from the frame along with the verdict */
+#define NFQNL_RING_F_MARK		(1 << 0)
+
+#define NFQNL_RING_ALIGNMENT		16
+#define NFQNL_RING_ALIGN(len)	__ALIGN_KERNEL(len, NFQNL_RING_ALIGNMENT)
+#define NFQNL_RING_HDRLEN		\
+	NFQNL_RING_ALIGN(sizeof(struct nfqnl_ring_frame))
+
+struct nfqnl_ring_req {
+	__u16	queue_num;
+	__u16	_pad;
+	__u32	frame_size;		/* multiple of NFQNL_RING_ALIGNMENT */
+	__u32	frame_nr;
+};
+
+#define NFQNL_RING_IOC_SETUP		_IOW('Q', 0x80, struct nfqnl_ring_req)
+#define NFQNL_RING_IOC_VERDICT		_IO('Q', 0x81)
+
 #endif /* _NFNETLINK_QUEUE_H */
@@ -316,6 +316,8 @@ enum
 	LINUX_MIB_XFRMFWDHDRERROR,		/* XfrmFwdHdrError*/
 	LINUX_MIB_XFRMOUTSTATEINVALID,		/* XfrmOutStateInvalid */
 	LINUX_MIB_XFRMACQUIREERROR,		/* XfrmAcquireError */
+	LINUX_MIB_XFRMFLOWCACHEHIT,		/* XfrmFlowCacheHit */
+	LINUX_MIB_XFRMFLOWCACHEMISS,		/* XfrmFlowCacheMiss */
 	__LINUX_MIB_XFRMMAX
 };
 
@@ -0,0 +1,715 @@
+/* Copyright (c) 2017 Covalent IO, Inc. http://covalent.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* A BPF sock_map is used to store sock objects. This is primarly used
+ * for doing socket redirect with BPF helper routines.
+ *
+ * A sock map may have two BPF programs attached to it, a program used
+ * to parse packets and a program to provide a verdict and redirect
+ * decision on the packet. The parse program is attached to strparser
+ * and used to build messages that may span multiple skbs. The verdict
+ * program will either select a socket to send the message on or
+ * provide the drop code indicating the message should be dropped.
+ * Socks added while either program is missing only serve as redirect
+ * targets. Programs are picked up when a sock is added to the map.
+ *
+ * The map holds a reference on the socket file, like a KCM attach does,
+ * so a socket stays alive until it is deleted from the map, the map is
+ * freed or the connection is closed by the peer. A socket can only be
+ * a member of one sock map slot at a time.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/file.h>
+#include <linux/net.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <net/strparser.h>
+#include <net/tcp.h>
+
+struct bpf_stab {
+	struct bpf_map map;
+	struct sock **sock_map;
+	struct bpf_prog *bpf_parse;
+	struct bpf_prog *bpf_verdict;
+	/* serializes slot updates and program attach against each other */
+	spinlock_t lock;
+};
+
+enum smap_psock_state {
+	SMAP_TX_RUNNING,
+};
+
+struct smap_psock {
+	struct rcu_head	rcu;
+
+	/* datapath variables */
+	struct sk_buff_head rxqueue;
+	bool strp_enabled;
+
+	/* datapath error path cache across tx work invocations */
+	int save_rem;
+	int save_off;
+	struct sk_buff *save_skb;
+
+	struct strparser strp;
+	struct bpf_prog *bpf_parse;
+	struct bpf_prog *bpf_verdict;
+	struct bpf_stab *stab;
+	u32 key;
+
+	struct socket *sock;
+	unsigned long state;
+
+	struct work_struct tx_work;
+	struct work_struct gc_work;
+
+	void (*save_data_ready)(struct sock *sk);
+	void (*save_write_space)(struct sock *sk);
+	void (*save_state_change)(struct sock *sk);
+};
+
+/* Must be called with sk->sk_callback_lock held */
+static inline struct smap_psock *smap_psock_sk(const struct sock *sk)
+{
+	return sk->sk_user_data;
+}
+
+static void smap_write_space(struct sock *sk);
+
+static void smap_report_sk_error(struct smap_psock *psock, int err)
+{
+	struct sock *sk = psock->sock->sk;
+
+	sk->sk_err = err;
+	sk->sk_error_report(sk);
+}
+
+static void smap_release_sock(struct sock *sk);
+
+static void smap_state_change(struct sock *sk)
+{
+	void (*state_change)(struct sock *sk);
+	struct smap_psock *psock;
+	struct bpf_stab *stab;
+	u32 key;
+
+	rcu_read_lock();
+	read_lock_bh(&sk->sk_callback_lock);
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock)) {
+		read_unlock_bh(&sk->sk_callback_lock);
+		rcu_read_unlock();
+		sk->sk_state_change(sk);
+		return;
+	}
+
+	state_change = psock->save_state_change;
+	stab = psock->stab;
+	key = psock->key;
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	/* Once the connection is gone the sock is dropped from the map
+	 * so that the reference the map holds does not linger.
+	 */
+	if (sk->sk_state == TCP_CLOSE) {
+		spin_lock_bh(&stab->lock);
+		if (stab->sock_map[key] == sk) {
+			stab->sock_map[key] = NULL;
+			smap_release_sock(sk);
+		}
+		spin_unlock_bh(&stab->lock);
+	}
+	rcu_read_unlock();
+
+	state_change(sk);
+}
+
+static void smap_queue_peer(struct sock *sk, struct sk_buff *skb)
+{
+	struct smap_psock *peer;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	/* The slot may be stale, sk_user_data then belongs to somebody
+	 * else (KCM...) or to nobody.
+	 */
+	peer = NULL;
+	if (sk->sk_write_space == smap_write_space)
+		peer = smap_psock_sk(sk);
+	if (likely(peer &&
+		   test_bit(SMAP_TX_RUNNING, &peer->state) &&
+		   !sock_flag(sk, SOCK_DEAD) &&
+		   sock_writeable(sk))) {
+		skb_set_owner_w(skb, sk);
+		skb_queue_tail(&peer->rxqueue, skb);
+		schedule_work(&peer->tx_work);
+		skb = NULL;
+	}
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	/* Fall through and free skb otherwise */
+	if (skb)
+		kfree_skb(skb);
+}
+
+static struct sock *__sock_map_lookup_elem(struct bpf_map *map, u32 key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(stab->sock_map[key]);
+}
+
+static int smap_verdict_func(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct strp_rx_msg *rxm = strp_rx_msg(skb);
+	struct sk_skb_cb *cb = sk_skb_cb(skb);
+	struct bpf_prog *prog = psock->bpf_verdict;
+
+	if (unlikely(!prog))
+		return SK_DROP;
+
+	cb->off = rxm->offset;
+	cb->len = rxm->full_len;
+	cb->map = NULL;
+
+	return BPF_PROG_RUN(prog, skb);
+}
+
+static void smap_do_verdict(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct sk_skb_cb *cb;
+	struct sock *sk;
+	int rc;
+
+	rc = smap_verdict_func(psock, skb);
+	switch (rc) {
+	case SK_PASS:
+		cb = sk_skb_cb(skb);
+		sk = cb->map ? __sock_map_lookup_elem(cb->map, cb->key) : NULL;
+		if (likely(sk)) {
+			smap_queue_peer(sk, skb);
+			break;
+		}
+	/* Fall through and free skb otherwise */
+	case SK_DROP:
+	default:
+		kfree_skb(skb);
+	}
+}
+
+/* Called with lower sock held */
+static void smap_read_sock_strparser(struct strparser *strp,
+				     struct sk_buff *skb)
+{
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = container_of(strp, struct smap_psock, strp);
+	smap_do_verdict(psock, skb);
+	rcu_read_unlock();
+}
+
+static int smap_parse_func_strparser(struct strparser *strp,
+				     struct sk_buff *skb)
+{
+	struct smap_psock *psock = container_of(strp, struct smap_psock,
+						strp);
+	struct strp_rx_msg *rxm = strp_rx_msg(skb);
+	struct sk_skb_cb *cb = sk_skb_cb(skb);
+	int rc;
+
+	/* The message starts rxm->offset bytes into the head skb, give the
+	 * program a view that starts there as well.
+	 */
+	cb->off = rxm->offset;
+	cb->len = skb->len - rxm->offset;
+	cb->map = NULL;
+
+	rcu_read_lock();
+	rc = BPF_PROG_RUN(psock->bpf_parse, skb);
+	rcu_read_unlock();
+
+	return rc;
+}
+
+/* Called with lower socket held */
+static int smap_read_sock_done(struct strparser *strp, int err)
+{
+	return err;
+}
+
+static void smap_data_ready(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	psock = smap_psock_sk(sk);
+	if (likely(psock))
+		strp_data_ready(&psock->strp);
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void smap_tx_work(struct work_struct *w)
+{
+	struct smap_psock *psock;
+	struct sk_buff *skb;
+	int rem, off, n;
+
+	psock = container_of(w, struct smap_psock, tx_work);
+
+	if (psock->save_skb) {
+		skb = psock->save_skb;
+		rem = psock->save_rem;
+		off = psock->save_off;
+		psock->save_skb = NULL;
+		goto start;
+	}
+
+	while ((skb = skb_dequeue(&psock->rxqueue))) {
+		rem = sk_skb_cb(skb)->len;
+		off = sk_skb_cb(skb)->off;
+start:
+		do {
+			if (likely(test_bit(SMAP_TX_RUNNING, &psock->state)))
+				n = skb_send_sock(psock->sock, skb, off, rem);
+			else
+				n = -EINVAL;
+			if (n <= 0) {
+				if (n == -EAGAIN) {
+					/* Retry when space is available */
+					psock->save_skb = skb;
+					psock->save_rem = rem;
+					psock->save_off = off;
+					return;
+				}
+				/* Hard errors break pipe and stop xmit */
+				if (n != -EINVAL)
+					smap_report_sk_error(psock,
+							     n ? -n : EPIPE);
+				clear_bit(SMAP_TX_RUNNING, &psock->state);
+				kfree_skb(skb);
+				return;
+			}
+			rem -= n;
+			off += n;
+		} while (rem);
+		kfree_skb(skb);
+	}
+}
+
+static void smap_write_space(struct sock *sk)
+{
+	void (*write_space)(struct sock *sk) = NULL;
+	struct smap_psock *psock;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		if (test_bit(SMAP_TX_RUNNING, &psock->state))
+			schedule_work(&psock->tx_work);
+		write_space = psock->save_write_space;
+	}
+	read_unlock_bh(&sk->sk_callback_lock);
+
+	/* Wake up local writers as well */
+	if (write_space)
+		write_space(sk);
+	else
+		sk->sk_write_space(sk);
+}
+
+static void smap_destroy_psock(struct rcu_head *rcu)
+{
+	struct smap_psock *psock = container_of(rcu, struct smap_psock, rcu);
+
+	sockfd_put(psock->sock);
+	kfree(psock);
+}
+
+static void smap_gc_work(struct work_struct *w)
+{
+	struct smap_psock *psock;
+
+	psock = container_of(w, struct smap_psock, gc_work);
+
+	/* No callbacks or redirects can reach the psock anymore, it was
+	 * unhooked from the sock before this work got scheduled.
+	 */
+	if (psock->strp_enabled)
+		strp_done(&psock->strp);
+
+	cancel_work_sync(&psock->tx_work);
+	skb_queue_purge(&psock->rxqueue);
+	kfree_skb(psock->save_skb);
+
+	if (psock->bpf_parse)
+		bpf_prog_put(psock->bpf_parse);
+	if (psock->bpf_verdict)
+		bpf_prog_put(psock->bpf_verdict);
+
+	/* Verdict programs may still hold the sock from a lookup */
+	call_rcu(&psock->rcu, smap_destroy_psock);
+}
+
+/* Called with stab->lock held after the sock was removed from its slot */
+static void smap_release_sock(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	psock = smap_psock_sk(sk);
+	if (WARN_ON(!psock)) {
+		write_unlock_bh(&sk->sk_callback_lock);
+		return;
+	}
+
+	if (psock->strp_enabled) {
+		sk->sk_data_ready = psock->save_data_ready;
+		strp_stop(&psock->strp);
+	}
+	sk->sk_write_space = psock->save_write_space;
+	sk->sk_state_change = psock->save_state_change;
+	sk->sk_user_data = NULL;
+	clear_bit(SMAP_TX_RUNNING, &psock->state);
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	schedule_work(&psock->gc_work);
+}
+
+static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_stab *stab;
+	u64 cost;
+
+	if (!capable(CAP_NET_ADMIN))
+		return ERR_PTR(-EPERM);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != 4 || attr->map_flags)
+		return ERR_PTR(-EINVAL);
+
+	/* make sure there is no u32 overflow later in round_up() */
+	cost = (u64) attr->max_entries * sizeof(struct sock *);
+	if (cost >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-ENOMEM);
+
+	stab = kzalloc(sizeof(*stab), GFP_USER);
+	if (!stab)
+		return ERR_PTR(-ENOMEM);
+
+	/* mandatory map attributes */
+	stab->map.map_type = attr->map_type;
+	stab->map.key_size = attr->key_size;
+	stab->map.value_size = attr->value_size;
+	stab->map.max_entries = attr->max_entries;
+	stab->map.map_flags = attr->map_flags;
+	stab->map.pages = round_up(cost + sizeof(*stab), PAGE_SIZE) >>
+			  PAGE_SHIFT;
+
+	stab->sock_map = kzalloc(cost, GFP_USER | __GFP_NOWARN);
+	if (!stab->sock_map) {
+		stab->sock_map = vzalloc(cost);
+		if (!stab->sock_map) {
+			kfree(stab);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+
+	spin_lock_init(&stab->lock);
+
+	return &stab->map;
+}
+
+static void sock_map_free(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	int i;
+
+	/* At this point bpf_prog->aux->refcnt == 0 and this map->refcnt == 0,
+	 * so the programs (can be more than one that used this map) were
+	 * disconnected from events. Wait for outstanding critical sections in
+	 * these programs to complete.
+	 */
+	synchronize_rcu();
+
+	spin_lock_bh(&stab->lock);
+	for (i = 0; i < stab->map.max_entries; i++) {
+		struct sock *sk = stab->sock_map[i];
+
+		if (!sk)
+			continue;
+
+		stab->sock_map[i] = NULL;
+		smap_release_sock(sk);
+	}
+	spin_unlock_bh(&stab->lock);
+
+	/* smap_state_change() may still look at the map */
+	synchronize_rcu();
+
+	if (stab->bpf_verdict)
+		bpf_prog_put(stab->bpf_verdict);
+	if (stab->bpf_parse)
+		bpf_prog_put(stab->bpf_parse);
+
+	kvfree(stab->sock_map);
+	kfree(stab);
+}
+
+static int sock_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 index = *(u32 *)key;
+	u32 *next = (u32 *)next_key;
+
+	if (index >= stab->map.max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == stab->map.max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+/* Socks can only be looked up by the datapath via bpf_sk_redirect_map() */
+static void *sock_map_lookup(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+static int sock_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 k = *(u32 *)key;
+	struct sock *sk;
+
+	if (k >= map->max_entries)
+		return -EINVAL;
+
+	spin_lock_bh(&stab->lock);
+	sk = stab->sock_map[k];
+	if (sk) {
+		stab->sock_map[k] = NULL;
+		smap_release_sock(sk);
+	}
+	spin_unlock_bh(&stab->lock);
+
+	return sk ? 0 : -ENOENT;
+}
+
+static struct smap_psock *smap_init_psock(struct socket *sock,
+					  struct bpf_stab *stab, u32 key)
+{
+	struct smap_psock *psock;
+
+	psock = kzalloc(sizeof(*psock), GFP_ATOMIC | __GFP_NOWARN);
+	if (!psock)
+		return NULL;
+
+	skb_queue_head_init(&psock->rxqueue);
+	INIT_WORK(&psock->tx_work, smap_tx_work);
+	INIT_WORK(&psock->gc_work, smap_gc_work);
+	psock->sock = sock;
+	psock->stab = stab;
+	psock->key = key;
+
+	return psock;
+}
+
+static int smap_init_strparser(struct smap_psock *psock)
+{
+	struct strp_callbacks cb;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.rcv_msg = smap_read_sock_strparser;
+	cb.parse_msg = smap_parse_func_strparser;
+	cb.read_sock_done = smap_read_sock_done;
+
+	return strp_init(&psock->strp, psock->sock->sk, &cb);
+}
+
+/* Called from the bpf syscall with rcu_read_lock held and preemption
+ * disabled, the value is the file descriptor of a TCP socket.
+ */
+static int sock_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 flags)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 i = *(u32 *)key;
+	u32 fd = *(u32 *)value;
+	struct smap_psock *psock;
+	struct socket *sock;
+	struct sock *sk;
+	int err;
+
+	if (unlikely(flags > BPF_EXIST))
+		return -EINVAL;
+
+	if (unlikely(i >= stab->map.max_entries))
+		return -E2BIG;
+
+	sock = sockfd_lookup(fd, &err);
+	if (!sock)
+		return err;
+
+	sk = sock->sk;
+	if (sk->sk_type != SOCK_STREAM || sk->sk_protocol != IPPROTO_TCP) {
+		err = -EOPNOTSUPP;
+		goto out_put;
+	}
+
+	psock = smap_init_psock(sock, stab, i);
+	if (!psock) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+
+	spin_lock_bh(&stab->lock);
+
+	if (stab->sock_map[i] && flags == BPF_NOEXIST) {
+		err = -EEXIST;
+		goto out_unlock;
+	}
+	if (!stab->sock_map[i] && flags == BPF_EXIST) {
+		err = -ENOENT;
+		goto out_unlock;
+	}
+
+	/* Only a parser and a verdict program together can build and
+	 * redirect messages, without them the sock is a redirect target.
+	 */
+	if (stab->bpf_parse && stab->bpf_verdict) {
+		err = smap_init_strparser(psock);
+		if (err)
+			goto out_unlock;
+
+		psock->bpf_parse = bpf_prog_inc(stab->bpf_parse);
+		if (IS_ERR(psock->bpf_parse)) {
+			err = PTR_ERR(psock->bpf_parse);
+			psock->bpf_parse = NULL;
+			goto out_unlock;
+		}
+
+		psock->bpf_verdict = bpf_prog_inc(stab->bpf_verdict);
+		if (IS_ERR(psock->bpf_verdict)) {
+			err = PTR_ERR(psock->bpf_verdict);
+			psock->bpf_verdict = NULL;
+			goto out_progs;
+		}
+		psock->strp_enabled = true;
+	}
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (sk->sk_user_data) {
+		/* Already in a sock map, or owned by KCM or similar */
+		write_unlock_bh(&sk->sk_callback_lock);
+		err = -EBUSY;
+		goto out_progs;
+	}
+
+	psock->save_write_space = sk->sk_write_space;
+	psock->save_state_change = sk->sk_state_change;
+	sk->sk_write_space = smap_write_space;
+	sk->sk_state_change = smap_state_change;
+	if (psock->strp_enabled) {
+		psock->save_data_ready = sk->sk_data_ready;
+		sk->sk_data_ready = smap_data_ready;
+	}
+	sk->sk_user_data = psock;
+	set_bit(SMAP_TX_RUNNING, &psock->state);
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (stab->sock_map[i])
+		smap_release_sock(stab->sock_map[i]);
+	stab->sock_map[i] = sk;
+
+	spin_unlock_bh(&stab->lock);
+
+	/* Parse whatever was queued before the sock was added */
+	if (psock->strp_enabled)
+		strp_check_rcv(&psock->strp);
+
+	return 0;
+
+out_progs:
+	if (psock->bpf_verdict)
+		bpf_prog_put(psock->bpf_verdict);
+	if (psock->bpf_parse)
+		bpf_prog_put(psock->bpf_parse);
+out_unlock:
+	spin_unlock_bh(&stab->lock);
+	kfree(psock);
+out_put:
+	sockfd_put(sock);
+	return err;
+}
+
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *orig;
+
+	if (unlikely(map->map_type != BPF_MAP_TYPE_SOCKMAP))
+		return -EINVAL;
+
+	spin_lock_bh(&stab->lock);
+	switch (type) {
+	case BPF_SK_SKB_STREAM_PARSER:
+		orig = stab->bpf_parse;
+		stab->bpf_parse = prog;
+		break;
+	case BPF_SK_SKB_STREAM_VERDICT:
+		orig = stab->bpf_verdict;
+		stab->bpf_verdict = prog;
+		break;
+	default:
+		spin_unlock_bh(&stab->lock);
+		return -EOPNOTSUPP;
+	}
+	spin_unlock_bh(&stab->lock);
+
+	/* Socks already in the map keep the programs they were added with */
+	if (orig)
+		bpf_prog_put(orig);
+
+	return 0;
+}
+
+static const struct bpf_map_ops sock_map_ops = {
+	.map_alloc = sock_map_alloc,
+	.map_free = sock_map_free,
+	.map_get_next_key = sock_map_get_next_key,
+	.map_lookup_elem = sock_map_lookup,
+	.map_update_elem = sock_map_update_elem,
+	.map_delete_elem = sock_map_delete_elem,
+};
+
+static struct bpf_map_type_list sock_map_type __read_mostly = {
+	.ops = &sock_map_ops,
+	.type = BPF_MAP_TYPE_SOCKMAP,
+};
+
+static int __init register_sock_map(void)
+{
+	bpf_register_map_type(&sock_map_type);
+	return 0;
+}
+late_initcall(register_sock_map);
@@ -5064,6 +5064,7 @@ static void css_release_work_fn(struct work_struct *work)
 
 		cgroup_idr_remove(&cgrp->root->cgroup_idr, cgrp->id);
 		cgrp->id = -1;
+		cgroup_bpf_put(cgrp);
 
 		/*
 		 * There are two control paths which try to determine
@@ -5289,6 +5290,8 @@ static struct cgroup *cgroup_create(struct cgroup *parent)
 
 	cgroup_propagate_control(cgrp);
 
+	cgroup_bpf_inherit(cgrp, parent);
+
 	return cgrp;
 
 out_cancel_ref:
@@ -6345,6 +6348,20 @@ void cgroup_sk_free(struct sock_cgroup_data *skcd)
 
 #endif	/* CONFIG_SOCK_CGROUP_DATA */
 
+#ifdef CONFIG_CGROUP_BPF
+int cgroup_bpf_update(struct cgroup *cgrp, struct bpf_prog *prog,
+		      enum bpf_attach_type type, bool overridable)
+{
+	struct cgroup *parent = cgroup_parent(cgrp);
+	int ret;
+
+	mutex_lock(&cgroup_mutex);
+	ret = __cgroup_bpf_update(cgrp, parent, prog, type, overridable);
+	mutex_unlock(&cgroup_mutex);
+	return ret;
+}
+#endif /* CONFIG_CGROUP_BPF */
+
 /* cgroup namespaces */
 
 static struct ucounts *inc_cgroup_namespaces(struct user_namespace *ns)
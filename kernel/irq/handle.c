@@ -11,6 +11,7 @@
  */
 
 #include <linux/irq.h>
+#include <linux/cpuidle.h>
 #include <linux/random.h>
 #include <linux/sched.h>
 #include <linux/interrupt.h>
@@ -185,6 +186,9 @@ irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 	retval = __handle_irq_event_percpu(desc, &flags);
 
 	add_interrupt_randomness(desc->irq_data.irq, flags);
+	/* Timer events are predicted from the timers, not learned */
+	if (!(flags & IRQF_TIMER))
+		cpuidle_irq_record(desc->irq_data.irq);
 
 	if (!noirqdebug)
 		note_interrupt(desc, retval);
@@ -176,12 +176,12 @@ static inline int pm_qos_get_value(struct pm_qos_constraints *c)
 
 s32 pm_qos_read_value(struct pm_qos_constraints *c)
 {
-	return c->target_value;
+	return READ_ONCE(c->target_value);
 }
 
 static inline void pm_qos_set_value(struct pm_qos_constraints *c, s32 value)
 {
-	c->target_value = value;
+	WRITE_ONCE(c->target_value, value);
 }
 
 static inline int pm_qos_get_value(struct pm_qos_constraints *c);
@@ -259,30 +259,14 @@ static const struct file_operations pm_qos_debug_fops = {
 	.release        = single_release,
 };
 
-/**
- * pm_qos_update_target - manages the constraints list and calls the notifiers
- *  if needed
- * @c: constraints data struct
- * @node: request to add to the list, to update or to remove
- * @action: action to take on the constraints list
- * @value: value of the request to add or update
- *
- * This function returns 1 if the aggregated constraint value has changed, 0
- *  otherwise.
- */
-int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
-			 enum pm_qos_req_action action, int value)
+/* Apply @action to the constraints list and update the target value */
+static s32 __pm_qos_update_target(struct pm_qos_constraints *c,
+				  struct plist_node *node,
+				  enum pm_qos_req_action action, s32 new_value)
 {
-	unsigned long flags;
-	int prev_value, curr_value, new_value;
-	int ret;
+	s32 curr_value;
 
-	spin_lock_irqsave(&pm_qos_lock, flags);
-	prev_value = pm_qos_get_value(c);
-	if (value == PM_QOS_DEFAULT_VALUE)
-		new_value = c->default_value;
-	else
-		new_value = value;
+	lockdep_assert_held(&pm_qos_lock);
 
 	switch (action) {
 	case PM_QOS_REMOVE_REQ:
@@ -307,6 +291,61 @@ int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 	curr_value = pm_qos_get_value(c);
 	pm_qos_set_value(c, curr_value);
 
+	return curr_value;
+}
+
+/*
+ * Notifiers of the classes whose target value was changed by
+ * pm_qos_update_request_atomic(), they are called from process context.
+ */
+static unsigned long pm_qos_notify_pending;
+
+static void pm_qos_notify_fn(struct work_struct *work)
+{
+	struct pm_qos_constraints *c;
+	int i;
+
+	for (i = PM_QOS_CPU_DMA_LATENCY; i < PM_QOS_NUM_CLASSES; i++) {
+		if (!test_and_clear_bit(i, &pm_qos_notify_pending))
+			continue;
+
+		c = pm_qos_array[i]->constraints;
+		if (c->notifiers)
+			blocking_notifier_call_chain(c->notifiers,
+						     (unsigned long)pm_qos_read_value(c),
+						     NULL);
+	}
+}
+
+static DECLARE_WORK(pm_qos_notify_work, pm_qos_notify_fn);
+
+/**
+ * pm_qos_update_target - manages the constraints list and calls the notifiers
+ *  if needed
+ * @c: constraints data struct
+ * @node: request to add to the list, to update or to remove
+ * @action: action to take on the constraints list
+ * @value: value of the request to add or update
+ *
+ * This function returns 1 if the aggregated constraint value has changed, 0
+ *  otherwise.
+ */
+int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
+			 enum pm_qos_req_action action, int value)
+{
+	unsigned long flags;
+	int prev_value, curr_value, new_value;
+	int ret;
+
+	spin_lock_irqsave(&pm_qos_lock, flags);
+	prev_value = pm_qos_get_value(c);
+	if (value == PM_QOS_DEFAULT_VALUE)
+		new_value = c->default_value;
+	else
+		new_value = value;
+
+	curr_value = __pm_qos_update_target(c, node, action, new_value);
+
 	spin_unlock_irqrestore(&pm_qos_lock, flags);
 
 	trace_pm_qos_update_target(action, prev_value, curr_value);
@@ -496,6 +535,59 @@ void pm_qos_update_request(struct pm_qos_request *req,
 }
 EXPORT_SYMBOL_GPL(pm_qos_update_request);
 
+/**
+ * pm_qos_update_request_atomic - modifies an existing qos request from any
+ *  context
+ * @req : handle to list element holding a pm_qos request to use
+ * @new_value: defines the qos request
+ *
+ * Same as pm_qos_update_request(), but may be called with interrupts
+ * disabled or from interrupt context, e.g. to tighten the latency only
+ * for the duration of a DMA transfer.  The target value, as returned by
+ * pm_qos_request(), is updated before this returns, while the notifiers
+ * of the class are called later from a workqueue.
+ *
+ * Must not be used on a request that is also updated with
+ * pm_qos_update_request_timeout().
+ */
+void pm_qos_update_request_atomic(struct pm_qos_request *req, s32 new_value)
+{
+	struct pm_qos_constraints *c;
+	s32 prev_value, curr_value;
+	unsigned long flags;
+
+	if (!req) /*guard against callers passing in null */
+		return;
+
+	if (WARN(!pm_qos_request_active(req),
+		 "%s called for unknown object.", __func__))
+		return;
+
+	trace_pm_qos_update_request(req->pm_qos_class, new_value);
+
+	c = pm_qos_array[req->pm_qos_class]->constraints;
+	if (new_value == PM_QOS_DEFAULT_VALUE)
+		new_value = c->default_value;
+
+	spin_lock_irqsave(&pm_qos_lock, flags);
+	if (new_value == req->node.prio) {
+		spin_unlock_irqrestore(&pm_qos_lock, flags);
+		return;
+	}
+
+	prev_value = pm_qos_get_value(c);
+	curr_value = __pm_qos_update_target(c, &req->node, PM_QOS_UPDATE_REQ,
+					    new_value);
+	spin_unlock_irqrestore(&pm_qos_lock, flags);
+
+	trace_pm_qos_update_target(PM_QOS_UPDATE_REQ, prev_value, curr_value);
+	if (prev_value != curr_value && c->notifiers) {
+		set_bit(req->pm_qos_class, &pm_qos_notify_pending);
+		schedule_work(&pm_qos_notify_work);
+	}
+}
+EXPORT_SYMBOL_GPL(pm_qos_update_request_atomic);
+
 /**
  * pm_qos_update_request_timeout - modifies an existing qos request temporarily.
  * @req : handle to list element holding a pm_qos request to use
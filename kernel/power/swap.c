@@ -25,6 +25,7 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
@@ -524,6 +525,97 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 #define LZO_MIN_RD_PAGES	1024
 #define LZO_MAX_RD_PAGES	8192
 
+/*
+ * Compression algorithms for the image. The buffers above are sized for
+ * the worst case of LZO, which is above the one of LZ4 for LZO_UNC_SIZE.
+ */
+struct hib_compressor {
+	const char *name;
+	unsigned int flags;		/* SF_* flags stored in the header */
+	size_t wrk_size;		/* compression workspace size */
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst, size_t *dst_len);
+	size_t (*worst_compress)(size_t len);
+};
+
+static size_t hib_lzo_worst_compress(size_t len)
+{
+	return lzo1x_worst_compress(len);
+}
+
+static const struct hib_compressor hib_lzo = {
+	.name		= "lzo",
+	.wrk_size	= LZO1X_1_MEM_COMPRESS,
+	.compress	= lzo1x_1_compress,
+	.decompress	= lzo1x_decompress_safe,
+	.worst_compress	= hib_lzo_worst_compress,
+};
+
+#ifdef CONFIG_HIBERNATION_COMP_LZ4
+static const struct hib_compressor hib_lz4 = {
+	.name		= "lz4",
+	.flags		= SF_LZ4_MODE,
+	.wrk_size	= LZ4_MEM_COMPRESS,
+	.compress	= lz4_compress,
+	.decompress	= lz4_decompress_unknownoutputsize,
+	.worst_compress	= lz4_compressbound,
+};
+
+/* Slower to compress, same decompression as LZ4 */
+static const struct hib_compressor hib_lz4hc = {
+	.name		= "lz4hc",
+	.flags		= SF_LZ4_MODE,
+	.wrk_size	= LZ4HC_MEM_COMPRESS,
+	.compress	= lz4hc_compress,
+	.decompress	= lz4_decompress_unknownoutputsize,
+	.worst_compress	= lz4_compressbound,
+};
+#endif
+
+static const struct hib_compressor *hib_comp = &hib_lzo;
+
+static int __init hib_compression_setup(char *str)
+{
+	if (!strcmp(str, "lzo"))
+		hib_comp = &hib_lzo;
+#ifdef CONFIG_HIBERNATION_COMP_LZ4
+	else if (!strcmp(str, "lz4"))
+		hib_comp = &hib_lz4;
+	else if (!strcmp(str, "lz4hc"))
+		hib_comp = &hib_lz4hc;
+#endif
+	else
+		pr_warn("PM: Unsupported hibernation compression %s\n", str);
+	return 1;
+}
+__setup("hib_compression=", hib_compression_setup);
+
+static const struct hib_compressor *hib_comp_from_flags(unsigned int flags)
+{
+	if (!(flags & SF_LZ4_MODE))
+		return &hib_lzo;
+#ifdef CONFIG_HIBERNATION_COMP_LZ4
+	return &hib_lz4;
+#else
+	return NULL;
+#endif
+}
+
+static void hib_show_wait(const struct hib_compressor *comp, const char *what,
+			  u64 io_ns, u64 cmp_ns)
+{
+	printk(KERN_INFO "PM: %s: %llu ms waiting for I/O, %llu ms waiting for %s\n",
+	       comp->name, div_u64(io_ns, NSEC_PER_MSEC),
+	       div_u64(cmp_ns, NSEC_PER_MSEC), what);
+}
+
+static inline u64 hib_ns_since(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
 
 /**
  *	save_image - save the suspend image data
@@ -615,26 +707,26 @@ static int crc32_threadfn(void *data)
 	return 0;
 }
 /**
- * Structure used for LZO data compression.
+ * Structure used for data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	unsigned char *wrk;                       /* compression workspace */
 	wait_queue_head_t go;                     /* start compression */
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
 };
 
 /**
  * Compression function that runs in its own thread.
  */
-static int lzo_compress_threadfn(void *data)
+static int compress_threadfn(void *data)
 {
 	struct cmp_data *d = data;
 
@@ -650,9 +742,9 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		d->ret = hib_comp->compress(d->unc, d->unc_len,
+		                            d->cmp + LZO_HEADER, &d->cmp_len,
+		                            d->wrk);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -660,14 +752,14 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_compressed_image - Save the suspend image data compressed.
  * @handle: Swap map handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
  */
-static int save_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+static int save_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_write)
 {
 	unsigned int m;
 	int ret = 0;
@@ -676,6 +768,8 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	struct hib_bio_batch hb;
 	ktime_t start;
 	ktime_t stop;
+	ktime_t wait;
+	u64 io_ns = 0, cmp_ns = 0;
 	size_t off;
 	unsigned thr, run_threads, nr_threads;
 	unsigned char *page = NULL;
@@ -693,20 +787,30 @@ static int save_image_lzo(struct swap_map_handle *handle,
 
 	page = (void *)__get_free_page(__GFP_RECLAIM | __GFP_HIGH);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate compression page\n");
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate compression data\n");
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 	for (thr = 0; thr < nr_threads; thr++)
 		memset(&data[thr], 0, offsetof(struct cmp_data, go));
 
+	for (thr = 0; thr < nr_threads; thr++) {
+		data[thr].wrk = vmalloc(hib_comp->wrk_size);
+		if (!data[thr].wrk) {
+			printk(KERN_ERR
+			       "PM: Failed to allocate compression workspace\n");
+			ret = -ENOMEM;
+			goto out_clean;
+		}
+	}
+
 	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
 	if (!crc) {
 		printk(KERN_ERR "PM: Failed to allocate crc\n");
@@ -722,7 +826,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_compress_threadfn,
+		data[thr].thr = kthread_run(compress_threadfn,
 		                            &data[thr],
 		                            "image_compress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -762,9 +866,9 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	handle->reqd_free_pages = reqd_free_pages();
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for compression.\n"
+		"PM: Using %u thread(s) for %s compression.\n"
 		"PM: Compressing and saving image data (%u pages)...\n",
-		nr_threads, nr_to_write);
+		nr_threads, hib_comp->name, nr_to_write);
 	m = nr_to_write / 10;
 	if (!m)
 		m = 1;
@@ -807,22 +911,26 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		wake_up(&crc->go);
 
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
+			wait = ktime_get();
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
 			atomic_set(&data[thr].stop, 0);
+			cmp_ns += hib_ns_since(wait);
 
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				printk(KERN_ERR "PM: LZO compression failed\n");
+				printk(KERN_ERR "PM: %s compression failed\n",
+				       hib_comp->name);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(data[thr].unc_len))) {
+			             hib_comp->worst_compress(data[thr].unc_len))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       hib_comp->name);
 				ret = -1;
 				goto out_finish;
 			}
@@ -837,6 +945,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			 * any garbage at the end will be discarded when we
 			 * read it.
 			 */
+			wait = ktime_get();
 			for (off = 0;
 			     off < LZO_HEADER + data[thr].cmp_len;
 			     off += PAGE_SIZE) {
@@ -846,6 +955,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 				if (ret)
 					goto out_finish;
 			}
+			io_ns += hib_ns_since(wait);
 		}
 
 		wait_event(crc->done, atomic_read(&crc->stop));
@@ -853,13 +963,16 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	}
 
 out_finish:
+	wait = ktime_get();
 	err2 = hib_wait_io(&hb);
 	stop = ktime_get();
+	io_ns += ktime_to_ns(ktime_sub(stop, wait));
 	if (!ret)
 		ret = err2;
 	if (!ret)
 		printk(KERN_INFO "PM: Image saving done.\n");
 	swsusp_show_speed(start, stop, nr_to_write, "Wrote");
+	hib_show_wait(hib_comp, "compression", io_ns, cmp_ns);
 out_clean:
 	if (crc) {
 		if (crc->thr)
@@ -867,9 +980,11 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		kfree(crc);
 	}
 	if (data) {
-		for (thr = 0; thr < nr_threads; thr++)
+		for (thr = 0; thr < nr_threads; thr++) {
 			if (data[thr].thr)
 				kthread_stop(data[thr].thr);
+			vfree(data[thr].wrk);
+		}
 		vfree(data);
 	}
 	if (page) free_page((unsigned long)page);
@@ -937,9 +1052,11 @@ int swsusp_write(unsigned int flags)
 	header = (struct swsusp_info *)data_of(snapshot);
 	error = swap_write_page(&handle, header, NULL);
 	if (!error) {
+		if (!(flags & SF_NOCOMPRESS_MODE))
+			flags |= hib_comp->flags;
 		error = (flags & SF_NOCOMPRESS_MODE) ?
 			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+			save_compressed_image(&handle, &snapshot, pages - 1);
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1108,13 +1225,14 @@ static int load_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	const struct hib_compressor *comp;        /* of the image */
 	wait_queue_head_t go;                     /* start decompression */
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
@@ -1126,7 +1244,7 @@ struct dec_data {
 /**
  * Deompression function that runs in its own thread.
  */
-static int lzo_decompress_threadfn(void *data)
+static int decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
 
@@ -1143,8 +1261,8 @@ static int lzo_decompress_threadfn(void *data)
 		atomic_set(&d->ready, 0);
 
 		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		d->ret = d->comp->decompress(d->cmp + LZO_HEADER, d->cmp_len,
+		                             d->unc, &d->unc_len);
 		if (clean_pages_on_decompress)
 			flush_icache_range((unsigned long)d->unc,
 					   (unsigned long)d->unc + d->unc_len);
@@ -1156,14 +1274,19 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_compressed_image - Load compressed image data and decompress them.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
+ * @comp: Compressor the image was written with.
+ *
+ * Reads of the compressed data are submitted ahead into a ring of pages
+ * while the previous chunks are being decompressed.
  */
-static int load_image_lzo(struct swap_map_handle *handle,
-                          struct snapshot_handle *snapshot,
-                          unsigned int nr_to_read)
+static int load_compressed_image(struct swap_map_handle *handle,
+                                 struct snapshot_handle *snapshot,
+                                 unsigned int nr_to_read,
+                                 const struct hib_compressor *comp)
 {
 	unsigned int m;
 	int ret = 0;
@@ -1171,6 +1294,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	struct hib_bio_batch hb;
 	ktime_t start;
 	ktime_t stop;
+	ktime_t wait;
+	u64 io_ns = 0, cmp_ns = 0;
 	unsigned nr_pages;
 	size_t off;
 	unsigned i, thr, run_threads, nr_threads;
@@ -1192,14 +1317,14 @@ static int load_image_lzo(struct swap_map_handle *handle,
 
 	page = vmalloc(sizeof(*page) * LZO_MAX_RD_PAGES);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate decompression page\n");
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate decompression data\n");
 		ret = -ENOMEM;
 		goto out_clean;
 	}
@@ -1222,8 +1347,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	for (thr = 0; thr < nr_threads; thr++) {
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
+		data[thr].comp = comp;
 
-		data[thr].thr = kthread_run(lzo_decompress_threadfn,
+		data[thr].thr = kthread_run(decompress_threadfn,
 		                            &data[thr],
 		                            "image_decompress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -1277,7 +1403,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			if (i < LZO_CMP_PAGES) {
 				ring_size = i;
 				printk(KERN_ERR
-				       "PM: Failed to allocate LZO pages\n");
+				       "PM: Failed to allocate read pages\n");
 				ret = -ENOMEM;
 				goto out_clean;
 			} else {
@@ -1288,9 +1414,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	want = ring_size = i;
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for decompression.\n"
+		"PM: Using %u thread(s) for %s decompression.\n"
 		"PM: Loading and decompressing image data (%u pages)...\n",
-		nr_threads, nr_to_read);
+		nr_threads, comp->name, nr_to_read);
 	m = nr_to_read / 10;
 	if (!m)
 		m = 1;
@@ -1330,7 +1456,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			if (!asked)
 				break;
 
+			wait = ktime_get();
 			ret = hib_wait_io(&hb);
+			io_ns += hib_ns_since(wait);
 			if (ret)
 				goto out_finish;
 			have += asked;
@@ -1349,9 +1477,10 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
+			             comp->worst_compress(LZO_UNC_SIZE))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       comp->name);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1385,7 +1514,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		 * Wait for more data while we are decompressing.
 		 */
 		if (have < LZO_CMP_PAGES && asked) {
+			wait = ktime_get();
 			ret = hib_wait_io(&hb);
+			io_ns += hib_ns_since(wait);
 			if (ret)
 				goto out_finish;
 			have += asked;
@@ -1395,15 +1526,18 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
+			wait = ktime_get();
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
 			atomic_set(&data[thr].stop, 0);
+			cmp_ns += hib_ns_since(wait);
 
 			ret = data[thr].ret;
 
 			if (ret < 0) {
 				printk(KERN_ERR
-				       "PM: LZO decompression failed\n");
+				       "PM: %s decompression failed\n",
+				       comp->name);
 				goto out_finish;
 			}
 
@@ -1411,7 +1545,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			             data[thr].unc_len > LZO_UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO uncompressed length\n");
+				       "PM: Invalid %s uncompressed length\n",
+				       comp->name);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1465,6 +1600,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 	}
 	swsusp_show_speed(start, stop, nr_to_read, "Read");
+	hib_show_wait(comp, "decompression", io_ns, cmp_ns);
 out_clean:
 	for (i = 0; i < ring_size; i++)
 		free_page((unsigned long)page[i]);
@@ -1496,6 +1632,7 @@ int swsusp_read(unsigned int *flags_p)
 	struct swap_map_handle handle;
 	struct snapshot_handle snapshot;
 	struct swsusp_info *header;
+	const struct hib_compressor *comp = NULL;
 
 	memset(&snapshot, 0, sizeof(struct snapshot_handle));
 	error = snapshot_write_next(&snapshot);
@@ -1507,10 +1644,19 @@ int swsusp_read(unsigned int *flags_p)
 		goto end;
 	if (!error)
 		error = swap_read_page(&handle, header, NULL);
+	if (!error && !(*flags_p & SF_NOCOMPRESS_MODE)) {
+		/* Leave the compressor for the next hibernation alone */
+		comp = hib_comp_from_flags(*flags_p);
+		if (!comp) {
+			printk(KERN_ERR "PM: Image compression not supported\n");
+			error = -EINVAL;
+		}
+	}
 	if (!error) {
 		error = (*flags_p & SF_NOCOMPRESS_MODE) ?
 			load_image(&handle, &snapshot, header->pages - 1) :
-			load_image_lzo(&handle, &snapshot, header->pages - 1);
+			load_compressed_image(&handle, &snapshot,
+					      header->pages - 1, comp);
 	}
 	swap_reader_finish(&handle);
 end:
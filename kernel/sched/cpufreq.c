@@ -61,3 +61,60 @@ void cpufreq_remove_update_util_hook(int cpu)
 	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), NULL);
 }
 EXPORT_SYMBOL_GPL(cpufreq_remove_update_util_hook);
+
+/* Minimum interval between two network boost updates on a CPU */
+#define CPUFREQ_NET_BOOST_INTERVAL_NS	NSEC_PER_MSEC
+
+static DEFINE_PER_CPU(u64, cpufreq_net_boost_time);
+
+/**
+ * cpufreq_net_boost - Report a sustained network backlog on this CPU.
+ *
+ * Network drivers and NAPI call this when packets keep coming in (or
+ * going out) faster than they are processed, e.g. when a NAPI poll uses
+ * up its whole budget. The governor attached to the CPU gets an update
+ * with SCHED_CPUFREQ_NET set and may raise the frequency before the
+ * utilization of the softirq and of the tasks consuming the traffic
+ * has had time to ramp up.
+ *
+ * Updates are rate limited per CPU, so calling this on every poll is
+ * cheap. It must be called with preemption disabled, softirq context is
+ * fine.
+ */
+void cpufreq_net_boost(void)
+{
+	struct update_util_data *data;
+	unsigned long flags;
+	struct rq *rq;
+	u64 time;
+
+	local_irq_save(flags);
+
+	data = rcu_dereference_sched(*this_cpu_ptr(&cpufreq_update_util_data));
+	if (!data)
+		goto out;
+
+	/*
+	 * Serialize with the updates done by the scheduler on this CPU, and
+	 * pass the same time base they do.
+	 */
+	rq = this_rq();
+
+	/* Rate limit before taking the lock, the tick keeps rq->clock going */
+	if (__rq_clock_broken(rq) - __this_cpu_read(cpufreq_net_boost_time) <
+	    CPUFREQ_NET_BOOST_INTERVAL_NS)
+		goto out;
+
+	raw_spin_lock(&rq->lock);
+	update_rq_clock(rq);
+	time = rq_clock(rq);
+	if (time - __this_cpu_read(cpufreq_net_boost_time) >=
+	    CPUFREQ_NET_BOOST_INTERVAL_NS) {
+		__this_cpu_write(cpufreq_net_boost_time, time);
+		data->func(data, time, SCHED_CPUFREQ_NET);
+	}
+	raw_spin_unlock(&rq->lock);
+out:
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_net_boost);
@@ -17,6 +17,12 @@
 
 #include "sched.h"
 
+/*
+ * A network boost is held while the backlog keeps being reported, and is
+ * halved each time no report came in for that long.
+ */
+#define SUGOV_NET_BOOST_HOLD_NS		(2 * TICK_NSEC)
+
 struct sugov_tunables {
 	struct gov_attr_set attr_set;
 	unsigned int rate_limit_us;
@@ -51,6 +57,11 @@ struct sugov_cpu {
 	unsigned long iowait_boost_max;
 	u64 last_update;
 
+	/* Boost requested through cpufreq_net_boost() */
+	unsigned long net_boost;
+	unsigned long net_boost_max;
+	u64 last_net_boost;
+
 	/* The fields below are only needed when sharing a policy. */
 	unsigned long util;
 	unsigned long max;
@@ -146,14 +157,30 @@ static unsigned int get_next_freq(struct sugov_cpu *sg_cpu, unsigned long util,
 	return cpufreq_driver_resolve_freq(policy, freq);
 }
 
-static void sugov_get_util(unsigned long *util, unsigned long *max)
+static void sugov_get_util(unsigned long *util, unsigned long *max,
+			   unsigned int flags)
 {
 	struct rq *rq = this_rq();
 	unsigned long cfs_max;
 
 	cfs_max = arch_scale_cpu_capacity(NULL, smp_processor_id());
 
-	*util = min(rq->cfs.avg.util_avg, cfs_max);
+	/*
+	 * RT and DL tasks ask for the highest frequency, CFS tasks for their
+	 * utilization. RT and CFS requests are then restricted by the
+	 * utilization clamps of the tasks RUNNABLE on this CPU. DL tasks are
+	 * not refcounted in the rq clamps, and their bandwidth must not be
+	 * clamped by others, so their requests are left alone.
+	 */
+	if (flags & SCHED_CPUFREQ_DL) {
+		*util = cfs_max;
+	} else {
+		if (flags & SCHED_CPUFREQ_RT)
+			*util = cfs_max;
+		else
+			*util = rq->cfs.avg.util_avg;
+		*util = min(uclamp_util(rq, *util), cfs_max);
+	}
 	*max = cfs_max;
 }
 
@@ -187,45 +214,85 @@ static void sugov_iowait_boost(struct sugov_cpu *sg_cpu, unsigned long *util,
 	sg_cpu->iowait_boost >>= 1;
 }
 
+static void sugov_set_net_boost(struct sugov_cpu *sg_cpu, u64 time,
+				unsigned int flags)
+{
+	s64 delta_ns;
+
+	if (flags & SCHED_CPUFREQ_NET) {
+		/* Ramp up for as long as the backlog persists. */
+		if (sg_cpu->net_boost)
+			sg_cpu->net_boost = min(sg_cpu->net_boost << 1,
+						sg_cpu->net_boost_max);
+		else
+			sg_cpu->net_boost = sg_cpu->net_boost_max >> 2;
+		sg_cpu->last_net_boost = time;
+		return;
+	}
+
+	if (!sg_cpu->net_boost)
+		return;
+
+	delta_ns = time - sg_cpu->last_net_boost;
+	if (delta_ns <= SUGOV_NET_BOOST_HOLD_NS)
+		return;
+
+	/* Clear net_boost if the CPU appears to have been idle. */
+	if (delta_ns > 4 * SUGOV_NET_BOOST_HOLD_NS ||
+	    sg_cpu->net_boost <= sg_cpu->net_boost_max >> 2)
+		sg_cpu->net_boost = 0;
+	else
+		sg_cpu->net_boost >>= 1;
+	sg_cpu->last_net_boost = time;
+}
+
+static void sugov_net_boost(struct sugov_cpu *sg_cpu, unsigned long *util,
+			    unsigned long *max)
+{
+	unsigned long boost_util = sg_cpu->net_boost;
+	unsigned long boost_max = sg_cpu->net_boost_max;
+
+	if (!boost_util)
+		return;
+
+	if (*util * boost_max < *max * boost_util) {
+		*util = boost_util;
+		*max = boost_max;
+	}
+}
+
 static void sugov_update_single(struct update_util_data *hook, u64 time,
 				unsigned int flags)
 {
 	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu, update_util);
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
-	struct cpufreq_policy *policy = sg_policy->policy;
 	unsigned long util, max;
 	unsigned int next_f;
 
 	sugov_set_iowait_boost(sg_cpu, time, flags);
+	sugov_set_net_boost(sg_cpu, time, flags);
 	sg_cpu->last_update = time;
 
 	if (!sugov_should_update_freq(sg_policy, time))
 		return;
 
-	if (flags & SCHED_CPUFREQ_RT_DL) {
-		next_f = policy->cpuinfo.max_freq;
-	} else {
-		sugov_get_util(&util, &max);
-		sugov_iowait_boost(sg_cpu, &util, &max);
-		next_f = get_next_freq(sg_cpu, util, max);
-	}
+	sugov_get_util(&util, &max, flags);
+	sugov_iowait_boost(sg_cpu, &util, &max);
+	sugov_net_boost(sg_cpu, &util, &max);
+	next_f = get_next_freq(sg_cpu, util, max);
 	sugov_update_commit(sg_policy, time, next_f);
 }
 
 static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu,
-					   unsigned long util, unsigned long max,
-					   unsigned int flags)
+					   unsigned long util, unsigned long max)
 {
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
 	struct cpufreq_policy *policy = sg_policy->policy;
-	unsigned int max_f = policy->cpuinfo.max_freq;
 	u64 last_freq_update_time = sg_policy->last_freq_update_time;
 	unsigned int j;
 
-	if (flags & SCHED_CPUFREQ_RT_DL)
-		return max_f;
-
 	sugov_iowait_boost(sg_cpu, &util, &max);
+	sugov_net_boost(sg_cpu, &util, &max);
 
 	for_each_cpu(j, policy->cpus) {
 		struct sugov_cpu *j_sg_cpu;
@@ -246,11 +313,9 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu,
 		delta_ns = last_freq_update_time - j_sg_cpu->last_update;
 		if (delta_ns > TICK_NSEC) {
 			j_sg_cpu->iowait_boost = 0;
+			j_sg_cpu->net_boost = 0;
 			continue;
 		}
-		if (j_sg_cpu->flags & SCHED_CPUFREQ_RT_DL)
-			return max_f;
-
 		j_util = j_sg_cpu->util;
 		j_max = j_sg_cpu->max;
 		if (j_util * max > j_max * util) {
@@ -259,6 +324,7 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu,
 		}
 
 		sugov_iowait_boost(j_sg_cpu, &util, &max);
+		sugov_net_boost(j_sg_cpu, &util, &max);
 	}
 
 	return get_next_freq(sg_cpu, util, max);
@@ -272,7 +338,7 @@ static void sugov_update_shared(struct update_util_data *hook, u64 time,
 	unsigned long util, max;
 	unsigned int next_f;
 
-	sugov_get_util(&util, &max);
+	sugov_get_util(&util, &max, flags);
 
 	raw_spin_lock(&sg_policy->update_lock);
 
@@ -281,10 +347,11 @@ static void sugov_update_shared(struct update_util_data *hook, u64 time,
 	sg_cpu->flags = flags;
 
 	sugov_set_iowait_boost(sg_cpu, time, flags);
+	sugov_set_net_boost(sg_cpu, time, flags);
 	sg_cpu->last_update = time;
 
 	if (sugov_should_update_freq(sg_policy, time)) {
-		next_f = sugov_next_freq_shared(sg_cpu, util, max, flags);
+		next_f = sugov_next_freq_shared(sg_cpu, util, max);
 		sugov_update_commit(sg_policy, time, next_f);
 	}
 
@@ -507,6 +574,9 @@ static int sugov_start(struct cpufreq_policy *policy)
 		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
 
 		sg_cpu->sg_policy = sg_policy;
+		sg_cpu->net_boost = 0;
+		sg_cpu->net_boost_max = policy->cpuinfo.max_freq;
+		sg_cpu->last_net_boost = 0;
 		if (policy_is_shared(policy)) {
 			sg_cpu->util = 0;
 			sg_cpu->max = 0;
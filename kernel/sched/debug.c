@@ -622,6 +622,16 @@ do {									\
 	P(cpu_load[2]);
 	P(cpu_load[3]);
 	P(cpu_load[4]);
+#ifdef CONFIG_UCLAMP_TASK
+	SEQ_printf(m, "  .%-30s: %u\n", "uclamp.min",
+		   rq->uclamp[UCLAMP_MIN].value);
+	SEQ_printf(m, "  .%-30s: %u\n", "uclamp.max",
+		   rq->uclamp[UCLAMP_MAX].value);
+	SEQ_printf(m, "  .%-30s: %lu\n", "util_avg",
+		   rq->cfs.avg.util_avg);
+	SEQ_printf(m, "  .%-30s: %lu\n", "util_avg_clamped",
+		   uclamp_util(rq, rq->cfs.avg.util_avg));
+#endif
 #undef P
 #undef PN
 
@@ -869,6 +879,8 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 		"----------\n");
 #define __P(F) \
 	SEQ_printf(m, "%-45s:%21Ld\n", #F, (long long)F)
+#define __PS(S, F) \
+	SEQ_printf(m, "%-45s:%21Ld\n", S, (long long)(F))
 #define P(F) \
 	SEQ_printf(m, "%-45s:%21Ld\n", #F, (long long)p->F)
 #define P_SCHEDSTAT(F) \
@@ -953,11 +965,18 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 #endif
 	P(policy);
 	P(prio);
+#ifdef CONFIG_UCLAMP_TASK
+	__PS("uclamp.min", p->uclamp_req[UCLAMP_MIN].value);
+	__PS("uclamp.max", p->uclamp_req[UCLAMP_MAX].value);
+	__PS("effective uclamp.min", p->uclamp[UCLAMP_MIN].value);
+	__PS("effective uclamp.max", p->uclamp[UCLAMP_MAX].value);
+#endif
 #undef PN_SCHEDSTAT
 #undef PN
 #undef __PN
 #undef P_SCHEDSTAT
 #undef P
+#undef __PS
 #undef __P
 
 	{
@@ -0,0 +1,373 @@
+/*
+ * Test cases for request batching and fairness of the crypto engine.
+ *
+ * This registers "cbc-aes-engine-test", an asynchronous cbc(aes) driver
+ * whose "hardware" is a crypto engine running the synchronous cbc(aes)
+ * implementation of the system on batches of requests. The algorithm
+ * goes through the usual self-tests when registered, and the module
+ * then checks that a bulk user cannot lock out another transform.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/engine.h>
+#include <crypto/internal/skcipher.h>
+
+#define TEST_MAX_BATCH	4
+#define TEST_BULK_REQS	32
+#define TEST_REQ_LEN	256
+
+struct test_engine_ctx {
+	struct crypto_skcipher *fallback;
+};
+
+struct test_engine_reqctx {
+	struct list_head list;
+	struct ablkcipher_request *req;
+	bool enc;
+};
+
+static struct crypto_engine *test_engine;
+static LIST_HEAD(test_batch);
+
+/* the first batch waits for the test to fill the queue */
+static bool test_hold;
+static DECLARE_COMPLETION(test_batch_started);
+static DECLARE_COMPLETION(test_batch_release);
+
+static int test_engine_one_request(struct crypto_engine *engine,
+				   struct ablkcipher_request *req)
+{
+	struct test_engine_reqctx *rctx = ablkcipher_request_ctx(req);
+
+	list_add_tail(&rctx->list, &test_batch);
+	return 0;
+}
+
+static int test_engine_do_batch(struct crypto_engine *engine)
+{
+	struct test_engine_reqctx *rctx, *tmp;
+
+	if (test_hold) {
+		test_hold = false;
+		complete(&test_batch_started);
+		wait_for_completion(&test_batch_release);
+	}
+
+	list_for_each_entry_safe(rctx, tmp, &test_batch, list) {
+		struct ablkcipher_request *req = rctx->req;
+		struct test_engine_ctx *ctx = crypto_tfm_ctx(req->base.tfm);
+		SKCIPHER_REQUEST_ON_STACK(subreq, ctx->fallback);
+		int err;
+
+		list_del(&rctx->list);
+
+		skcipher_request_set_tfm(subreq, ctx->fallback);
+		skcipher_request_set_callback(subreq, 0, NULL, NULL);
+		skcipher_request_set_crypt(subreq, req->src, req->dst,
+					   req->nbytes, req->info);
+		if (rctx->enc)
+			err = crypto_skcipher_encrypt(subreq);
+		else
+			err = crypto_skcipher_decrypt(subreq);
+		skcipher_request_zero(subreq);
+
+		crypto_finalize_cipher_request(engine, req, err);
+	}
+
+	return 0;
+}
+
+static int test_engine_crypt(struct ablkcipher_request *req, bool enc)
+{
+	struct test_engine_reqctx *rctx = ablkcipher_request_ctx(req);
+
+	rctx->req = req;
+	rctx->enc = enc;
+	return crypto_transfer_cipher_request_to_engine(test_engine, req);
+}
+
+static int test_engine_encrypt(struct ablkcipher_request *req)
+{
+	return test_engine_crypt(req, true);
+}
+
+static int test_engine_decrypt(struct ablkcipher_request *req)
+{
+	return test_engine_crypt(req, false);
+}
+
+static int test_engine_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
+			      unsigned int keylen)
+{
+	struct test_engine_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	int ret;
+
+	crypto_skcipher_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+	crypto_skcipher_set_flags(ctx->fallback, crypto_ablkcipher_get_flags(tfm) &
+				  CRYPTO_TFM_REQ_MASK);
+	ret = crypto_skcipher_setkey(ctx->fallback, key, keylen);
+	crypto_ablkcipher_set_flags(tfm, crypto_skcipher_get_flags(ctx->fallback) &
+				    CRYPTO_TFM_RES_MASK);
+	return ret;
+}
+
+static int test_engine_cra_init(struct crypto_tfm *tfm)
+{
+	struct test_engine_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_skcipher("cbc(aes)", 0,
+					      CRYPTO_ALG_ASYNC);
+	if (IS_ERR(ctx->fallback))
+		return PTR_ERR(ctx->fallback);
+
+	tfm->crt_ablkcipher.reqsize = sizeof(struct test_engine_reqctx);
+	return 0;
+}
+
+static void test_engine_cra_exit(struct crypto_tfm *tfm)
+{
+	struct test_engine_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_skcipher(ctx->fallback);
+}
+
+static struct crypto_alg test_engine_alg = {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-engine-test",
+	.cra_priority		= 0,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER | CRYPTO_ALG_ASYNC,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct test_engine_ctx),
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= test_engine_cra_init,
+	.cra_exit		= test_engine_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= test_engine_setkey,
+		.encrypt	= test_engine_encrypt,
+		.decrypt	= test_engine_decrypt,
+	},
+};
+
+static unsigned total_tests;
+static unsigned failed_tests;
+
+struct test_req {
+	struct skcipher_request *req;
+	struct scatterlist sg;
+	u8 iv[AES_BLOCK_SIZE];
+	u8 buf[TEST_REQ_LEN];
+	u8 expect[TEST_REQ_LEN];
+	int err;
+	int order;
+};
+
+static const u8 test_key[AES_KEYSIZE_128] = "engine test key";
+
+static atomic_t test_done_count;
+static DECLARE_COMPLETION(test_all_done);
+static int test_nr_reqs;
+
+static void test_req_done(struct crypto_async_request *areq, int err)
+{
+	struct test_req *t = areq->data;
+
+	if (err == -EINPROGRESS)
+		return;
+
+	t->err = err;
+	t->order = atomic_inc_return(&test_done_count);
+	if (t->order == test_nr_reqs)
+		complete(&test_all_done);
+}
+
+static void test_check(bool ok, const char *what)
+{
+	total_tests++;
+	if (!ok) {
+		pr_err("%s\n", what);
+		failed_tests++;
+	}
+}
+
+static int test_submit(struct crypto_skcipher *tfm, struct crypto_skcipher *ref,
+		       struct test_req *t, u32 flags, int i)
+{
+	SKCIPHER_REQUEST_ON_STACK(refreq, ref);
+	struct scatterlist sg;
+	u8 iv[AES_BLOCK_SIZE];
+	int err;
+
+	memset(t->buf, i, TEST_REQ_LEN);
+	memset(t->iv, ~i, AES_BLOCK_SIZE);
+	memcpy(t->expect, t->buf, TEST_REQ_LEN);
+	memcpy(iv, t->iv, AES_BLOCK_SIZE);
+
+	sg_init_one(&sg, t->expect, TEST_REQ_LEN);
+	skcipher_request_set_tfm(refreq, ref);
+	skcipher_request_set_callback(refreq, 0, NULL, NULL);
+	skcipher_request_set_crypt(refreq, &sg, &sg, TEST_REQ_LEN, iv);
+	err = crypto_skcipher_encrypt(refreq);
+	skcipher_request_zero(refreq);
+	if (err)
+		return err;
+
+	t->req = skcipher_request_alloc(tfm, GFP_KERNEL);
+	if (!t->req)
+		return -ENOMEM;
+	sg_init_one(&t->sg, t->buf, TEST_REQ_LEN);
+	skcipher_request_set_callback(t->req, flags, test_req_done, t);
+	skcipher_request_set_crypt(t->req, &t->sg, &t->sg, TEST_REQ_LEN,
+				   t->iv);
+	return crypto_skcipher_encrypt(t->req);
+}
+
+static void test_engine_fairness(void)
+{
+	struct crypto_skcipher *bulk, *lat, *ref;
+	struct test_req *t;
+	int i, err;
+
+	t = kcalloc(TEST_BULK_REQS + 1, sizeof(*t), GFP_KERNEL);
+	bulk = crypto_alloc_skcipher("cbc-aes-engine-test", 0, 0);
+	lat = crypto_alloc_skcipher("cbc-aes-engine-test", 0, 0);
+	ref = crypto_alloc_skcipher("cbc(aes)", 0, CRYPTO_ALG_ASYNC);
+	if (!t || IS_ERR(bulk) || IS_ERR(lat) || IS_ERR(ref)) {
+		test_check(false, "could not allocate transforms");
+		goto out;
+	}
+	if (crypto_skcipher_setkey(bulk, test_key, sizeof(test_key)) ||
+	    crypto_skcipher_setkey(lat, test_key, sizeof(test_key)) ||
+	    crypto_skcipher_setkey(ref, test_key, sizeof(test_key))) {
+		test_check(false, "setkey failed");
+		goto out;
+	}
+
+	test_nr_reqs = TEST_BULK_REQS + 1;
+	atomic_set(&test_done_count, 0);
+
+	/* keep the engine busy with the first request */
+	test_hold = true;
+	err = test_submit(bulk, ref, &t[0], CRYPTO_TFM_REQ_MAY_BACKLOG, 0);
+	if (err != -EINPROGRESS) {
+		test_check(false, "first bulk request not queued");
+		goto out;
+	}
+	wait_for_completion(&test_batch_started);
+
+	/* then fill the queue and its backlog */
+	for (i = 1; i < TEST_BULK_REQS; i++) {
+		err = test_submit(bulk, ref, &t[i],
+				  CRYPTO_TFM_REQ_MAY_BACKLOG, i);
+		if (err != -EINPROGRESS && err != -EBUSY) {
+			test_check(false, "bulk request not queued");
+			break;
+		}
+	}
+
+	/* a request of another transform must still get in, and first */
+	err = test_submit(lat, ref, &t[TEST_BULK_REQS], 0, TEST_BULK_REQS);
+	test_check(err == -EINPROGRESS, "request rejected behind bulk user");
+
+	complete(&test_batch_release);
+	if (!wait_for_completion_timeout(&test_all_done, 10 * HZ)) {
+		test_check(false, "requests not completed");
+		goto out;
+	}
+
+	test_check(t[TEST_BULK_REQS].order <= 1 + TEST_MAX_BATCH,
+		   "request not served before the bulk backlog");
+	for (i = 0; i <= TEST_BULK_REQS; i++) {
+		test_check(!t[i].err, "request failed");
+		test_check(!memcmp(t[i].buf, t[i].expect, TEST_REQ_LEN),
+			   "wrong result");
+	}
+
+	test_check(test_engine->stats.max_batch == TEST_MAX_BATCH,
+		   "requests not batched");
+	test_check(test_engine->stats.requests >= TEST_BULK_REQS + 1,
+		   "requests not accounted");
+
+out:
+	if (t)
+		for (i = 0; i <= TEST_BULK_REQS; i++)
+			skcipher_request_free(t[i].req);
+	if (!IS_ERR_OR_NULL(ref))
+		crypto_free_skcipher(ref);
+	if (!IS_ERR_OR_NULL(lat))
+		crypto_free_skcipher(lat);
+	if (!IS_ERR_OR_NULL(bulk))
+		crypto_free_skcipher(bulk);
+	kfree(t);
+}
+
+static struct platform_device *test_pdev;
+
+static int __init test_crypto_engine_init(void)
+{
+	int ret;
+
+	test_pdev = platform_device_register_simple(KBUILD_MODNAME, -1,
+						    NULL, 0);
+	if (IS_ERR(test_pdev))
+		return PTR_ERR(test_pdev);
+
+	test_engine = crypto_engine_alloc_init(&test_pdev->dev, false);
+	if (!test_engine) {
+		ret = -ENOMEM;
+		goto err_pdev;
+	}
+	test_engine->cipher_one_request = test_engine_one_request;
+	test_engine->do_batch = test_engine_do_batch;
+	test_engine->max_batch = TEST_MAX_BATCH;
+
+	ret = crypto_engine_start(test_engine);
+	if (ret)
+		goto err_engine;
+
+	ret = crypto_register_alg(&test_engine_alg);
+	if (ret)
+		goto err_engine;
+
+	test_engine_fairness();
+
+	if (failed_tests == 0)
+		pr_info("all %u tests passed\n", total_tests);
+	else
+		pr_err("failed %u out of %u tests\n", failed_tests, total_tests);
+
+	if (!failed_tests)
+		return 0;
+
+	ret = -EINVAL;
+	crypto_unregister_alg(&test_engine_alg);
+err_engine:
+	crypto_engine_exit(test_engine);
+err_pdev:
+	platform_device_unregister(test_pdev);
+	return ret;
+}
+module_init(test_crypto_engine_init);
+
+static void __exit test_crypto_engine_exit(void)
+{
+	crypto_unregister_alg(&test_engine_alg);
+	crypto_engine_exit(test_engine);
+	platform_device_unregister(test_pdev);
+}
+module_exit(test_crypto_engine_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,120 @@
+/*
+ * Test cases for the atomic PM QoS request update path.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/init.h>
+#include <linux/irqflags.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/notifier.h>
+#include <linux/pm_qos.h>
+
+static unsigned total_tests __initdata;
+static unsigned failed_tests __initdata;
+
+static s32 notified_value __initdata;
+static DECLARE_COMPLETION(notified);
+
+static int __init test_pm_qos_notify(struct notifier_block *nb,
+				     unsigned long value, void *unused)
+{
+	notified_value = value;
+	complete(&notified);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block test_pm_qos_nb __initdata = {
+	.notifier_call = test_pm_qos_notify,
+};
+
+static void __init test_pm_qos_check(const char *what, s32 expected)
+{
+	s32 value = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+
+	total_tests++;
+	if (value != expected) {
+		pr_err("%s: target %d, expected %d\n", what, value, expected);
+		failed_tests++;
+	}
+}
+
+static void __init test_pm_qos_update(struct pm_qos_request *req, s32 value)
+{
+	unsigned long flags;
+
+	/* the update must work with interrupts disabled */
+	local_irq_save(flags);
+	pm_qos_update_request_atomic(req, value);
+	local_irq_restore(flags);
+}
+
+static int __init test_pm_qos_init(void)
+{
+	struct pm_qos_request req1 = {}, req2 = {};
+	s32 base;
+
+	pm_qos_add_request(&req1, PM_QOS_CPU_DMA_LATENCY,
+			   PM_QOS_DEFAULT_VALUE);
+	pm_qos_add_request(&req2, PM_QOS_CPU_DMA_LATENCY,
+			   PM_QOS_DEFAULT_VALUE);
+	pm_qos_add_notifier(PM_QOS_CPU_DMA_LATENCY, &test_pm_qos_nb);
+
+	/* other requests in the system may already be tighter than ours */
+	base = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+
+	test_pm_qos_update(&req1, 10);
+	test_pm_qos_check("tighten", min(base, 10));
+
+	total_tests++;
+	if (base > 10 &&
+	    (!wait_for_completion_timeout(&notified, HZ) ||
+	     notified_value != 10)) {
+		pr_err("notifier not called with the new target\n");
+		failed_tests++;
+	}
+
+	test_pm_qos_update(&req2, 5);
+	test_pm_qos_check("tighten more", min(base, 5));
+
+	test_pm_qos_update(&req2, PM_QOS_DEFAULT_VALUE);
+	test_pm_qos_check("relax", min(base, 10));
+
+	test_pm_qos_update(&req1, 10);
+	test_pm_qos_check("same value", min(base, 10));
+
+	test_pm_qos_update(&req1, PM_QOS_DEFAULT_VALUE);
+	test_pm_qos_check("default", base);
+
+	/* mixing with the sleeping variant */
+	pm_qos_update_request(&req1, 20);
+	test_pm_qos_update(&req2, 30);
+	test_pm_qos_check("mixed", min(base, 20));
+
+	pm_qos_remove_request(&req2);
+	pm_qos_remove_request(&req1);
+	test_pm_qos_check("removed", base);
+
+	/* let the deferred notifications run before unregistering */
+	while (wait_for_completion_timeout(&notified, HZ / 10))
+		;
+	pm_qos_remove_notifier(PM_QOS_CPU_DMA_LATENCY, &test_pm_qos_nb);
+
+	if (failed_tests == 0)
+		pr_info("all %u tests passed\n", total_tests);
+	else
+		pr_err("failed %u out of %u tests\n", failed_tests, total_tests);
+
+	return failed_tests ? -EINVAL : 0;
+}
+module_init(test_pm_qos_init);
+
+static void __exit test_pm_qos_exit(void)
+{
+	/* do nothing */
+}
+module_exit(test_pm_qos_exit);
+
+MODULE_LICENSE("GPL");
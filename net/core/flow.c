@@ -25,6 +25,7 @@
 #include <linux/atomic.h>
 #include <linux/security.h>
 #include <net/net_namespace.h>
+#include <net/xfrm.h>
 
 struct flow_cache_entry {
 	union {
@@ -254,10 +255,10 @@ flow_cache_lookup(struct net *net, const struct flowi *key, u16 family, u8 dir,
 	} else if (likely(fle->genid == atomic_read(&net->xfrm.flow_cache_genid))) {
 		flo = fle->object;
 		if (!flo)
-			goto ret_object;
+			goto hit;
 		flo = flo->ops->get(flo);
 		if (flo)
-			goto ret_object;
+			goto hit;
 	} else if (fle->object) {
 	        flo = fle->object;
 	        flo->ops->delete(flo);
@@ -265,6 +266,7 @@ flow_cache_lookup(struct net *net, const struct flowi *key, u16 family, u8 dir,
 	}
 
 nocache:
+	XFRM_INC_STATS(net, LINUX_MIB_XFRMFLOWCACHEMISS);
 	flo = NULL;
 	if (fle) {
 		flo = fle->object;
@@ -281,6 +283,9 @@ flow_cache_lookup(struct net *net, const struct flowi *key, u16 family, u8 dir,
 		if (!IS_ERR_OR_NULL(flo))
 			flo->ops->delete(flo);
 	}
+	goto ret_object;
+hit:
+	XFRM_INC_STATS(net, LINUX_MIB_XFRMFLOWCACHEHIT);
 ret_object:
 	local_bh_enable();
 	return flo;
@@ -1607,7 +1607,11 @@ void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 		sk->sk_route_caps |= NETIF_F_GSO_SOFTWARE;
 	sk->sk_route_caps &= ~sk->sk_route_nocaps;
 	if (sk_can_gso(sk)) {
-		if (dst->header_len) {
+		/* IPsec bundles segment GSO packets in software before
+		 * encryption (see xfrm_output_gso()), so keep GSO enabled
+		 * for them and only refuse it for other encapsulations.
+		 */
+		if (dst->header_len && !dst_xfrm(dst)) {
 			sk->sk_route_caps &= ~NETIF_F_GSO_MASK;
 		} else {
 			sk->sk_route_caps |= NETIF_F_SG | NETIF_F_HW_CSUM;
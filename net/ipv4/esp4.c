@@ -30,17 +30,30 @@ struct esp_output_extra {
 
 #define ESP_SKB_CB(__skb) ((struct esp_skb_cb *)&((__skb)->cb[0]))
 
-static u32 esp4_get_mtu(struct xfrm_state *x, int mtu);
-
 /*
- * Allocate an AEAD request structure with extra space for SG and IV.
- *
- * For alignment considerations the IV is placed at the front, followed
- * by the request and finally the SG list.
- *
- * TODO: Use spare space in skb for this where possible.
+ * Each SA keeps a small per-CPU cache of request buffers large enough
+ * for packets of up to ESP_TMP_POOL_FRAGS fragments, so that the common
+ * small packet case does not go through the slab allocator twice. It
+ * holds a full output batch.
  */
-static void *esp_alloc_tmp(struct crypto_aead *aead, int nfrags, int extralen)
+#define ESP_TMP_POOL_SIZE	XFRM_OUTPUT_BATCH
+#define ESP_TMP_POOL_FRAGS	4
+
+struct esp_tmp_pool {
+	unsigned int count;
+	void *tmp[ESP_TMP_POOL_SIZE];
+};
+
+struct esp_data {
+	struct crypto_aead *aead;
+	unsigned int pool_len;
+	struct esp_tmp_pool __percpu *pool;
+};
+
+static u32 esp4_get_mtu(struct xfrm_state *x, int mtu);
+
+static unsigned int esp_tmp_len(struct crypto_aead *aead, int nfrags,
+				int extralen)
 {
 	unsigned int len;
 
@@ -59,7 +72,71 @@ static void *esp_alloc_tmp(struct crypto_aead *aead, int nfrags, int extralen)
 
 	len += sizeof(struct scatterlist) * nfrags;
 
-	return kmalloc(len, GFP_ATOMIC);
+	return len;
+}
+
+/*
+ * Allocate an AEAD request structure with extra space for SG and IV.
+ *
+ * For alignment considerations the IV is placed at the front, followed
+ * by the request and finally the SG list.
+ *
+ * Small requests are served from the per-SA pool when possible.
+ *
+ * TODO: Use spare space in skb for this where possible.
+ */
+static void *esp_alloc_tmp(struct xfrm_state *x, int nfrags, int extralen)
+{
+	struct esp_data *esp = x->data;
+	struct esp_tmp_pool *pool;
+	unsigned long flags;
+	void *tmp = NULL;
+
+	if (nfrags > ESP_TMP_POOL_FRAGS ||
+	    extralen > sizeof(struct esp_output_extra))
+		return kmalloc(esp_tmp_len(esp->aead, nfrags, extralen),
+			       GFP_ATOMIC);
+
+	local_irq_save(flags);
+	pool = this_cpu_ptr(esp->pool);
+	if (pool->count)
+		tmp = pool->tmp[--pool->count];
+	local_irq_restore(flags);
+
+	return tmp ?: kmalloc(esp->pool_len, GFP_ATOMIC);
+}
+
+static void esp_free_tmp(struct xfrm_state *x, void *tmp)
+{
+	struct esp_data *esp = x->data;
+	struct esp_tmp_pool *pool;
+	unsigned long flags;
+
+	if (!tmp || ksize(tmp) < esp->pool_len)
+		goto free;
+
+	local_irq_save(flags);
+	pool = this_cpu_ptr(esp->pool);
+	if (pool->count < ESP_TMP_POOL_SIZE) {
+		pool->tmp[pool->count++] = tmp;
+		tmp = NULL;
+	}
+	local_irq_restore(flags);
+
+free:
+	kfree(tmp);
+}
+
+static void esp_drain_tmp_pool(struct esp_data *esp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct esp_tmp_pool *pool = per_cpu_ptr(esp->pool, cpu);
+
+		while (pool->count)
+			kfree(pool->tmp[--pool->count]);
+	}
 }
 
 static inline void *esp_tmp_extra(void *tmp)
@@ -96,7 +173,7 @@ static void esp_output_done(struct crypto_async_request *base, int err)
 {
 	struct sk_buff *skb = base->data;
 
-	kfree(ESP_SKB_CB(skb)->tmp);
+	esp_free_tmp(skb_dst(skb)->xfrm, ESP_SKB_CB(skb)->tmp);
 	xfrm_output_resume(skb, err);
 }
 
@@ -128,10 +205,13 @@ static void esp_output_done_esn(struct crypto_async_request *base, int err)
 	esp_output_done(base, err);
 }
 
-static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
+/* Builds the ESP packet and the AEAD request which encrypts it */
+static int esp_output_head(struct xfrm_state *x, struct sk_buff *skb,
+			   struct aead_request **reqp)
 {
 	int err;
 	struct esp_output_extra *extra;
+	struct esp_data *esp = x->data;
 	struct ip_esp_hdr *esph;
 	struct crypto_aead *aead;
 	struct aead_request *req;
@@ -153,7 +233,7 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 
 	/* skb is pure payload to encrypt */
 
-	aead = x->data;
+	aead = esp->aead;
 	alen = crypto_aead_authsize(aead);
 	ivlen = crypto_aead_ivsize(aead);
 
@@ -183,7 +263,7 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 		assoclen += sizeof(__be32);
 	}
 
-	tmp = esp_alloc_tmp(aead, nfrags, extralen);
+	tmp = esp_alloc_tmp(x, nfrags, extralen);
 	if (!tmp) {
 		err = -ENOMEM;
 		goto error;
@@ -283,11 +363,19 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	       min(ivlen, 8));
 
 	ESP_SKB_CB(skb)->tmp = tmp;
-	err = crypto_aead_encrypt(req);
+	*reqp = req;
+	return 0;
+
+error:
+	return err;
+}
 
+/* Finishes a packet whose encryption did not go asynchronous */
+static int esp_output_tail(struct xfrm_state *x, struct sk_buff *skb, int err)
+{
 	switch (err) {
 	case -EINPROGRESS:
-		goto error;
+		return err;
 
 	case -EBUSY:
 		err = NET_XMIT_DROP;
@@ -298,17 +386,49 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 			esp_output_restore_header(skb);
 	}
 
-	kfree(tmp);
-
-error:
+	esp_free_tmp(x, ESP_SKB_CB(skb)->tmp);
 	return err;
 }
 
+static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct aead_request *req;
+	int err;
+
+	err = esp_output_head(x, skb, &req);
+	if (err)
+		return err;
+
+	return esp_output_tail(x, skb, crypto_aead_encrypt(req));
+}
+
+/* Encrypts the packets of a batch with one crypto call */
+static void esp_output_batch(struct xfrm_state *x, struct sk_buff **skbs,
+			     int *errs, unsigned int nr)
+{
+	struct aead_request *reqs[XFRM_OUTPUT_BATCH];
+	int cerrs[XFRM_OUTPUT_BATCH];
+	u8 idx[XFRM_OUTPUT_BATCH];
+	unsigned int i, n = 0;
+
+	for (i = 0; i < nr; i++) {
+		errs[i] = esp_output_head(x, skbs[i], &reqs[n]);
+		if (!errs[i])
+			idx[n++] = i;
+	}
+
+	crypto_aead_encrypt_batch(reqs, cerrs, n);
+
+	for (i = 0; i < n; i++)
+		errs[idx[i]] = esp_output_tail(x, skbs[idx[i]], cerrs[i]);
+}
+
 static int esp_input_done2(struct sk_buff *skb, int err)
 {
 	const struct iphdr *iph;
 	struct xfrm_state *x = xfrm_input_state(skb);
-	struct crypto_aead *aead = x->data;
+	struct esp_data *esp = x->data;
+	struct crypto_aead *aead = esp->aead;
 	int alen = crypto_aead_authsize(aead);
 	int hlen = sizeof(struct ip_esp_hdr) + crypto_aead_ivsize(aead);
 	int elen = skb->len - hlen;
@@ -316,7 +436,7 @@ static int esp_input_done2(struct sk_buff *skb, int err)
 	u8 nexthdr[2];
 	int padlen;
 
-	kfree(ESP_SKB_CB(skb)->tmp);
+	esp_free_tmp(x, ESP_SKB_CB(skb)->tmp);
 
 	if (unlikely(err))
 		goto out;
@@ -417,7 +537,8 @@ static void esp_input_done_esn(struct crypto_async_request *base, int err)
 static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 {
 	struct ip_esp_hdr *esph;
-	struct crypto_aead *aead = x->data;
+	struct esp_data *esp = x->data;
+	struct crypto_aead *aead = esp->aead;
 	struct aead_request *req;
 	struct sk_buff *trailer;
 	int ivlen = crypto_aead_ivsize(aead);
@@ -452,7 +573,7 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 	}
 
 	err = -ENOMEM;
-	tmp = esp_alloc_tmp(aead, nfrags, seqhilen);
+	tmp = esp_alloc_tmp(x, nfrags, seqhilen);
 	if (!tmp)
 		goto out;
 
@@ -501,7 +622,8 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 
 static u32 esp4_get_mtu(struct xfrm_state *x, int mtu)
 {
-	struct crypto_aead *aead = x->data;
+	struct esp_data *esp = x->data;
+	struct crypto_aead *aead = esp->aead;
 	u32 blksize = ALIGN(crypto_aead_blocksize(aead), 4);
 	unsigned int net_adj;
 
@@ -554,17 +676,23 @@ static int esp4_err(struct sk_buff *skb, u32 info)
 
 static void esp_destroy(struct xfrm_state *x)
 {
-	struct crypto_aead *aead = x->data;
+	struct esp_data *esp = x->data;
 
-	if (!aead)
+	if (!esp)
 		return;
 
-	crypto_free_aead(aead);
+	if (esp->pool) {
+		esp_drain_tmp_pool(esp);
+		free_percpu(esp->pool);
+	}
+	crypto_free_aead(esp->aead);
+	kfree(esp);
 }
 
 static int esp_init_aead(struct xfrm_state *x)
 {
 	char aead_name[CRYPTO_MAX_ALG_NAME];
+	struct esp_data *esp = x->data;
 	struct crypto_aead *aead;
 	int err;
 
@@ -578,7 +706,7 @@ static int esp_init_aead(struct xfrm_state *x)
 	if (IS_ERR(aead))
 		goto error;
 
-	x->data = aead;
+	esp->aead = aead;
 
 	err = crypto_aead_setkey(aead, x->aead->alg_key,
 				 (x->aead->alg_key_len + 7) / 8);
@@ -595,6 +723,7 @@ static int esp_init_aead(struct xfrm_state *x)
 
 static int esp_init_authenc(struct xfrm_state *x)
 {
+	struct esp_data *esp = x->data;
 	struct crypto_aead *aead;
 	struct crypto_authenc_key_param *param;
 	struct rtattr *rta;
@@ -633,7 +762,7 @@ static int esp_init_authenc(struct xfrm_state *x)
 	if (IS_ERR(aead))
 		goto error;
 
-	x->data = aead;
+	esp->aead = aead;
 
 	keylen = (x->aalg ? (x->aalg->alg_key_len + 7) / 8 : 0) +
 		 (x->ealg->alg_key_len + 7) / 8 + RTA_SPACE(sizeof(*param));
@@ -689,10 +818,15 @@ static int esp_init_authenc(struct xfrm_state *x)
 static int esp_init_state(struct xfrm_state *x)
 {
 	struct crypto_aead *aead;
+	struct esp_data *esp;
 	u32 align;
 	int err;
 
-	x->data = NULL;
+	esp = kzalloc(sizeof(*esp), GFP_KERNEL);
+	if (!esp)
+		return -ENOMEM;
+
+	x->data = esp;
 
 	if (x->aead)
 		err = esp_init_aead(x);
@@ -702,7 +836,15 @@ static int esp_init_state(struct xfrm_state *x)
 	if (err)
 		goto error;
 
-	aead = x->data;
+	aead = esp->aead;
+
+	err = -ENOMEM;
+	esp->pool = alloc_percpu(struct esp_tmp_pool);
+	if (!esp->pool)
+		goto error;
+	esp->pool_len = esp_tmp_len(aead, ESP_TMP_POOL_FRAGS,
+				    sizeof(struct esp_output_extra));
+	err = 0;
 
 	x->props.header_len = sizeof(struct ip_esp_hdr) +
 			      crypto_aead_ivsize(aead);
@@ -747,7 +889,8 @@ static const struct xfrm_type esp_type =
 	.destructor	= esp_destroy,
 	.get_mtu	= esp4_get_mtu,
 	.input		= esp_input,
-	.output		= esp_output
+	.output		= esp_output,
+	.output_batch	= esp_output_batch,
 };
 
 static struct xfrm4_protocol esp4_protocol = {
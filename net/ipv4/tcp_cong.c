@@ -331,8 +331,12 @@ int tcp_set_allowed_congestion_control(char *val)
 	return ret;
 }
 
-/* Change congestion control for socket */
-int tcp_set_congestion_control(struct sock *sk, const char *name)
+/* Change congestion control for socket. @load is false when called from
+ * a BPF sock_ops program, which may run in softirq context: the module is
+ * not autoloaded and the capability check was done when the program was
+ * attached.
+ */
+int tcp_set_congestion_control(struct sock *sk, const char *name, bool load)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	const struct tcp_congestion_ops *ca;
@@ -342,21 +346,31 @@ int tcp_set_congestion_control(struct sock *sk, const char *name)
 		return -EPERM;
 
 	rcu_read_lock();
-	ca = __tcp_ca_find_autoload(name);
+	if (load)
+		ca = __tcp_ca_find_autoload(name);
+	else
+		ca = tcp_ca_find(name);
 	/* No change asking for existing value */
 	if (ca == icsk->icsk_ca_ops) {
 		icsk->icsk_ca_setsockopt = 1;
 		goto out;
 	}
-	if (!ca)
+	if (!ca) {
 		err = -ENOENT;
-	else if (!((ca->flags & TCP_CONG_NON_RESTRICTED) ||
-		   ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN)))
+	} else if (load && !((ca->flags & TCP_CONG_NON_RESTRICTED) ||
+			   ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))) {
 		err = -EPERM;
-	else if (!try_module_get(ca->owner))
+	} else if (!try_module_get(ca->owner)) {
 		err = -EBUSY;
-	else
+	} else if (!load && sk->sk_state == TCP_SYN_SENT) {
+		/* tcp_finish_connect() initializes the new ops */
+		module_put(icsk->icsk_ca_ops->owner);
+		icsk->icsk_ca_ops = ca;
+		icsk->icsk_ca_setsockopt = 1;
+		memset(icsk->icsk_ca_priv, 0, sizeof(icsk->icsk_ca_priv));
+	} else {
 		tcp_reinit_congestion_control(sk, ca);
+	}
  out:
 	rcu_read_unlock();
 	return err;
@@ -145,8 +145,12 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 			set_bit(e->id, map->members);
 			return -IPSET_ERR_EXIST;
 		}
-		/* Element is re-added, cleanup extensions */
-		ip_set_ext_destroy(set, x);
+		/* Element is re-added, the extensions are set again below
+		 * and its per-CPU counters are kept
+		 */
+	} else if (SET_WITH_COUNTER(set) &&
+		   ip_set_alloc_counter(ext_counter(x, set))) {
+		return -ENOMEM;
 	}
 
 	if (SET_WITH_TIMEOUT(set))
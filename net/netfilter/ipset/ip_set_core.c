@@ -324,15 +324,63 @@ ip_set_get_ipaddr6(struct nlattr *nla, union nf_inet_addr *ipaddr)
 }
 EXPORT_SYMBOL_GPL(ip_set_get_ipaddr6);
 
+static void
+ip_set_counter_rcu_free(struct rcu_head *head)
+{
+	struct ip_set_counter_rcu *c =
+		container_of(head, struct ip_set_counter_rcu, rcu);
+
+	free_percpu(c->pcpu);
+	kfree(c);
+}
+
+/* Called with the set lock held, before a new element is made visible.
+ * Elements of sets with counters are not added without them.
+ */
+int
+ip_set_alloc_counter(struct ip_set_counter *counter)
+{
+	struct ip_set_counter_rcu *c;
+
+	if (rcu_access_pointer(counter->c))
+		return 0;
+	c = kmalloc(sizeof(*c), GFP_ATOMIC);
+	if (unlikely(!c))
+		return -ENOMEM;
+	c->pcpu = alloc_percpu_gfp(struct ip_set_counter_pcpu, GFP_ATOMIC);
+	if (unlikely(!c->pcpu)) {
+		kfree(c);
+		return -ENOMEM;
+	}
+	atomic64_set(&counter->bytes, 0);
+	atomic64_set(&counter->packets, 0);
+	rcu_assign_pointer(counter->c, c);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ip_set_alloc_counter);
+
+void
+ip_set_counter_free(struct ip_set_counter *counter)
+{
+	struct ip_set_counter_rcu *c = rcu_dereference_protected(counter->c, 1);
+
+	if (unlikely(!c))
+		return;
+	RCU_INIT_POINTER(counter->c, NULL);
+	call_rcu(&c->rcu, ip_set_counter_rcu_free);
+}
+EXPORT_SYMBOL_GPL(ip_set_counter_free);
+
 typedef void (*destroyer)(void *);
 /* ipset data extension types, in size order */
 
 const struct ip_set_ext_type ip_set_extensions[] = {
 	[IPSET_EXT_ID_COUNTER] = {
-		.type	= IPSET_EXT_COUNTER,
-		.flag	= IPSET_FLAG_WITH_COUNTERS,
-		.len	= sizeof(struct ip_set_counter),
-		.align	= __alignof__(struct ip_set_counter),
+		.type	 = IPSET_EXT_COUNTER | IPSET_EXT_DESTROY,
+		.flag	 = IPSET_FLAG_WITH_COUNTERS,
+		.len	 = sizeof(struct ip_set_counter),
+		.align	 = __alignof__(struct ip_set_counter),
+		.destroy = (destroyer) ip_set_counter_free,
 	},
 	[IPSET_EXT_ID_TIMEOUT] = {
 		.type	= IPSET_EXT_TIMEOUT,
@@ -589,6 +637,18 @@ ip_set_add(ip_set_id_t index, const struct sk_buff *skb,
 	    !(opt->family == set->family || set->family == NFPROTO_UNSPEC))
 		return -IPSET_ERR_TYPE_MISMATCH;
 
+	opt->cmdflags &= ~IPSET_FLAG_UNLOCKED;
+	if (set->variant->unlocked_add) {
+		/* Existing elements are refreshed without the set lock */
+		opt->cmdflags |= IPSET_FLAG_UNLOCKED;
+		rcu_read_lock_bh();
+		ret = set->variant->kadt(set, skb, par, IPSET_ADD, opt);
+		rcu_read_unlock_bh();
+		opt->cmdflags &= ~IPSET_FLAG_UNLOCKED;
+		if (ret != -ENOENT)
+			return ret;
+	}
+
 	spin_lock_bh(&set->lock);
 	ret = set->variant->kadt(set, skb, par, IPSET_ADD, opt);
 	spin_unlock_bh(&set->lock);
@@ -2095,6 +2155,8 @@ ip_set_fini(void)
 	unregister_pernet_subsys(&ip_set_net_ops);
 	nf_unregister_sockopt(&so_set);
 	nfnetlink_subsys_unregister(&ip_set_netlink_subsys);
+	/* Wait for the per-CPU counters freed by call_rcu() */
+	rcu_barrier();
 	pr_debug("these are the famous last words\n");
 }
 
@@ -194,6 +194,7 @@ htable_bits(u32 hashsize)
 #undef mtype
 
 #undef mtype_add
+#undef mtype_add_unlocked
 #undef mtype_del
 #undef mtype_test_cidrs
 #undef mtype_test
@@ -236,6 +237,7 @@ htable_bits(u32 hashsize)
 #define mtype			MTYPE
 
 #define mtype_add		IPSET_TOKEN(MTYPE, _add)
+#define mtype_add_unlocked	IPSET_TOKEN(MTYPE, _add_unlocked)
 #define mtype_del		IPSET_TOKEN(MTYPE, _del)
 #define mtype_test_cidrs	IPSET_TOKEN(MTYPE, _test_cidrs)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
@@ -698,6 +700,56 @@ mtype_resize(struct ip_set *set, bool retried)
 	goto out;
 }
 
+/* Look up the element to be added from the packet path, without the set
+ * lock. An existing, not timed out element is reported or, when asked for
+ * by IPSET_FLAG_EXIST, its timeout, counter and skbinfo extensions are
+ * refreshed in place. Everything else, including the cases which would
+ * need memory allocated or freed, is left to the locked path by -ENOENT.
+ */
+static int
+mtype_add_unlocked(struct ip_set *set, const struct mtype_elem *d,
+		   const struct ip_set_ext *ext, u32 flags)
+{
+	struct htype *h = set->data;
+	struct htable *t;
+	struct mtype_elem *data;
+	struct hbucket *n;
+	u32 key, multi = 0;
+	int i;
+
+	if (SET_WITH_COMMENT(set))
+		return -ENOENT;
+	t = rcu_dereference_bh(h->table);
+	key = HKEY(d, h->initval, t->htable_bits);
+	n = rcu_dereference_bh(hbucket(t, key));
+	if (!n)
+		return -ENOENT;
+	for (i = 0; i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
+		data = ahash_data(n, i, set->dsize);
+		if (!mtype_data_equal(data, d, &multi))
+			continue;
+		if (SET_WITH_TIMEOUT(set) &&
+		    ip_set_timeout_expired(ext_timeout(data, set)))
+			return -ENOENT;
+		if (!(flags & IPSET_FLAG_EXIST))
+			return -IPSET_ERR_EXIST;
+#ifdef IP_SET_HASH_WITH_NETS
+		mtype_data_set_flags(data, flags);
+#endif
+		if (SET_WITH_COUNTER(set))
+			ip_set_init_counter(ext_counter(data, set), ext);
+		if (SET_WITH_SKBINFO(set))
+			ip_set_init_skbinfo(ext_skbinfo(data, set), ext);
+		if (SET_WITH_TIMEOUT(set))
+			ip_set_timeout_set(ext_timeout(data, set),
+					   ext->timeout);
+		return 0;
+	}
+	return -ENOENT;
+}
+
 /* Add an element to a hash and update the internal counters when succeeded,
  * otherwise report the proper error code.
  */
@@ -715,6 +767,9 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	bool deleted = false, forceadd = false, reuse = false;
 	u32 key, multi = 0;
 
+	if (flags & IPSET_FLAG_UNLOCKED)
+		return mtype_add_unlocked(set, d, ext, flags);
+
 	if (h->elements >= h->maxelem) {
 		if (SET_WITH_TIMEOUT(set))
 			/* FIXME: when set is full, we slow down here */
@@ -810,6 +865,9 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	j = n->pos++;
 	data = ahash_data(n, j, set->dsize);
 copy_data:
+	if (SET_WITH_COUNTER(set) &&
+	    ip_set_alloc_counter(ext_counter(data, set)))
+		goto nomem;
 	h->elements++;
 #ifdef IP_SET_HASH_WITH_NETS
 	for (i = 0; i < IPSET_NET_COUNT; i++)
@@ -844,6 +902,15 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 		pr_warn("Set %s is full, maxelem %u reached\n",
 			set->name, h->maxelem);
 	return -IPSET_ERR_HASH_FULL;
+nomem:
+	/* Nothing refers to the new element yet */
+	if (reuse || forceadd)
+		clear_bit(j, n->used);
+	else if (old != ERR_PTR(-ENOENT))
+		kfree(n);
+	else
+		n->pos--;
+	return -ENOMEM;
 }
 
 /* Delete an element from the hash and free up space if possible.
@@ -1212,6 +1279,7 @@ static const struct ip_set_type_variant mtype_variant = {
 		[IPSET_DEL] = mtype_del,
 		[IPSET_TEST] = mtype_test,
 	},
+	.unlocked_add = true,
 	.destroy = mtype_destroy,
 	.flush	= mtype_flush,
 	.head	= mtype_head,
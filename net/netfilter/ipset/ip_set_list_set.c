@@ -266,8 +266,7 @@ list_set_uadd(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 			return -IPSET_ERR_REF_EXIST;
 		if (!flag_exist)
 			return -IPSET_ERR_EXIST;
-		/* Update extensions */
-		ip_set_ext_destroy(set, n);
+		/* Update extensions, the per-CPU counters are kept */
 		list_set_init_extensions(set, ext, n);
 
 		/* Set is already added to the list */
@@ -297,6 +296,11 @@ list_set_uadd(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	e = kzalloc(set->dsize, GFP_ATOMIC);
 	if (!e)
 		return -ENOMEM;
+	if (SET_WITH_COUNTER(set) &&
+	    ip_set_alloc_counter(ext_counter(e, set))) {
+		kfree(e);
+		return -ENOMEM;
+	}
 	e->id = d->id;
 	e->set = set;
 	INIT_LIST_HEAD(&e->list);
@@ -2939,6 +2939,7 @@ static int nf_tables_newset(struct net *net, struct sock *nlsk,
 	}
 
 	INIT_LIST_HEAD(&set->bindings);
+	INIT_LIST_HEAD(&set->pending_update);
 	set->ops   = ops;
 	set->ktype = ktype;
 	set->klen  = desc.klen;
@@ -4044,14 +4045,52 @@ static void nf_tables_commit_release(struct nft_trans *trans)
 	kfree(trans);
 }
 
+static void nft_set_commit_update(const struct net *net,
+				  struct list_head *set_update_list)
+{
+	struct nft_set *set, *next;
+
+	list_for_each_entry_safe(set, next, set_update_list, pending_update) {
+		list_del_init(&set->pending_update);
+		set->ops->commit(net, set);
+	}
+}
+
+static void nft_set_commit_prepare(const struct net *net,
+				   struct list_head *set_update_list)
+{
+	struct nft_trans *trans;
+	struct nft_set *set;
+
+	list_for_each_entry(trans, &net->nft.commit_list, list) {
+		if (trans->msg_type != NFT_MSG_NEWSETELEM &&
+		    trans->msg_type != NFT_MSG_DELSETELEM)
+			continue;
+
+		set = nft_trans_elem_set(trans);
+		if (set->ops->commit && list_empty(&set->pending_update))
+			list_add_tail(&set->pending_update, set_update_list);
+	}
+
+	list_for_each_entry(set, set_update_list, pending_update)
+		set->ops->commit_prepare(net, set);
+}
+
 static int nf_tables_commit(struct net *net, struct sk_buff *skb)
 {
+	LIST_HEAD(set_update_list);
 	struct nft_trans *trans, *next;
 	struct nft_trans_elem *te;
 
 	/* Bump generation counter, invalidate any dump in progress */
 	while (++net->nft.base_seq == 0);
 
+	/* Sets build the lookup structures of the new generation, which
+	 * must be visible before the generation is.
+	 */
+	nft_set_commit_prepare(net, &set_update_list);
+	smp_wmb();
+
 	/* A new generation has just started */
 	net->nft.gencursor = nft_gencursor_next(net);
 
@@ -4150,6 +4189,9 @@ static int nf_tables_commit(struct net *net, struct sk_buff *skb)
 		}
 	}
 
+	/* Removed elements are released only after the next grace period */
+	nft_set_commit_update(net, &set_update_list);
+
 	synchronize_rcu();
 
 	list_for_each_entry_safe(trans, next, &net->nft.commit_list, list) {
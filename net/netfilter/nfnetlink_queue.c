@@ -21,6 +21,11 @@
 #include <linux/slab.h>
 #include <linux/notifier.h>
 #include <linux/netdevice.h>
+#include <linux/highmem.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/netfilter.h>
 #include <linux/proc_fs.h>
 #include <linux/netfilter_ipv4.h>
@@ -51,6 +56,29 @@
  */
 #define NFQNL_MAX_COPY_RANGE (0xffff - NLA_HDRLEN)
 
+/* Upper bound for the memory of a packet ring */
+#define NFQNL_RING_MAX_SIZE	(64 << 20)
+
+/* Verdicts taken from the ring per pass, reinjected without the lock */
+#define NFQNL_RING_BATCH	16
+
+/* Frames are used in ring order. head is the next frame to fill, pending
+ * the number of frames from tail on that userspace has not given back.
+ * ids holds the packet id of each frame out of reach of userspace, or 0
+ * once the frame has been given back. All of these are protected by the
+ * lock of the queue using the ring.
+ */
+struct nfqnl_ring {
+	void			*buf;
+	u32			*ids;
+	unsigned int		frame_size;
+	unsigned int		frame_nr;
+	unsigned int		head;
+	unsigned int		tail;
+	unsigned int		pending;
+	wait_queue_head_t	wait;
+};
+
 struct nfqnl_instance {
 	struct hlist_node hlist;		/* global list of queues */
 	struct rcu_head rcu;
@@ -73,6 +101,7 @@ struct nfqnl_instance {
 	unsigned int	queue_total;
 	unsigned int	id_sequence;		/* 'sequence' of pkt ids */
 	struct list_head queue_list;		/* packets in queue */
+	struct nfqnl_ring *ring;		/* set up on /dev/nfqueue */
 };
 
 typedef int (*nfqnl_cmpfn)(struct nf_queue_entry *, unsigned long);
@@ -199,12 +228,10 @@ __dequeue_entry(struct nfqnl_instance *queue, struct nf_queue_entry *entry)
 }
 
 static struct nf_queue_entry *
-find_dequeue_entry(struct nfqnl_instance *queue, unsigned int id)
+__find_dequeue_entry(struct nfqnl_instance *queue, unsigned int id)
 {
 	struct nf_queue_entry *entry = NULL, *i;
 
-	spin_lock_bh(&queue->lock);
-
 	list_for_each_entry(i, &queue->queue_list, list) {
 		if (i->id == id) {
 			entry = i;
@@ -215,8 +242,6 @@ find_dequeue_entry(struct nfqnl_instance *queue, unsigned int id)
 	if (entry)
 		__dequeue_entry(queue, entry);
 
-	spin_unlock_bh(&queue->lock);
-
 	return entry;
 }
 
@@ -236,9 +261,17 @@ nfqnl_flush(struct nfqnl_instance *queue, nfqnl_cmpfn cmpfn, unsigned long data)
 	spin_unlock_bh(&queue->lock);
 }
 
-static int
-nfqnl_put_packet_info(struct sk_buff *nlskb, struct sk_buff *packet,
-		      bool csum_verify)
+static bool nfqnl_csum_verify(const struct nf_queue_entry *entry)
+{
+	const struct sk_buff *entskb = entry->skb;
+
+	if (entry->state.hook <= NF_INET_FORWARD ||
+	   (entry->state.hook == NF_INET_POST_ROUTING && entskb->sk == NULL))
+		return !skb_csum_unnecessary(entskb);
+	return false;
+}
+
+static __u32 nfqnl_packet_info(const struct sk_buff *packet, bool csum_verify)
 {
 	__u32 flags = 0;
 
@@ -250,6 +283,15 @@ nfqnl_put_packet_info(struct sk_buff *nlskb, struct sk_buff *packet,
 	if (skb_is_gso(packet))
 		flags |= NFQA_SKB_GSO;
 
+	return flags;
+}
+
+static int
+nfqnl_put_packet_info(struct sk_buff *nlskb, struct sk_buff *packet,
+		      bool csum_verify)
+{
+	__u32 flags = nfqnl_packet_info(packet, csum_verify);
+
 	return flags ? nla_put_be32(nlskb, NFQA_SKB_INFO, htonl(flags)) : 0;
 }
 
@@ -389,11 +431,7 @@ nfqnl_build_packet_message(struct net *net, struct nfqnl_instance *queue,
 
 	size += nfqnl_get_bridge_size(entry);
 
-	if (entry->state.hook <= NF_INET_FORWARD ||
-	   (entry->state.hook == NF_INET_POST_ROUTING && entskb->sk == NULL))
-		csum_verify = !skb_csum_unnecessary(entskb);
-	else
-		csum_verify = false;
+	csum_verify = nfqnl_csum_verify(entry);
 
 	outdev = entry->state.out;
 
@@ -607,6 +645,147 @@ nfqnl_build_packet_message(struct net *net, struct nfqnl_instance *queue,
 	return NULL;
 }
 
+static inline struct nfqnl_ring_frame *
+nfqnl_ring_frame(const struct nfqnl_ring *ring, unsigned int idx)
+{
+	return ring->buf + idx * ring->frame_size;
+}
+
+/* Release the frames at the tail that have been given back, returns
+ * how many were released.
+ */
+static unsigned int nfqnl_ring_advance(struct nfqnl_ring *ring)
+{
+	unsigned int freed = 0;
+
+	while (ring->pending && !ring->ids[ring->tail]) {
+		if (++ring->tail == ring->frame_nr)
+			ring->tail = 0;
+		ring->pending--;
+		freed++;
+	}
+
+	return freed;
+}
+
+static void nfqnl_ring_flush_frame(struct nfqnl_ring_frame *frame,
+				   unsigned int len)
+{
+#if ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE == 1
+	u8 *start = (u8 *)((unsigned long)frame & PAGE_MASK);
+	u8 *end = (u8 *)PAGE_ALIGN((unsigned long)frame + len);
+
+	for (; start < end; start += PAGE_SIZE)
+		flush_dcache_page(vmalloc_to_page(start));
+#endif
+}
+
+/* Copy the packet into the next free frame of the ring instead of building
+ * a netlink message. Userspace sees the frame once its status is USER.
+ * Returns -ENODEV if the ring has been detached meanwhile, the packet is
+ * then left to netlink.
+ */
+static int
+nfqnl_ring_enqueue(struct nfqnl_instance *queue, struct nf_queue_entry *entry)
+{
+	struct sk_buff *entskb = entry->skb;
+	struct nfqnl_ring_frame *frame;
+	struct nfqnl_ring *ring;
+	unsigned int cap_len = 0;
+	bool csum_verify;
+	int failopen = 0;
+	int err = 0;
+
+	csum_verify = nfqnl_csum_verify(entry);
+
+	if (queue->copy_mode == NFQNL_COPY_PACKET &&
+	    !(queue->flags & NFQA_CFG_F_GSO) &&
+	    entskb->ip_summed == CHECKSUM_PARTIAL &&
+	    skb_checksum_help(entskb))
+		return -ENOMEM;
+
+	spin_lock_bh(&queue->lock);
+
+	ring = queue->ring;
+	if (ring == NULL) {
+		spin_unlock_bh(&queue->lock);
+		return -ENODEV;
+	}
+
+	if (ring->pending == ring->frame_nr) {
+		if (queue->flags & NFQA_CFG_F_FAIL_OPEN) {
+			failopen = 1;
+		} else {
+			queue->queue_user_dropped++;
+			err = -ENOBUFS;
+		}
+		goto out_unlock;
+	}
+
+	if (queue->queue_total >= queue->queue_maxlen) {
+		if (queue->flags & NFQA_CFG_F_FAIL_OPEN) {
+			failopen = 1;
+		} else {
+			queue->queue_dropped++;
+			net_warn_ratelimited("nf_queue: full at %d entries, dropping packets(s)\n",
+					     queue->queue_total);
+			err = -ENOBUFS;
+		}
+		goto out_unlock;
+	}
+
+	if (queue->copy_mode == NFQNL_COPY_PACKET) {
+		cap_len = min_t(unsigned int, READ_ONCE(queue->copy_range),
+				entskb->len);
+		cap_len = min_t(unsigned int, cap_len,
+				ring->frame_size - NFQNL_RING_HDRLEN);
+	}
+
+	/* Id 0 marks a frame that has been given back */
+	do {
+		entry->id = ++queue->id_sequence;
+	} while (unlikely(!entry->id));
+
+	ring->ids[ring->head] = entry->id;
+	frame = nfqnl_ring_frame(ring, ring->head);
+	frame->packet_id = entry->id;
+	frame->len = entskb->len;
+	frame->cap_len = cap_len;
+	frame->mark = entskb->mark;
+	frame->indev = entry->state.in ? entry->state.in->ifindex : 0;
+	frame->outdev = entry->state.out ? entry->state.out->ifindex : 0;
+	frame->skbinfo = nfqnl_packet_info(entskb, csum_verify);
+	frame->verdict = 0;
+	frame->hw_protocol = entskb->protocol;
+	frame->hook = entry->state.hook;
+	frame->flags = 0;
+	if (cap_len)
+		skb_copy_bits(entskb, 0, (void *)frame + NFQNL_RING_HDRLEN,
+			      cap_len);
+
+	/* Make the frame contents visible before its status */
+	smp_wmb();
+	WRITE_ONCE(frame->status, NFQNL_RING_USER);
+	nfqnl_ring_flush_frame(frame, NFQNL_RING_HDRLEN + cap_len);
+
+	if (++ring->head == ring->frame_nr)
+		ring->head = 0;
+	ring->pending++;
+
+	__enqueue_entry(queue, entry);
+	spin_unlock_bh(&queue->lock);
+
+	/* The ring is freed after a grace period, see nfqnl_ring_release() */
+	wake_up_interruptible(&ring->wait);
+	return 0;
+
+out_unlock:
+	spin_unlock_bh(&queue->lock);
+	if (failopen)
+		nf_reinject(entry, NF_ACCEPT);
+	return err;
+}
+
 static int
 __nfqnl_enqueue_packet(struct net *net, struct nfqnl_instance *queue,
 			struct nf_queue_entry *entry)
@@ -616,6 +795,13 @@ __nfqnl_enqueue_packet(struct net *net, struct nfqnl_instance *queue,
 	__be32 *packet_id_ptr;
 	int failopen = 0;
 
+	if (READ_ONCE(queue->ring)) {
+		err = nfqnl_ring_enqueue(queue, entry);
+		if (err != -ENODEV)
+			return err;
+		err = -ENOBUFS;
+	}
+
 	nskb = nfqnl_build_packet_message(net, queue, entry, &packet_id_ptr);
 	if (nskb == NULL) {
 		err = -ENOMEM;
@@ -1026,6 +1212,35 @@ static int nfq_id_after(unsigned int id, unsigned int max)
 	return (int)(id - max) > 0;
 }
 
+/* Packets in the ring that got their verdict through netlink give their
+ * frames back, as if userspace had set them to NFQNL_RING_VERDICT. With
+ * @batch this covers all ids up to @id, otherwise only @id. Frames hold
+ * ids in increasing order from the tail. Called with queue->lock held.
+ */
+static void nfqnl_ring_forget(struct nfqnl_ring *ring, unsigned int id,
+			      bool batch)
+{
+	unsigned int i, idx = ring->tail;
+
+	for (i = 0; i < ring->pending; i++) {
+		u32 fid = ring->ids[idx];
+
+		if (fid) {
+			if (nfq_id_after(fid, id))
+				break;
+			if (batch || fid == id) {
+				ring->ids[idx] = 0;
+				WRITE_ONCE(nfqnl_ring_frame(ring, idx)->status,
+					   NFQNL_RING_UNUSED);
+			}
+		}
+		if (++idx == ring->frame_nr)
+			idx = 0;
+	}
+
+	nfqnl_ring_advance(ring);
+}
+
 static int nfqnl_recv_verdict_batch(struct net *net, struct sock *ctnl,
 				    struct sk_buff *skb,
 				    const struct nlmsghdr *nlh,
@@ -1061,6 +1276,9 @@ static int nfqnl_recv_verdict_batch(struct net *net, struct sock *ctnl,
 		list_add_tail(&entry->list, &batch_list);
 	}
 
+	if (queue->ring)
+		nfqnl_ring_forget(queue->ring, maxid, true);
+
 	spin_unlock_bh(&queue->lock);
 
 	if (list_empty(&batch_list))
@@ -1158,7 +1376,11 @@ static int nfqnl_recv_verdict(struct net *net, struct sock *ctnl,
 
 	verdict = ntohl(vhdr->verdict);
 
-	entry = find_dequeue_entry(queue, ntohl(vhdr->id));
+	spin_lock_bh(&queue->lock);
+	entry = __find_dequeue_entry(queue, ntohl(vhdr->id));
+	if (entry && queue->ring)
+		nfqnl_ring_forget(queue->ring, entry->id, false);
+	spin_unlock_bh(&queue->lock);
 	if (entry == NULL)
 		return -ENOENT;
 
@@ -1359,6 +1581,325 @@ static const struct nfnetlink_subsystem nfqnl_subsys = {
 	.cb		= nfqnl_cb,
 };
 
+/* /dev/nfqueue: one packet ring per open file, attached to a queue that
+ * is bound through nfnetlink. Verdicts are read back from the ring.
+ */
+struct nfqnl_ring_file {
+	struct mutex		mutex;		/* protects ring, queue_num */
+	struct net		*net;
+	struct nfqnl_ring	*ring;
+	u16			queue_num;
+};
+
+struct nfqnl_ring_verdict {
+	struct nf_queue_entry	*entry;
+	unsigned int		verdict;
+};
+
+/* Take up to NFQNL_RING_BATCH verdicts off the ring and release the frames
+ * at its tail that are no longer in use. *scanned is the number of frames
+ * from the tail that have been looked at already by this call of the
+ * verdict ioctl, so that each pass continues where the last one stopped.
+ * Called with queue->lock held.
+ */
+static unsigned int
+nfqnl_ring_collect(struct nfqnl_instance *queue, struct nfqnl_ring *ring,
+		   struct nfqnl_ring_verdict *batch, unsigned int *scanned)
+{
+	unsigned int idx, n = 0, freed;
+
+	idx = ring->tail + *scanned;
+	if (idx >= ring->frame_nr)
+		idx -= ring->frame_nr;
+
+	for (; *scanned < ring->pending && n < NFQNL_RING_BATCH; (*scanned)++) {
+		struct nfqnl_ring_frame *frame = nfqnl_ring_frame(ring, idx);
+		struct nf_queue_entry *entry;
+		unsigned int verdict;
+		u32 id = ring->ids[idx];
+
+		if (!id || READ_ONCE(frame->status) != NFQNL_RING_VERDICT) {
+			if (++idx == ring->frame_nr)
+				idx = 0;
+			continue;
+		}
+		/* Read the verdict only after seeing the status */
+		smp_rmb();
+
+		verdict = READ_ONCE(frame->verdict);
+		entry = __find_dequeue_entry(queue, id);
+		if (entry) {
+			if ((verdict & NF_VERDICT_MASK) > NF_MAX_VERDICT ||
+			    (verdict & NF_VERDICT_MASK) == NF_STOLEN)
+				verdict = NF_DROP;
+			if (READ_ONCE(frame->flags) & NFQNL_RING_F_MARK)
+				entry->skb->mark = READ_ONCE(frame->mark);
+
+			batch[n].entry = entry;
+			batch[n].verdict = verdict;
+			n++;
+		}
+		ring->ids[idx] = 0;
+		WRITE_ONCE(frame->status, NFQNL_RING_UNUSED);
+		if (++idx == ring->frame_nr)
+			idx = 0;
+	}
+
+	freed = nfqnl_ring_advance(ring);
+	*scanned = *scanned > freed ? *scanned - freed : 0;
+
+	return n;
+}
+
+/* Drop the packets waiting in the ring, those queued to netlink are left
+ * alone. Called with queue->lock held.
+ */
+static void nfqnl_ring_flush(struct nfqnl_instance *queue,
+			     struct nfqnl_ring *ring)
+{
+	struct nf_queue_entry *entry;
+	unsigned int idx = ring->tail;
+
+	for (; ring->pending; ring->pending--) {
+		if (ring->ids[idx]) {
+			entry = __find_dequeue_entry(queue, ring->ids[idx]);
+			if (entry)
+				nf_reinject(entry, NF_DROP);
+		}
+		if (++idx == ring->frame_nr)
+			idx = 0;
+	}
+}
+
+static int nfqnl_ring_verdict(struct nfqnl_ring_file *rf)
+{
+	struct nfnl_queue_net *q = nfnl_queue_pernet(rf->net);
+	struct nfqnl_ring_verdict batch[NFQNL_RING_BATCH];
+	struct nfqnl_ring *ring = rf->ring;
+	struct nfqnl_instance *queue;
+	unsigned int i, n, scanned = 0;
+	int done = 0;
+
+	if (ring == NULL)
+		return -EINVAL;
+
+	rcu_read_lock();
+	queue = instance_lookup(q, rf->queue_num);
+	if (queue == NULL) {
+		rcu_read_unlock();
+		return -ENODEV;
+	}
+
+	do {
+		spin_lock_bh(&queue->lock);
+		if (queue->ring != ring) {
+			spin_unlock_bh(&queue->lock);
+			rcu_read_unlock();
+			return -ENODEV;
+		}
+		n = nfqnl_ring_collect(queue, ring, batch, &scanned);
+		spin_unlock_bh(&queue->lock);
+
+		for (i = 0; i < n; i++)
+			nf_reinject(batch[i].entry, batch[i].verdict);
+		done += n;
+	} while (n == NFQNL_RING_BATCH);
+
+	rcu_read_unlock();
+	return done;
+}
+
+static int nfqnl_ring_setup(struct nfqnl_ring_file *rf,
+			    const struct nfqnl_ring_req *req)
+{
+	struct nfnl_queue_net *q = nfnl_queue_pernet(rf->net);
+	struct nfqnl_instance *queue;
+	struct nfqnl_ring *ring;
+	int err = 0;
+
+	if (rf->ring)
+		return -EBUSY;
+	if (req->frame_size < NFQNL_RING_HDRLEN ||
+	    req->frame_size & (NFQNL_RING_ALIGNMENT - 1) ||
+	    req->frame_nr == 0 ||
+	    req->frame_size > NFQNL_RING_MAX_SIZE ||
+	    req->frame_nr > NFQNL_RING_MAX_SIZE / req->frame_size)
+		return -EINVAL;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL)
+		return -ENOMEM;
+	ring->buf = vmalloc_user(PAGE_ALIGN(req->frame_size * req->frame_nr));
+	ring->ids = vzalloc(req->frame_nr * sizeof(*ring->ids));
+	if (ring->buf == NULL || ring->ids == NULL) {
+		vfree(ring->ids);
+		vfree(ring->buf);
+		kfree(ring);
+		return -ENOMEM;
+	}
+	ring->frame_size = req->frame_size;
+	ring->frame_nr = req->frame_nr;
+	init_waitqueue_head(&ring->wait);
+
+	rcu_read_lock();
+	queue = instance_lookup(q, req->queue_num);
+	if (queue == NULL) {
+		err = -ENODEV;
+	} else {
+		spin_lock_bh(&queue->lock);
+		if (queue->ring)
+			err = -EBUSY;
+		else
+			WRITE_ONCE(queue->ring, ring);
+		spin_unlock_bh(&queue->lock);
+	}
+	rcu_read_unlock();
+
+	if (err) {
+		vfree(ring->ids);
+		vfree(ring->buf);
+		kfree(ring);
+		return err;
+	}
+
+	rf->ring = ring;
+	rf->queue_num = req->queue_num;
+	return 0;
+}
+
+static long nfqnl_ring_ioctl(struct file *file, unsigned int cmd,
+			     unsigned long arg)
+{
+	struct nfqnl_ring_file *rf = file->private_data;
+	struct nfqnl_ring_req req;
+	int err;
+
+	switch (cmd) {
+	case NFQNL_RING_IOC_SETUP:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		mutex_lock(&rf->mutex);
+		err = nfqnl_ring_setup(rf, &req);
+		mutex_unlock(&rf->mutex);
+		return err;
+	case NFQNL_RING_IOC_VERDICT:
+		mutex_lock(&rf->mutex);
+		err = nfqnl_ring_verdict(rf);
+		mutex_unlock(&rf->mutex);
+		return err;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int nfqnl_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct nfqnl_ring_file *rf = file->private_data;
+	int err = -EINVAL;
+
+	mutex_lock(&rf->mutex);
+	if (rf->ring)
+		err = remap_vmalloc_range(vma, rf->ring->buf, vma->vm_pgoff);
+	mutex_unlock(&rf->mutex);
+
+	return err;
+}
+
+static unsigned int nfqnl_ring_poll(struct file *file, poll_table *wait)
+{
+	struct nfqnl_ring_file *rf = file->private_data;
+	struct nfqnl_ring_frame *frame;
+	struct nfqnl_ring *ring;
+	unsigned int mask = 0;
+	unsigned int head;
+
+	mutex_lock(&rf->mutex);
+	ring = rf->ring;
+	if (ring == NULL) {
+		mutex_unlock(&rf->mutex);
+		return POLLERR;
+	}
+
+	poll_wait(file, &ring->wait, wait);
+
+	/* The last frame filled tells whether anything new is waiting */
+	head = READ_ONCE(ring->head);
+	frame = nfqnl_ring_frame(ring, head ? head - 1 : ring->frame_nr - 1);
+	if (READ_ONCE(frame->status) == NFQNL_RING_USER)
+		mask |= POLLIN | POLLRDNORM;
+	mutex_unlock(&rf->mutex);
+
+	return mask;
+}
+
+static int nfqnl_ring_open(struct inode *inode, struct file *file)
+{
+	struct net *net = current->nsproxy->net_ns;
+	struct nfqnl_ring_file *rf;
+
+	if (!ns_capable(net->user_ns, CAP_NET_ADMIN))
+		return -EPERM;
+
+	rf = kzalloc(sizeof(*rf), GFP_KERNEL);
+	if (rf == NULL)
+		return -ENOMEM;
+	mutex_init(&rf->mutex);
+	rf->net = get_net(net);
+	file->private_data = rf;
+
+	return nonseekable_open(inode, file);
+}
+
+static int nfqnl_ring_release(struct inode *inode, struct file *file)
+{
+	struct nfqnl_ring_file *rf = file->private_data;
+	struct nfqnl_ring *ring = rf->ring;
+	struct nfqnl_instance *queue;
+
+	if (ring) {
+		rcu_read_lock();
+		queue = instance_lookup(nfnl_queue_pernet(rf->net),
+					rf->queue_num);
+		if (queue) {
+			spin_lock_bh(&queue->lock);
+			if (queue->ring == ring) {
+				WRITE_ONCE(queue->ring, NULL);
+				/* Nobody is left to give a verdict on these */
+				nfqnl_ring_flush(queue, ring);
+			}
+			spin_unlock_bh(&queue->lock);
+		}
+		rcu_read_unlock();
+
+		/* Wait for enqueuers that still see the ring */
+		synchronize_rcu();
+		vfree(ring->ids);
+		vfree(ring->buf);
+		kfree(ring);
+	}
+
+	put_net(rf->net);
+	kfree(rf);
+	return 0;
+}
+
+static const struct file_operations nfqnl_ring_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nfqnl_ring_open,
+	.release	= nfqnl_ring_release,
+	.unlocked_ioctl	= nfqnl_ring_ioctl,
+	.compat_ioctl	= nfqnl_ring_ioctl,
+	.mmap		= nfqnl_ring_mmap,
+	.poll		= nfqnl_ring_poll,
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice nfqnl_ring_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "nfqueue",
+	.fops		= &nfqnl_ring_fops,
+};
+
 #ifdef CONFIG_PROC_FS
 struct iter_state {
 	struct seq_net_private p;
@@ -1530,8 +2071,16 @@ static int __init nfnetlink_queue_init(void)
 		goto cleanup_netlink_subsys;
 	}
 
+	status = misc_register(&nfqnl_ring_dev);
+	if (status < 0) {
+		pr_err("nf_queue: failed to register ring device\n");
+		goto cleanup_netdev_notifier;
+	}
+
 	return status;
 
+cleanup_netdev_notifier:
+	unregister_netdevice_notifier(&nfqnl_dev_notifier);
 cleanup_netlink_subsys:
 	nfnetlink_subsys_unregister(&nfqnl_subsys);
 cleanup_netlink_notifier:
@@ -1543,6 +2092,7 @@ static int __init nfnetlink_queue_init(void)
 
 static void __exit nfnetlink_queue_fini(void)
 {
+	misc_deregister(&nfqnl_ring_dev);
 	unregister_netdevice_notifier(&nfqnl_dev_notifier);
 	nfnetlink_subsys_unregister(&nfqnl_subsys);
 	netlink_unregister_notifier(&nfqnl_rtnl_notifier);
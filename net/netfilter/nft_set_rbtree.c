@@ -13,6 +13,8 @@
 #include <linux/module.h>
 #include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/nf_tables.h>
@@ -20,8 +22,28 @@
 
 static DEFINE_SPINLOCK(nft_rbtree_lock);
 
+#define NFT_RBTREE_KEY_WORDS	(NFT_DATA_VALUE_MAXLEN / sizeof(u32))
+
+/*
+ * Packet path view of the set: the start keys of the committed elements
+ * and interval ends, sorted in ascending order, each followed by the
+ * element, or NULL for the end of an interval. Keys are stored as host
+ * endian words, so that they compare like the network order bytes.
+ * There is one array per generation, looked up with a lockless binary
+ * search. A commit builds the array of the next generation before it
+ * becomes current, then shares it between both once the old generation
+ * is gone.
+ */
+struct nft_rbtree_match {
+	struct rcu_head			rcu;
+	unsigned int			num;
+	u32				*keys;
+	const struct nft_set_ext	*ext[];
+};
+
 struct nft_rbtree {
-	struct rb_root		root;
+	struct rb_root			root;
+	struct nft_rbtree_match __rcu	*match[2];
 };
 
 struct nft_rbtree_elem {
@@ -41,8 +63,82 @@ static bool nft_rbtree_equal(const struct nft_set *set, const void *this,
 	return memcmp(this, nft_set_ext_key(&interval->ext), set->klen) == 0;
 }
 
-static bool nft_rbtree_lookup(const struct net *net, const struct nft_set *set,
-			      const u32 *key, const struct nft_set_ext **ext)
+static unsigned int nft_rbtree_key_words(const struct nft_set *set)
+{
+	return DIV_ROUND_UP(set->klen, sizeof(u32));
+}
+
+/* Convert @klen bytes of network order key into comparable words. */
+static void nft_rbtree_key_load(u32 *dst, const u32 *src, unsigned int klen)
+{
+	unsigned int i, n = DIV_ROUND_UP(klen, sizeof(u32));
+
+	for (i = 0; i < n; i++)
+		dst[i] = ntohl((__force __be32)src[i]);
+	if (klen % sizeof(u32))
+		dst[n - 1] &= ~0U << (BITS_PER_BYTE *
+				      (sizeof(u32) - klen % sizeof(u32)));
+}
+
+static int nft_rbtree_key_cmp(const u32 *a, const u32 *b, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static bool nft_rbtree_match_lookup(const struct nft_set *set,
+				    const struct nft_rbtree_match *m,
+				    const u32 *key, u8 genmask,
+				    const struct nft_set_ext **ext)
+{
+	unsigned int n = nft_rbtree_key_words(set);
+	unsigned int lo = 0, hi = m->num, mid;
+	u32 k[NFT_RBTREE_KEY_WORDS];
+	const struct nft_set_ext *e;
+
+	nft_rbtree_key_load(k, key, set->klen);
+
+	/* find the last entry not greater than the key */
+	if (n == 1) {
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (m->keys[mid] <= k[0])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	} else {
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (nft_rbtree_key_cmp(&m->keys[mid * n], k, n) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	}
+	if (lo == 0)
+		return false;
+
+	e = m->ext[lo - 1];
+	if (e == NULL || !nft_set_elem_active(e, genmask))
+		return false;
+	if (!(set->flags & NFT_SET_INTERVAL) &&
+	    nft_rbtree_key_cmp(&m->keys[(lo - 1) * n], k, n))
+		return false;
+
+	*ext = e;
+	return true;
+}
+
+/* Slow path, until the set is first committed or if building failed */
+static bool nft_rbtree_tree_lookup(const struct net *net,
+				   const struct nft_set *set, const u32 *key,
+				   const struct nft_set_ext **ext)
 {
 	const struct nft_rbtree *priv = nft_set_priv(set);
 	const struct nft_rbtree_elem *rbe, *interval = NULL;
@@ -95,6 +191,22 @@ static bool nft_rbtree_lookup(const struct net *net, const struct nft_set *set,
 	return false;
 }
 
+static bool nft_rbtree_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	const struct nft_rbtree *priv = nft_set_priv(set);
+	unsigned int cursor = ACCESS_ONCE(net->nft.gencursor);
+	const struct nft_rbtree_match *m;
+
+	/* Pairs with the barrier before the generation flip */
+	smp_rmb();
+	m = rcu_dereference(priv->match[cursor]);
+	if (m != NULL)
+		return nft_rbtree_match_lookup(set, m, key, 1 << cursor, ext);
+
+	return nft_rbtree_tree_lookup(net, set, key, ext);
+}
+
 static int __nft_rbtree_insert(const struct net *net, const struct nft_set *set,
 			       struct nft_rbtree_elem *new,
 			       struct nft_set_ext **ext)
@@ -242,6 +354,125 @@ static void nft_rbtree_walk(const struct nft_ctx *ctx,
 	spin_unlock_bh(&nft_rbtree_lock);
 }
 
+static void nft_rbtree_match_free(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct nft_rbtree_match, rcu));
+}
+
+static struct nft_rbtree_match *nft_rbtree_match_alloc(unsigned int num,
+						       unsigned int n)
+{
+	struct nft_rbtree_match *m;
+	size_t size;
+
+	size = sizeof(*m) + num * (sizeof(m->ext[0]) + n * sizeof(u32));
+	m = kmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (m == NULL)
+		m = vmalloc(size);
+	if (m == NULL)
+		return NULL;
+
+	m->num = num;
+	m->keys = (u32 *)&m->ext[num];
+	return m;
+}
+
+/* Build the lookup array from the elements active in @genmask */
+static struct nft_rbtree_match *nft_rbtree_match_build(const struct nft_set *set,
+							u8 genmask)
+{
+	struct nft_rbtree *priv = nft_set_priv(set);
+	unsigned int n = nft_rbtree_key_words(set);
+	u32 k[NFT_RBTREE_KEY_WORDS];
+	struct nft_rbtree_match *m;
+	struct nft_rbtree_elem *rbe;
+	unsigned int num = 0, i;
+	struct rb_node *node;
+
+	for (node = rb_first(&priv->root); node != NULL; node = rb_next(node)) {
+		rbe = rb_entry(node, struct nft_rbtree_elem, node);
+		if (nft_set_elem_active(&rbe->ext, genmask))
+			num++;
+	}
+
+	m = nft_rbtree_match_alloc(num, n);
+	if (m == NULL)
+		return NULL;
+
+	/* The tree is in descending key order, fill the array backwards */
+	i = num;
+	for (node = rb_first(&priv->root); node != NULL; node = rb_next(node)) {
+		rbe = rb_entry(node, struct nft_rbtree_elem, node);
+		if (!nft_set_elem_active(&rbe->ext, genmask))
+			continue;
+
+		nft_rbtree_key_load(k, nft_set_ext_key(&rbe->ext)->data,
+				    set->klen);
+
+		/* Adjacent ranges: the start of one wins over the other's end */
+		if (i < num && !nft_rbtree_key_cmp(&m->keys[i * n], k, n)) {
+			if (!nft_rbtree_interval_end(rbe))
+				m->ext[i] = &rbe->ext;
+			continue;
+		}
+
+		i--;
+		memcpy(&m->keys[i * n], k, n * sizeof(u32));
+		m->ext[i] = nft_rbtree_interval_end(rbe) ? NULL : &rbe->ext;
+	}
+
+	if (i > 0) {
+		m->num = num - i;
+		memmove(&m->ext[0], &m->ext[i], m->num * sizeof(m->ext[0]));
+		memmove(&m->keys[0], &m->keys[i * n], m->num * n * sizeof(u32));
+	}
+
+	return m;
+}
+
+/* Replace the array of one generation, freeing the old one unless the
+ * other generation still uses it. Without an array, lookups in that
+ * generation fall back to walking the tree.
+ */
+static void nft_rbtree_match_set(struct nft_rbtree *priv, unsigned int cursor,
+				 struct nft_rbtree_match *m)
+{
+	struct nft_rbtree_match *old;
+
+	old = rcu_dereference_protected(priv->match[cursor], 1);
+	rcu_assign_pointer(priv->match[cursor], m);
+	if (old != NULL && old != rcu_access_pointer(priv->match[!cursor]))
+		call_rcu(&old->rcu, nft_rbtree_match_free);
+}
+
+/*
+ * Called with the nfnetlink mutex held before the generation flip: the
+ * next generation gets an array of its own, which lookups pick up
+ * together with the new generation.
+ */
+static void nft_rbtree_commit_prepare(const struct net *net,
+				      const struct nft_set *set)
+{
+	struct nft_rbtree *priv = nft_set_priv(set);
+
+	nft_rbtree_match_set(priv, nft_gencursor_next(net),
+			     nft_rbtree_match_build(set, nft_genmask_next(net)));
+}
+
+/*
+ * Called after the generation flip, once no lookup uses the previous
+ * generation any more and before removed elements are released. Both
+ * generations share the array until the next commit.
+ */
+static void nft_rbtree_commit(const struct net *net, const struct nft_set *set)
+{
+	struct nft_rbtree *priv = nft_set_priv(set);
+	unsigned int cursor = net->nft.gencursor;
+
+	nft_rbtree_match_set(priv, !cursor,
+			     rcu_dereference_protected(priv->match[cursor], 1));
+}
+
 static unsigned int nft_rbtree_privsize(const struct nlattr * const nla[])
 {
 	return sizeof(struct nft_rbtree);
@@ -254,15 +485,24 @@ static int nft_rbtree_init(const struct nft_set *set,
 	struct nft_rbtree *priv = nft_set_priv(set);
 
 	priv->root = RB_ROOT;
+	RCU_INIT_POINTER(priv->match[0], NULL);
+	RCU_INIT_POINTER(priv->match[1], NULL);
 	return 0;
 }
 
 static void nft_rbtree_destroy(const struct nft_set *set)
 {
 	struct nft_rbtree *priv = nft_set_priv(set);
+	struct nft_rbtree_match *m0, *m1;
 	struct nft_rbtree_elem *rbe;
 	struct rb_node *node;
 
+	m0 = rcu_dereference_protected(priv->match[0], 1);
+	m1 = rcu_dereference_protected(priv->match[1], 1);
+	if (m1 != m0)
+		kvfree(m1);
+	kvfree(m0);
+
 	while ((node = priv->root.rb_node) != NULL) {
 		rb_erase(node, &priv->root);
 		rbe = rb_entry(node, struct nft_rbtree_elem, node);
@@ -275,7 +515,8 @@ static bool nft_rbtree_estimate(const struct nft_set_desc *desc, u32 features,
 {
 	unsigned int nsize;
 
-	nsize = sizeof(struct nft_rbtree_elem);
+	nsize = sizeof(struct nft_rbtree_elem) +
+		sizeof(struct nft_set_ext *) + round_up(desc->klen, sizeof(u32));
 	if (desc->size)
 		est->size = sizeof(struct nft_rbtree) + desc->size * nsize;
 	else
@@ -298,6 +539,8 @@ static struct nft_set_ops nft_rbtree_ops __read_mostly = {
 	.activate	= nft_rbtree_activate,
 	.lookup		= nft_rbtree_lookup,
 	.walk		= nft_rbtree_walk,
+	.commit_prepare	= nft_rbtree_commit_prepare,
+	.commit		= nft_rbtree_commit,
 	.features	= NFT_SET_INTERVAL | NFT_SET_MAP,
 	.owner		= THIS_MODULE,
 };
@@ -310,6 +553,7 @@ static int __init nft_rbtree_module_init(void)
 static void __exit nft_rbtree_module_exit(void)
 {
 	nft_unregister_set(&nft_rbtree_ops);
+	rcu_barrier();
 }
 
 module_init(nft_rbtree_module_init);
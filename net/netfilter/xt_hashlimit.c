@@ -59,6 +59,12 @@ static inline struct hashlimit_net *hashlimit_pernet(struct net *net)
 static const struct file_operations dl_file_ops_v1;
 static const struct file_operations dl_file_ops;
 
+/* Number of spinlocks protecting the hash chains of a table */
+#define HASHLIMIT_LOCKS		64
+
+/* Number of hash chains walked by one garbage collector run */
+#define HASHLIMIT_GC_BUCKETS	1024
+
 /* hash table crap */
 struct dsthash_dst {
 	union {
@@ -83,11 +89,11 @@ struct dsthash_ent {
 	struct dsthash_dst dst;
 
 	/* modified structure members in the end */
-	spinlock_t lock;
+	spinlock_t lock;		/* serializes refills */
 	unsigned long expires;		/* precalculated expiry time */
 	struct {
 		unsigned long prev;	/* last modification */
-		u_int64_t credit;
+		atomic64_t credit;	/* also consumed without the lock */
 		u_int64_t credit_cap, cost;
 	} rateinfo;
 	struct rcu_head rcu;
@@ -97,14 +103,14 @@ struct xt_hashlimit_htable {
 	struct hlist_node node;		/* global list of all htables */
 	int use;
 	u_int8_t family;
-	bool rnd_initialized;
 
 	struct hashlimit_cfg2 cfg;	/* config */
 
 	/* used internally */
-	spinlock_t lock;		/* lock for list_head */
+	spinlock_t lock[HASHLIMIT_LOCKS]; /* locks for hash chains */
 	u_int32_t rnd;			/* random seed for hash */
-	unsigned int count;		/* number entries in table */
+	atomic_t count;			/* number entries in table */
+	unsigned int gc_next;		/* first chain of the next gc run */
 	struct delayed_work gc_work;
 
 	/* seq_file stuff */
@@ -163,6 +169,12 @@ hash_dst(const struct xt_hashlimit_htable *ht, const struct dsthash_dst *dst)
 	return reciprocal_scale(hash, ht->cfg.size);
 }
 
+static inline spinlock_t *
+htable_lock(struct xt_hashlimit_htable *ht, u_int32_t hash)
+{
+	return &ht->lock[hash & (HASHLIMIT_LOCKS - 1)];
+}
+
 static struct dsthash_ent *
 dsthash_find(const struct xt_hashlimit_htable *ht,
 	     const struct dsthash_dst *dst)
@@ -172,41 +184,38 @@ dsthash_find(const struct xt_hashlimit_htable *ht,
 
 	if (!hlist_empty(&ht->hash[hash])) {
 		hlist_for_each_entry_rcu(ent, &ht->hash[hash], node)
-			if (dst_cmp(ent, dst)) {
-				spin_lock(&ent->lock);
+			if (dst_cmp(ent, dst))
 				return ent;
-			}
 	}
 	return NULL;
 }
 
-/* allocate dsthash_ent, initialize dst, put in htable and lock it */
+static void rateinfo_init(struct dsthash_ent *dh,
+			  struct xt_hashlimit_htable *hinfo,
+			  unsigned long now, int revision);
+
+/* allocate dsthash_ent, initialize it and put it in htable */
 static struct dsthash_ent *
 dsthash_alloc_init(struct xt_hashlimit_htable *ht,
-		   const struct dsthash_dst *dst, bool *race)
+		   const struct dsthash_dst *dst, unsigned long now,
+		   int revision)
 {
+	u_int32_t hash = hash_dst(ht, dst);
+	spinlock_t *lock = htable_lock(ht, hash);
 	struct dsthash_ent *ent;
 
-	spin_lock(&ht->lock);
+	spin_lock(lock);
 
 	/* Two or more packets may race to create the same entry in the
 	 * hashtable, double check if this packet lost race.
 	 */
 	ent = dsthash_find(ht, dst);
 	if (ent != NULL) {
-		spin_unlock(&ht->lock);
-		*race = true;
+		spin_unlock(lock);
 		return ent;
 	}
 
-	/* initialize hash with random val at the time we allocate
-	 * the first hashtable entry */
-	if (unlikely(!ht->rnd_initialized)) {
-		get_random_bytes(&ht->rnd, sizeof(ht->rnd));
-		ht->rnd_initialized = true;
-	}
-
-	if (ht->cfg.max && ht->count >= ht->cfg.max) {
+	if (ht->cfg.max && atomic_read(&ht->count) >= ht->cfg.max) {
 		/* FIXME: do something. question is what.. */
 		net_err_ratelimited("max count of %u reached\n", ht->cfg.max);
 		ent = NULL;
@@ -215,12 +224,13 @@ dsthash_alloc_init(struct xt_hashlimit_htable *ht,
 	if (ent) {
 		memcpy(&ent->dst, dst, sizeof(ent->dst));
 		spin_lock_init(&ent->lock);
-
-		spin_lock(&ent->lock);
-		hlist_add_head_rcu(&ent->node, &ht->hash[hash_dst(ht, dst)]);
-		ht->count++;
+		/* lockless readers may use the entry as soon as it is hashed */
+		ent->expires = now + msecs_to_jiffies(ht->cfg.expire);
+		rateinfo_init(ent, ht, now, revision);
+		hlist_add_head_rcu(&ent->node, &ht->hash[hash]);
+		atomic_inc(&ht->count);
 	}
-	spin_unlock(&ht->lock);
+	spin_unlock(lock);
 	return ent;
 }
 
@@ -236,7 +246,7 @@ dsthash_free(struct xt_hashlimit_htable *ht, struct dsthash_ent *ent)
 {
 	hlist_del_rcu(&ent->node);
 	call_rcu_bh(&ent->rcu, dsthash_free_rcu);
-	ht->count--;
+	atomic_dec(&ht->count);
 }
 static void htable_gc(struct work_struct *work);
 
@@ -283,15 +293,17 @@ static int htable_create(struct net *net, struct hashlimit_cfg2 *cfg,
 		INIT_HLIST_HEAD(&hinfo->hash[i]);
 
 	hinfo->use = 1;
-	hinfo->count = 0;
+	atomic_set(&hinfo->count, 0);
+	hinfo->gc_next = 0;
 	hinfo->family = family;
-	hinfo->rnd_initialized = false;
+	get_random_bytes(&hinfo->rnd, sizeof(hinfo->rnd));
 	hinfo->name = kstrdup(name, GFP_KERNEL);
 	if (!hinfo->name) {
 		vfree(hinfo);
 		return -ENOMEM;
 	}
-	spin_lock_init(&hinfo->lock);
+	for (i = 0; i < HASHLIMIT_LOCKS; i++)
+		spin_lock_init(&hinfo->lock[i]);
 
 	hinfo->pde = proc_create_data(name, 0,
 		(family == NFPROTO_IPV4) ?
@@ -327,35 +339,46 @@ static bool select_gc(const struct xt_hashlimit_htable *ht,
 }
 
 static void htable_selective_cleanup(struct xt_hashlimit_htable *ht,
+			unsigned int start, unsigned int end,
 			bool (*select)(const struct xt_hashlimit_htable *ht,
 				      const struct dsthash_ent *he))
 {
 	unsigned int i;
 
-	for (i = 0; i < ht->cfg.size; i++) {
+	for (i = start; i < end; i++) {
+		spinlock_t *lock = htable_lock(ht, i);
 		struct dsthash_ent *dh;
 		struct hlist_node *n;
 
-		spin_lock_bh(&ht->lock);
+		spin_lock_bh(lock);
 		hlist_for_each_entry_safe(dh, n, &ht->hash[i], node) {
 			if ((*select)(ht, dh))
 				dsthash_free(ht, dh);
 		}
-		spin_unlock_bh(&ht->lock);
+		spin_unlock_bh(lock);
 		cond_resched();
 	}
 }
 
+/* Every run walks up to HASHLIMIT_GC_BUCKETS chains. The runs are spread
+ * so that the whole table is still walked once per gc_interval.
+ */
 static void htable_gc(struct work_struct *work)
 {
 	struct xt_hashlimit_htable *ht;
+	unsigned int end, runs;
+	unsigned long delay;
 
 	ht = container_of(work, struct xt_hashlimit_htable, gc_work.work);
 
-	htable_selective_cleanup(ht, select_gc);
+	end = min(ht->gc_next + HASHLIMIT_GC_BUCKETS, ht->cfg.size);
+	htable_selective_cleanup(ht, ht->gc_next, end, select_gc);
+	ht->gc_next = end < ht->cfg.size ? end : 0;
 
+	runs = DIV_ROUND_UP(ht->cfg.size, HASHLIMIT_GC_BUCKETS);
+	delay = msecs_to_jiffies(ht->cfg.gc_interval / runs);
 	queue_delayed_work(system_power_efficient_wq,
-			   &ht->gc_work, msecs_to_jiffies(ht->cfg.gc_interval));
+			   &ht->gc_work, max(delay, 1UL));
 }
 
 static void htable_remove_proc_entry(struct xt_hashlimit_htable *hinfo)
@@ -376,7 +399,7 @@ static void htable_destroy(struct xt_hashlimit_htable *hinfo)
 {
 	cancel_delayed_work_sync(&hinfo->gc_work);
 	htable_remove_proc_entry(hinfo);
-	htable_selective_cleanup(hinfo, select_all);
+	htable_selective_cleanup(hinfo, 0, hinfo->cfg.size, select_all);
 	kfree(hinfo->name);
 	vfree(hinfo);
 }
@@ -489,48 +512,66 @@ static u32 user2credits_byte(u32 user)
 	return (u32) (us >> 32);
 }
 
+/* Called with dh->lock held. Credit is added with cmpxchg, as packets
+ * under the limit take theirs in rateinfo_consume() without the lock.
+ */
 static void rateinfo_recalc(struct dsthash_ent *dh, unsigned long now,
 			    u32 mode, int revision)
 {
 	unsigned long delta = now - dh->rateinfo.prev;
-	u64 cap, cpj;
+	u64 cap, cpj, add, old, new;
 
 	if (delta == 0)
 		return;
 
-	dh->rateinfo.prev = now;
+	WRITE_ONCE(dh->rateinfo.prev, now);
 
 	if (mode & XT_HASHLIMIT_BYTES) {
-		u64 tmp = dh->rateinfo.credit;
-		dh->rateinfo.credit += CREDITS_PER_JIFFY_BYTES * delta;
+		add = CREDITS_PER_JIFFY_BYTES * delta;
 		cap = CREDITS_PER_JIFFY_BYTES * HZ;
-		if (tmp >= dh->rateinfo.credit) {/* overflow */
-			dh->rateinfo.credit = cap;
-			return;
-		}
 	} else {
 		cpj = (revision == 1) ?
 			CREDITS_PER_JIFFY_v1 : CREDITS_PER_JIFFY;
-		dh->rateinfo.credit += delta * cpj;
+		add = delta * cpj;
 		cap = dh->rateinfo.credit_cap;
 	}
-	if (dh->rateinfo.credit > cap)
-		dh->rateinfo.credit = cap;
+	do {
+		old = atomic64_read(&dh->rateinfo.credit);
+		new = old + add;
+		if (new < old || new > cap) /* overflow or full */
+			new = cap;
+	} while (atomic64_cmpxchg(&dh->rateinfo.credit, old, new) != old);
+}
+
+static bool rateinfo_consume(struct dsthash_ent *dh, u64 cost)
+{
+	u64 old;
+
+	do {
+		old = atomic64_read(&dh->rateinfo.credit);
+		if (old < cost)
+			return false;
+	} while (atomic64_cmpxchg(&dh->rateinfo.credit, old,
+				  old - cost) != old);
+	return true;
 }
 
 static void rateinfo_init(struct dsthash_ent *dh,
-			  struct xt_hashlimit_htable *hinfo, int revision)
+			  struct xt_hashlimit_htable *hinfo,
+			  unsigned long now, int revision)
 {
-	dh->rateinfo.prev = jiffies;
+	dh->rateinfo.prev = now;
 	if (hinfo->cfg.mode & XT_HASHLIMIT_BYTES) {
-		dh->rateinfo.credit = CREDITS_PER_JIFFY_BYTES * HZ;
+		atomic64_set(&dh->rateinfo.credit,
+			     CREDITS_PER_JIFFY_BYTES * HZ);
 		dh->rateinfo.cost = user2credits_byte(hinfo->cfg.avg);
 		dh->rateinfo.credit_cap = hinfo->cfg.burst;
 	} else {
-		dh->rateinfo.credit = user2credits(hinfo->cfg.avg *
-						   hinfo->cfg.burst, revision);
+		dh->rateinfo.credit_cap = user2credits(hinfo->cfg.avg *
+						       hinfo->cfg.burst,
+						       revision);
 		dh->rateinfo.cost = user2credits(hinfo->cfg.avg, revision);
-		dh->rateinfo.credit_cap = dh->rateinfo.credit;
+		atomic64_set(&dh->rateinfo.credit, dh->rateinfo.credit_cap);
 	}
 }
 
@@ -637,21 +678,48 @@ hashlimit_init_dst(const struct xt_hashlimit_htable *hinfo,
 	return 0;
 }
 
-static u32 hashlimit_byte_cost(unsigned int len, struct dsthash_ent *dh)
+static u64 hashlimit_len_cost(unsigned int len, const struct dsthash_ent *dh)
 {
 	u64 tmp = xt_hashlimit_len_to_chunks(len);
 	tmp = tmp * dh->rateinfo.cost;
 
 	if (unlikely(tmp > CREDITS_PER_JIFFY_BYTES * HZ))
 		tmp = CREDITS_PER_JIFFY_BYTES * HZ;
+	return tmp;
+}
+
+static u32 hashlimit_byte_cost(unsigned int len, struct dsthash_ent *dh)
+{
+	u64 tmp = hashlimit_len_cost(len, dh);
 
-	if (dh->rateinfo.credit < tmp && dh->rateinfo.credit_cap) {
+	if ((u64)atomic64_read(&dh->rateinfo.credit) < tmp &&
+	    dh->rateinfo.credit_cap) {
 		dh->rateinfo.credit_cap--;
-		dh->rateinfo.credit = CREDITS_PER_JIFFY_BYTES * HZ;
+		atomic64_set(&dh->rateinfo.credit,
+			     CREDITS_PER_JIFFY_BYTES * HZ);
 	}
 	return (u32) tmp;
 }
 
+/* Within the jiffy of the last refill no credit is due and the expiry
+ * time is current, so a packet below the limit only has to take its
+ * cost. Anything else goes through the entry lock.
+ */
+static bool hashlimit_mt_fast(const struct sk_buff *skb,
+			      struct dsthash_ent *dh, unsigned long now,
+			      u32 mode)
+{
+	u64 cost;
+
+	if (READ_ONCE(dh->rateinfo.prev) != now)
+		return false;
+	if (mode & XT_HASHLIMIT_BYTES)
+		cost = hashlimit_len_cost(skb->len, dh);
+	else
+		cost = dh->rateinfo.cost;
+	return rateinfo_consume(dh, cost);
+}
+
 static bool
 hashlimit_mt_common(const struct sk_buff *skb, struct xt_action_param *par,
 		    struct xt_hashlimit_htable *hinfo,
@@ -660,7 +728,7 @@ hashlimit_mt_common(const struct sk_buff *skb, struct xt_action_param *par,
 	unsigned long now = jiffies;
 	struct dsthash_ent *dh;
 	struct dsthash_dst dst;
-	bool race = false;
+	bool below;
 	u64 cost;
 
 	if (hashlimit_init_dst(hinfo, &dst, skb, par->thoff) < 0)
@@ -669,39 +737,32 @@ hashlimit_mt_common(const struct sk_buff *skb, struct xt_action_param *par,
 	rcu_read_lock_bh();
 	dh = dsthash_find(hinfo, &dst);
 	if (dh == NULL) {
-		dh = dsthash_alloc_init(hinfo, &dst, &race);
+		dh = dsthash_alloc_init(hinfo, &dst, now, revision);
 		if (dh == NULL) {
 			rcu_read_unlock_bh();
 			goto hotdrop;
-		} else if (race) {
-			/* Already got an entry, update expiration timeout */
-			dh->expires = now + msecs_to_jiffies(hinfo->cfg.expire);
-			rateinfo_recalc(dh, now, hinfo->cfg.mode, revision);
-		} else {
-			dh->expires = jiffies + msecs_to_jiffies(hinfo->cfg.expire);
-			rateinfo_init(dh, hinfo, revision);
 		}
-	} else {
-		/* update expiration timeout */
-		dh->expires = now + msecs_to_jiffies(hinfo->cfg.expire);
-		rateinfo_recalc(dh, now, hinfo->cfg.mode, revision);
+	} else if (hashlimit_mt_fast(skb, dh, now, cfg->mode)) {
+		rcu_read_unlock_bh();
+		return !(cfg->mode & XT_HASHLIMIT_INVERT);
 	}
 
+	spin_lock(&dh->lock);
+	/* update expiration timeout */
+	dh->expires = now + msecs_to_jiffies(hinfo->cfg.expire);
+	rateinfo_recalc(dh, now, hinfo->cfg.mode, revision);
+
 	if (cfg->mode & XT_HASHLIMIT_BYTES)
 		cost = hashlimit_byte_cost(skb->len, dh);
 	else
 		cost = dh->rateinfo.cost;
 
-	if (dh->rateinfo.credit >= cost) {
-		/* below the limit */
-		dh->rateinfo.credit -= cost;
-		spin_unlock(&dh->lock);
-		rcu_read_unlock_bh();
-		return !(cfg->mode & XT_HASHLIMIT_INVERT);
-	}
-
+	below = rateinfo_consume(dh, cost);
 	spin_unlock(&dh->lock);
 	rcu_read_unlock_bh();
+
+	if (below)
+		return !(cfg->mode & XT_HASHLIMIT_INVERT);
 	/* default match is underlimit - so over the limit, we need to invert */
 	return cfg->mode & XT_HASHLIMIT_INVERT;
 
@@ -878,16 +939,14 @@ static struct xt_match hashlimit_mt_reg[] __read_mostly = {
 
 /* PROC stuff */
 static void *dl_seq_start(struct seq_file *s, loff_t *pos)
-	__acquires(htable->lock)
 {
 	struct xt_hashlimit_htable *htable = s->private;
 	unsigned int *bucket;
 
-	spin_lock_bh(&htable->lock);
 	if (*pos >= htable->cfg.size)
 		return NULL;
 
-	bucket = kmalloc(sizeof(unsigned int), GFP_ATOMIC);
+	bucket = kmalloc(sizeof(unsigned int), GFP_KERNEL);
 	if (!bucket)
 		return ERR_PTR(-ENOMEM);
 
@@ -909,14 +968,11 @@ static void *dl_seq_next(struct seq_file *s, void *v, loff_t *pos)
 }
 
 static void dl_seq_stop(struct seq_file *s, void *v)
-	__releases(htable->lock)
 {
-	struct xt_hashlimit_htable *htable = s->private;
 	unsigned int *bucket = (unsigned int *)v;
 
 	if (!IS_ERR(bucket))
 		kfree(bucket);
-	spin_unlock_bh(&htable->lock);
 }
 
 static void dl_seq_print(struct dsthash_ent *ent, u_int8_t family,
@@ -930,8 +986,8 @@ static void dl_seq_print(struct dsthash_ent *ent, u_int8_t family,
 			   ntohs(ent->dst.src_port),
 			   &ent->dst.ip.dst,
 			   ntohs(ent->dst.dst_port),
-			   ent->rateinfo.credit, ent->rateinfo.credit_cap,
-			   ent->rateinfo.cost);
+			   (u64)atomic64_read(&ent->rateinfo.credit),
+			   ent->rateinfo.credit_cap, ent->rateinfo.cost);
 		break;
 #if IS_ENABLED(CONFIG_IP6_NF_IPTABLES)
 	case NFPROTO_IPV6:
@@ -941,8 +997,8 @@ static void dl_seq_print(struct dsthash_ent *ent, u_int8_t family,
 			   ntohs(ent->dst.src_port),
 			   &ent->dst.ip6.dst,
 			   ntohs(ent->dst.dst_port),
-			   ent->rateinfo.credit, ent->rateinfo.credit_cap,
-			   ent->rateinfo.cost);
+			   (u64)atomic64_read(&ent->rateinfo.credit),
+			   ent->rateinfo.credit_cap, ent->rateinfo.cost);
 		break;
 #endif
 	default:
@@ -984,28 +1040,40 @@ static int dl_seq_show_v1(struct seq_file *s, void *v)
 {
 	struct xt_hashlimit_htable *htable = s->private;
 	unsigned int *bucket = (unsigned int *)v;
+	spinlock_t *lock = htable_lock(htable, *bucket);
 	struct dsthash_ent *ent;
+	int ret = 0;
 
+	spin_lock_bh(lock);
 	if (!hlist_empty(&htable->hash[*bucket])) {
 		hlist_for_each_entry(ent, &htable->hash[*bucket], node)
-			if (dl_seq_real_show_v1(ent, htable->family, s))
-				return -1;
+			if (dl_seq_real_show_v1(ent, htable->family, s)) {
+				ret = -1;
+				break;
+			}
 	}
-	return 0;
+	spin_unlock_bh(lock);
+	return ret;
 }
 
 static int dl_seq_show(struct seq_file *s, void *v)
 {
 	struct xt_hashlimit_htable *htable = s->private;
 	unsigned int *bucket = (unsigned int *)v;
+	spinlock_t *lock = htable_lock(htable, *bucket);
 	struct dsthash_ent *ent;
+	int ret = 0;
 
+	spin_lock_bh(lock);
 	if (!hlist_empty(&htable->hash[*bucket])) {
 		hlist_for_each_entry(ent, &htable->hash[*bucket], node)
-			if (dl_seq_real_show(ent, htable->family, s))
-				return -1;
+			if (dl_seq_real_show(ent, htable->family, s)) {
+				ret = -1;
+				break;
+			}
 	}
-	return 0;
+	spin_unlock_bh(lock);
+	return ret;
 }
 
 static const struct seq_operations dl_seq_ops_v1 = {
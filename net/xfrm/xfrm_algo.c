@@ -589,6 +589,15 @@ static struct xfrm_algo_desc calg_list[] = {
 	.pfkey_supported = 1,
 	.desc = { .sadb_alg_id = SADB_X_CALG_LZJH }
 },
+{
+	.name = "lz4",
+	.uinfo = {
+		.comp = {
+			.threshold = 90,
+		}
+	},
+	.pfkey_supported = 0,
+},
 };
 
 static inline int aalg_entries(void)
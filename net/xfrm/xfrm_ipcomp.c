@@ -12,7 +12,6 @@
  * Todo:
  *   - Tunable compression parameters.
  *   - Compression stats.
- *   - Adaptive compression.
  */
 
 #include <linux/crypto.h>
@@ -34,23 +33,57 @@ struct ipcomp_tfms {
 	int users;
 };
 
+/*
+ * After an incompressible packet, that many packets of the SA are sent
+ * uncompressed before trying again. This doubles with every further
+ * incompressible packet, up to IPCOMP_SKIP_MAX.
+ */
+#define IPCOMP_SKIP_MAX		128U
+
 static DEFINE_MUTEX(ipcomp_resource_mutex);
 static void * __percpu *ipcomp_scratches;
+static void * __percpu *ipcomp_streams;
 static int ipcomp_scratch_users;
 static LIST_HEAD(ipcomp_tfms_list);
 
+/*
+ * Return the payload of @skb as a contiguous buffer. Rather than
+ * linearizing a fragmented skb, its payload is gathered into the per-CPU
+ * stream buffer, which the caller must keep until it is done. Returns
+ * NULL if the payload does not fit into the stream buffer.
+ */
+static const u8 *ipcomp_payload(struct sk_buff *skb, int cpu)
+{
+	u8 *stream;
+
+	if (!skb_is_nonlinear(skb))
+		return skb->data;
+
+	if (skb->len > IPCOMP_SCRATCH_SIZE)
+		return NULL;
+
+	stream = *per_cpu_ptr(ipcomp_streams, cpu);
+	if (skb_copy_bits(skb, 0, stream, skb->len))
+		return NULL;
+	return stream;
+}
+
 static int ipcomp_decompress(struct xfrm_state *x, struct sk_buff *skb)
 {
 	struct ipcomp_data *ipcd = x->data;
 	const int plen = skb->len;
 	int dlen = IPCOMP_SCRATCH_SIZE;
-	const u8 *start = skb->data;
 	const int cpu = get_cpu();
+	const u8 *start = ipcomp_payload(skb, cpu);
 	u8 *scratch = *per_cpu_ptr(ipcomp_scratches, cpu);
 	struct crypto_comp *tfm = *per_cpu_ptr(ipcd->tfms, cpu);
-	int err = crypto_comp_decompress(tfm, start, plen, scratch, &dlen);
+	int err = -EINVAL;
 	int len;
 
+	if (!start)
+		goto out;
+
+	err = crypto_comp_decompress(tfm, start, plen, scratch, &dlen);
 	if (err)
 		goto out;
 
@@ -59,13 +92,18 @@ static int ipcomp_decompress(struct xfrm_state *x, struct sk_buff *skb)
 		goto out;
 	}
 
-	len = dlen - plen;
-	if (len > skb_tailroom(skb))
-		len = skb_tailroom(skb);
-
-	__skb_put(skb, len);
+	/* replace the compressed payload, and its fragments, in place */
+	err = skb_unclone(skb, GFP_ATOMIC);
+	if (err)
+		goto out;
+	if (skb_is_nonlinear(skb)) {
+		err = pskb_trim(skb, 0);
+		if (err)
+			goto out;
+	}
 
-	len += plen;
+	len = min_t(int, dlen, skb->len + skb_tailroom(skb));
+	__skb_put(skb, len - skb->len);
 	skb_copy_to_linear_data(skb, scratch, len);
 
 	while ((scratch += len, dlen -= len) > 0) {
@@ -113,7 +151,7 @@ int ipcomp_input(struct xfrm_state *x, struct sk_buff *skb)
 	int err = -ENOMEM;
 	struct ip_comp_hdr *ipch;
 
-	if (skb_linearize_cow(skb))
+	if (!pskb_may_pull(skb, sizeof(*ipch)))
 		goto out;
 
 	skb->ip_summed = CHECKSUM_NONE;
@@ -140,34 +178,77 @@ static int ipcomp_compress(struct xfrm_state *x, struct sk_buff *skb)
 	struct ipcomp_data *ipcd = x->data;
 	const int plen = skb->len;
 	int dlen = IPCOMP_SCRATCH_SIZE;
-	u8 *start = skb->data;
+	const u8 *start;
 	struct crypto_comp *tfm;
 	u8 *scratch;
+	int len;
 	int err;
 
 	local_bh_disable();
 	scratch = *this_cpu_ptr(ipcomp_scratches);
 	tfm = *this_cpu_ptr(ipcd->tfms);
+	start = ipcomp_payload(skb, smp_processor_id());
+	if (!start) {
+		err = -EINVAL;
+		goto out;
+	}
+
 	err = crypto_comp_compress(tfm, start, plen, scratch, &dlen);
 	if (err)
 		goto out;
 
-	if ((dlen + sizeof(struct ip_comp_hdr)) >= plen) {
+	len = dlen + sizeof(struct ip_comp_hdr);
+	if (len >= plen) {
 		err = -EMSGSIZE;
 		goto out;
 	}
 
-	memcpy(start + sizeof(struct ip_comp_hdr), scratch, dlen);
+	/*
+	 * Only the compressed payload needs to be linear and writable. If
+	 * this fails, the packet is unchanged and is sent uncompressed.
+	 */
+	if (skb_unclone(skb, GFP_ATOMIC) || !pskb_may_pull(skb, len)) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	memcpy(skb->data + sizeof(struct ip_comp_hdr), scratch, dlen);
 	local_bh_enable();
 
-	pskb_trim(skb, dlen + sizeof(struct ip_comp_hdr));
-	return 0;
+	/* the data beyond @len is in fragments we can drop without copying */
+	return pskb_trim(skb, len);
 
 out:
 	local_bh_enable();
 	return err;
 }
 
+/*
+ * Skip packets of SAs carrying data that does not compress. The SA is
+ * used from several CPUs at once, so both counters are atomic.
+ */
+static bool ipcomp_skip(struct ipcomp_data *ipcd)
+{
+	return atomic_add_unless(&ipcd->skip, -1, 0);
+}
+
+static void ipcomp_update_backoff(struct ipcomp_data *ipcd, bool compressed)
+{
+	int old, backoff;
+
+	if (compressed) {
+		if (atomic_read(&ipcd->backoff))
+			atomic_set(&ipcd->backoff, 0);
+		return;
+	}
+
+	do {
+		old = atomic_read(&ipcd->backoff);
+		backoff = old ? min_t(int, old * 2, IPCOMP_SKIP_MAX) : 1;
+	} while (atomic_cmpxchg(&ipcd->backoff, old, backoff) != old);
+	atomic_set(&ipcd->skip, backoff);
+}
+
 int ipcomp_output(struct xfrm_state *x, struct sk_buff *skb)
 {
 	int err;
@@ -179,14 +260,17 @@ int ipcomp_output(struct xfrm_state *x, struct sk_buff *skb)
 		goto out_ok;
 	}
 
-	if (skb_linearize_cow(skb))
+	if (ipcomp_skip(ipcd))
 		goto out_ok;
 
 	err = ipcomp_compress(x, skb);
 
 	if (err) {
+		if (err == -EMSGSIZE)
+			ipcomp_update_backoff(ipcd, false);
 		goto out_ok;
 	}
+	ipcomp_update_backoff(ipcd, true);
 
 	/* Install ipcomp header, convert into ipcomp datagram. */
 	ipch = ip_comp_hdr(skb);
@@ -200,48 +284,64 @@ int ipcomp_output(struct xfrm_state *x, struct sk_buff *skb)
 }
 EXPORT_SYMBOL_GPL(ipcomp_output);
 
-static void ipcomp_free_scratches(void)
+static void ipcomp_free_buffers(void * __percpu *buffers)
 {
 	int i;
-	void * __percpu *scratches;
 
-	if (--ipcomp_scratch_users)
-		return;
-
-	scratches = ipcomp_scratches;
-	if (!scratches)
+	if (!buffers)
 		return;
 
 	for_each_possible_cpu(i)
-		vfree(*per_cpu_ptr(scratches, i));
+		vfree(*per_cpu_ptr(buffers, i));
 
-	free_percpu(scratches);
+	free_percpu(buffers);
 }
 
-static void * __percpu *ipcomp_alloc_scratches(void)
+static void * __percpu *ipcomp_alloc_buffers(void)
 {
-	void * __percpu *scratches;
+	void * __percpu *buffers;
 	int i;
 
-	if (ipcomp_scratch_users++)
-		return ipcomp_scratches;
-
-	scratches = alloc_percpu(void *);
-	if (!scratches)
+	buffers = alloc_percpu(void *);
+	if (!buffers)
 		return NULL;
 
-	ipcomp_scratches = scratches;
-
 	for_each_possible_cpu(i) {
-		void *scratch;
+		void *buffer;
 
-		scratch = vmalloc_node(IPCOMP_SCRATCH_SIZE, cpu_to_node(i));
-		if (!scratch)
+		buffer = vmalloc_node(IPCOMP_SCRATCH_SIZE, cpu_to_node(i));
+		if (!buffer) {
+			ipcomp_free_buffers(buffers);
 			return NULL;
-		*per_cpu_ptr(scratches, i) = scratch;
+		}
+		*per_cpu_ptr(buffers, i) = buffer;
 	}
 
-	return scratches;
+	return buffers;
+}
+
+static void ipcomp_free_scratches(void)
+{
+	if (--ipcomp_scratch_users)
+		return;
+
+	ipcomp_free_buffers(ipcomp_scratches);
+	ipcomp_free_buffers(ipcomp_streams);
+	ipcomp_scratches = NULL;
+	ipcomp_streams = NULL;
+}
+
+static void * __percpu *ipcomp_alloc_scratches(void)
+{
+	if (ipcomp_scratch_users++)
+		return ipcomp_scratches;
+
+	ipcomp_scratches = ipcomp_alloc_buffers();
+	ipcomp_streams = ipcomp_alloc_buffers();
+	if (!ipcomp_streams)
+		return NULL;
+
+	return ipcomp_scratches;
 }
 
 static void ipcomp_free_tfms(struct crypto_comp * __percpu *tfms)
@@ -50,57 +50,77 @@ static struct dst_entry *skb_dst_pop(struct sk_buff *skb)
 	return child;
 }
 
-static int xfrm_output_one(struct sk_buff *skb, int err)
+/* Everything before the transformation itself. Frees the skb on error. */
+static int xfrm_output_prepare(struct sk_buff *skb)
 {
-	struct dst_entry *dst = skb_dst(skb);
-	struct xfrm_state *x = dst->xfrm;
+	struct xfrm_state *x = skb_dst(skb)->xfrm;
 	struct net *net = xs_net(x);
+	int err;
 
-	if (err <= 0)
-		goto resume;
+	err = xfrm_skb_check_space(skb);
+	if (err) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTERROR);
+		goto error_nolock;
+	}
 
-	do {
-		err = xfrm_skb_check_space(skb);
-		if (err) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTERROR);
-			goto error_nolock;
-		}
+	err = x->outer_mode->output(x, skb);
+	if (err) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEMODEERROR);
+		goto error_nolock;
+	}
 
-		err = x->outer_mode->output(x, skb);
-		if (err) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEMODEERROR);
-			goto error_nolock;
-		}
+	spin_lock_bh(&x->lock);
 
-		spin_lock_bh(&x->lock);
+	if (unlikely(x->km.state != XFRM_STATE_VALID)) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEINVALID);
+		err = -EINVAL;
+		goto error;
+	}
 
-		if (unlikely(x->km.state != XFRM_STATE_VALID)) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEINVALID);
-			err = -EINVAL;
-			goto error;
-		}
+	err = xfrm_state_check_expire(x);
+	if (err) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEEXPIRED);
+		goto error;
+	}
 
-		err = xfrm_state_check_expire(x);
-		if (err) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEEXPIRED);
-			goto error;
-		}
+	err = x->repl->overflow(x, skb);
+	if (err) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATESEQERROR);
+		goto error;
+	}
 
-		err = x->repl->overflow(x, skb);
-		if (err) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATESEQERROR);
-			goto error;
-		}
+	x->curlft.bytes += skb->len;
+	x->curlft.packets++;
+
+	spin_unlock_bh(&x->lock);
+
+	skb_dst_force(skb);
+
+	/* Inner headers are invalid now. */
+	skb->encapsulation = 0;
+
+	return 0;
 
-		x->curlft.bytes += skb->len;
-		x->curlft.packets++;
+error:
+	spin_unlock_bh(&x->lock);
+error_nolock:
+	kfree_skb(skb);
+	return err;
+}
 
-		spin_unlock_bh(&x->lock);
+static int xfrm_output_one(struct sk_buff *skb, int err)
+{
+	struct dst_entry *dst = skb_dst(skb);
+	struct xfrm_state *x = dst->xfrm;
+	struct net *net = xs_net(x);
 
-		skb_dst_force(skb);
+	if (err <= 0)
+		goto resume;
 
-		/* Inner headers are invalid now. */
-		skb->encapsulation = 0;
+	do {
+		err = xfrm_output_prepare(skb);
+		if (err)
+			goto out;
 
 		err = x->type->output(x, skb);
 		if (err == -EINPROGRESS)
@@ -124,8 +144,6 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 
 	return 0;
 
-error:
-	spin_unlock_bh(&x->lock);
 error_nolock:
 	kfree_skb(skb);
 out:
@@ -166,12 +184,49 @@ static int xfrm_output2(struct net *net, struct sock *sk, struct sk_buff *skb)
 	return xfrm_output_resume(skb, 1);
 }
 
+/* Runs the first transformation over a batch of prepared segments, then
+ * takes each segment through the rest of the output path on its own.
+ */
+static int xfrm_output_batch(struct sk_buff **skbs, unsigned int nr)
+{
+	struct xfrm_state *x = skb_dst(skbs[0])->xfrm;
+	int errs[XFRM_OUTPUT_BATCH];
+	unsigned int i;
+	int err = 0;
+
+	x->type->output_batch(x, skbs, errs, nr);
+
+	for (i = 0; i < nr; i++) {
+		int ret = errs[i];
+
+		if (ret == -EINPROGRESS)
+			continue;
+
+		if (ret > 0) {
+			XFRM_INC_STATS(xs_net(x),
+				       LINUX_MIB_XFRMOUTSTATEPROTOERROR);
+			kfree_skb(skbs[i]);
+		} else {
+			ret = xfrm_output_resume(skbs[i], ret);
+		}
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
 static int xfrm_output_gso(struct net *net, struct sock *sk, struct sk_buff *skb)
 {
+	struct sk_buff *batch[XFRM_OUTPUT_BATCH];
 	struct sk_buff *segs;
+	unsigned int nr = 0;
+	bool batched;
+	int err = 0;
 
 	BUILD_BUG_ON(sizeof(*IPCB(skb)) > SKB_SGO_CB_OFFSET);
 	BUILD_BUG_ON(sizeof(*IP6CB(skb)) > SKB_SGO_CB_OFFSET);
+	batched = !!skb_dst(skb)->xfrm->type->output_batch;
 	segs = skb_gso_segment(skb, 0);
 	kfree_skb(skb);
 	if (IS_ERR(segs))
@@ -181,10 +236,23 @@ static int xfrm_output_gso(struct net *net, struct sock *sk, struct sk_buff *skb
 
 	do {
 		struct sk_buff *nskb = segs->next;
-		int err;
 
 		segs->next = NULL;
-		err = xfrm_output2(net, sk, segs);
+		if (!batched) {
+			err = xfrm_output2(net, sk, segs);
+		} else {
+			/* Segments share the SA, encrypt them together */
+			err = xfrm_output_prepare(segs);
+			if (!err)
+				batch[nr++] = segs;
+			if (nr && (err || !nskb || nr == XFRM_OUTPUT_BATCH)) {
+				int ret = xfrm_output_batch(batch, nr);
+
+				if (!err)
+					err = ret;
+				nr = 0;
+			}
+		}
 
 		if (unlikely(err)) {
 			kfree_skb_list(nskb);
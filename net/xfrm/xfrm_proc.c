@@ -45,6 +45,8 @@ static const struct snmp_mib xfrm_mib_list[] = {
 	SNMP_MIB_ITEM("XfrmFwdHdrError", LINUX_MIB_XFRMFWDHDRERROR),
 	SNMP_MIB_ITEM("XfrmOutStateInvalid", LINUX_MIB_XFRMOUTSTATEINVALID),
 	SNMP_MIB_ITEM("XfrmAcquireError", LINUX_MIB_XFRMACQUIREERROR),
+	SNMP_MIB_ITEM("XfrmFlowCacheHit", LINUX_MIB_XFRMFLOWCACHEHIT),
+	SNMP_MIB_ITEM("XfrmFlowCacheMiss", LINUX_MIB_XFRMFLOWCACHEMISS),
 	SNMP_MIB_SENTINEL
 };
 
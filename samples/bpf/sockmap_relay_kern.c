@@ -0,0 +1,28 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#include <uapi/linux/bpf.h>
+#include "bpf_helpers.h"
+
+/* key 0: sock data arrives on, key 1: sock it is relayed out of */
+struct bpf_map_def SEC("maps") sock_map = {
+	.type = BPF_MAP_TYPE_SOCKMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = 2,
+};
+
+SEC("sk_skb/parser")
+int bpf_prog1(struct __sk_buff *skb)
+{
+	return skb->len;
+}
+
+SEC("sk_skb/verdict")
+int bpf_prog2(struct __sk_buff *skb)
+{
+	return bpf_sk_redirect_map(skb, &sock_map, 1, 0);
+}
+
+char _license[] SEC("license") = "GPL";
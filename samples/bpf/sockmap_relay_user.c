@@ -0,0 +1,176 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include "libbpf.h"
+#include "bpf_load.h"
+
+#define BUF_SIZE	(64 * 1024)
+#define TOTAL_BYTES	(1024 * 1024 * 1024ull)
+
+static char buf[BUF_SIZE];
+
+static __u64 time_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* source -> relay_in ... relay_out -> sink, all over loopback */
+static void tcp_pairs(int *cli, int *srv, int n)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int lfd, i;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(lfd >= 0);
+	assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(lfd, n) == 0);
+	assert(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+
+	for (i = 0; i < n; i++) {
+		cli[i] = socket(AF_INET, SOCK_STREAM, 0);
+		assert(cli[i] >= 0);
+		assert(connect(cli[i], (struct sockaddr *)&addr,
+			       sizeof(addr)) == 0);
+		srv[i] = accept(lfd, NULL, NULL);
+		assert(srv[i] >= 0);
+	}
+	close(lfd);
+}
+
+static void send_all(int fd)
+{
+	__u64 sent = 0;
+	ssize_t n;
+
+	while (sent < TOTAL_BYTES) {
+		n = send(fd, buf, sizeof(buf), 0);
+		if (n < 0) {
+			perror("send");
+			exit(1);
+		}
+		sent += n;
+	}
+}
+
+static void user_relay(int in, int out)
+{
+	ssize_t n, off, ret;
+
+	while ((n = recv(in, buf, sizeof(buf), 0)) > 0) {
+		for (off = 0; off < n; off += ret) {
+			ret = send(out, buf + off, n - off, 0);
+			if (ret < 0)
+				return;
+		}
+	}
+}
+
+static void run_test(const char *name, bool sockmap)
+{
+	int cli[2], srv[2], key;
+	pid_t src, relay = 0;
+	__u64 start_time, recvd = 0;
+	ssize_t n;
+
+	tcp_pairs(cli, srv, 2);
+
+	if (sockmap) {
+		key = 0;
+		assert(bpf_update_elem(map_fd[0], &key, &srv[0], BPF_ANY) == 0);
+		key = 1;
+		assert(bpf_update_elem(map_fd[0], &key, &cli[1], BPF_ANY) == 0);
+	} else {
+		relay = fork();
+		if (relay == 0) {
+			user_relay(srv[0], cli[1]);
+			exit(0);
+		}
+	}
+
+	start_time = time_get_ns();
+
+	src = fork();
+	if (src == 0) {
+		send_all(cli[0]);
+		exit(0);
+	}
+
+	while (recvd < TOTAL_BYTES) {
+		n = recv(srv[1], buf, sizeof(buf), 0);
+		if (n <= 0) {
+			perror("recv");
+			break;
+		}
+		recvd += n;
+	}
+
+	printf("%s: %lld MB/s\n", name,
+	       recvd * 1000000000ull / (time_get_ns() - start_time) >> 20);
+
+	waitpid(src, NULL, 0);
+	if (relay) {
+		kill(relay, SIGTERM);
+		waitpid(relay, NULL, 0);
+	}
+	if (sockmap) {
+		key = 0;
+		bpf_delete_elem(map_fd[0], &key);
+		key = 1;
+		bpf_delete_elem(map_fd[0], &key);
+	}
+	close(cli[0]);
+	close(cli[1]);
+	close(srv[0]);
+	close(srv[1]);
+}
+
+int main(int argc, char **argv)
+{
+	struct rlimit r = {RLIM_INFINITY, RLIM_INFINITY};
+	char filename[256];
+
+	snprintf(filename, sizeof(filename), "%s_kern.o", argv[0]);
+	setrlimit(RLIMIT_MEMLOCK, &r);
+
+	if (load_bpf_file(filename)) {
+		printf("%s", bpf_log_buf);
+		return 1;
+	}
+
+	if (bpf_prog_attach(prog_fd[0], map_fd[0],
+			    BPF_SK_SKB_STREAM_PARSER, 0) ||
+	    bpf_prog_attach(prog_fd[1], map_fd[0],
+			    BPF_SK_SKB_STREAM_VERDICT, 0)) {
+		printf("failed to attach sk_skb programs: %s\n",
+		       strerror(errno));
+		return 1;
+	}
+
+	run_test("user space relay", false);
+	run_test("sockmap relay", true);
+
+	return 0;
+}
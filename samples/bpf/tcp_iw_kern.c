@@ -0,0 +1,62 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * sock_ops program tuning TCP connections whose peers share a /24:
+ * a shorter SYN RTO, a larger initial receive window and a larger
+ * initial congestion window. All other connections keep the defaults.
+ *
+ * Use load_sock_ops to attach it to a cgroup.
+ */
+#include <uapi/linux/bpf.h>
+#include <linux/socket.h>
+#include "bpf_helpers.h"
+
+/* in jiffies, matches the 10ms datacenter RTO at HZ=1000 */
+#define SYN_RTO		10
+#define RWND_INIT	40
+#define IW		40
+#define CWND_CLAMP	100
+
+static inline int same_subnet(struct bpf_sock_ops *skops)
+{
+	/* addresses are in network byte order, the /24 is the low bytes */
+	return skops->family == AF_INET &&
+	       (skops->local_ip4 & 0x00ffffff) ==
+	       (skops->remote_ip4 & 0x00ffffff);
+}
+
+SEC("sockops")
+int bpf_tcp_iw(struct bpf_sock_ops *skops)
+{
+	int rv = -1;
+	int iw = IW, clamp = CWND_CLAMP;
+
+	if (!same_subnet(skops)) {
+		skops->reply = -1;
+		return 1;
+	}
+
+	switch (skops->op) {
+	case BPF_SOCK_OPS_TIMEOUT_INIT:
+		rv = SYN_RTO;
+		break;
+	case BPF_SOCK_OPS_RWND_INIT:
+		rv = RWND_INIT;
+		break;
+	case BPF_SOCK_OPS_ACTIVE_ESTABLISHED_CB:
+	case BPF_SOCK_OPS_PASSIVE_ESTABLISHED_CB:
+		rv = bpf_setsockopt(skops, SOL_TCP, TCP_BPF_SNDCWND_CLAMP,
+				    &clamp, sizeof(clamp));
+		rv += bpf_setsockopt(skops, SOL_TCP, TCP_BPF_IW,
+				     &iw, sizeof(iw));
+		break;
+	default:
+		break;
+	}
+
+	skops->reply = rv;
+	return 1;
+}
+
+char _license[] SEC("license") = "GPL";
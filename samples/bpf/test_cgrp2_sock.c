@@ -0,0 +1,240 @@
+/* eBPF example program:
+ *
+ * - Creates a private cgroup2 hierarchy with a child and a grandchild
+ *   cgroup and moves the current task into the grandchild
+ *
+ * - Checks the attach/override rules for BPF_CGROUP_INET_SOCK_CREATE
+ *   programs: a non-overridable program in the parent applies to the
+ *   whole subtree and cannot be replaced further down, an overridable
+ *   one can
+ *
+ * - Attaches a BPF_CGROUP_INET4_CONNECT program which rewrites the
+ *   destination of every connect() to a local listener, and checks that
+ *   a connect() to an unreachable address lands on that listener
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/bpf.h>
+#include <linux/limits.h>
+
+#include "libbpf.h"
+
+#define CGROUP_MOUNT_PATH	"/mnt"
+#define CGROUP_FOO		CGROUP_MOUNT_PATH "/foo"
+#define CGROUP_BAR		CGROUP_FOO "/bar"
+
+static int prog_load_ret(int ret)
+{
+	struct bpf_insn prog[] = {
+		BPF_MOV64_IMM(BPF_REG_0, ret),
+		BPF_EXIT_INSN(),
+	};
+
+	return bpf_prog_load(BPF_PROG_TYPE_CGROUP_SOCK, prog, sizeof(prog),
+			     "GPL", 0);
+}
+
+static int prog_load_connect4(unsigned short port)
+{
+	struct bpf_insn prog[] = {
+		/* only touch IPv4 TCP connects */
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+			    offsetof(struct bpf_sock_addr, protocol)),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, IPPROTO_TCP, 4),
+
+		/* ctx->user_ip4 = 127.0.0.1; ctx->user_port = port */
+		BPF_MOV32_IMM(BPF_REG_2, htonl(INADDR_LOOPBACK)),
+		BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_2,
+			    offsetof(struct bpf_sock_addr, user_ip4)),
+		BPF_MOV32_IMM(BPF_REG_2, htons(port)),
+		BPF_STX_MEM(BPF_W, BPF_REG_1, BPF_REG_2,
+			    offsetof(struct bpf_sock_addr, user_port)),
+
+		BPF_MOV64_IMM(BPF_REG_0, 1),
+		BPF_EXIT_INSN(),
+	};
+
+	return bpf_prog_load(BPF_PROG_TYPE_CGROUP_SOCK_ADDR, prog,
+			     sizeof(prog), "GPL", 0);
+}
+
+static int setup_cgroups(int *foo, int *bar)
+{
+	char buf[32];
+	int fd;
+
+	/* keep the test hierarchy out of the way of any existing one */
+	if (unshare(CLONE_NEWNS) ||
+	    mount("none", "/", NULL, MS_REC | MS_PRIVATE, NULL) ||
+	    mount("none", CGROUP_MOUNT_PATH, "cgroup2", 0, NULL)) {
+		perror("cgroup2 mount");
+		return -1;
+	}
+
+	if ((mkdir(CGROUP_FOO, 0777) && errno != EEXIST) ||
+	    (mkdir(CGROUP_BAR, 0777) && errno != EEXIST)) {
+		perror("mkdir");
+		return -1;
+	}
+
+	fd = open(CGROUP_BAR "/cgroup.procs", O_WRONLY);
+	if (fd < 0) {
+		perror("cgroup.procs");
+		return -1;
+	}
+	snprintf(buf, sizeof(buf), "%d\n", getpid());
+	if (write(fd, buf, strlen(buf)) < 0) {
+		perror("join cgroup");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	*foo = open(CGROUP_FOO, O_DIRECTORY | O_RDONLY);
+	*bar = open(CGROUP_BAR, O_DIRECTORY | O_RDONLY);
+	if (*foo < 0 || *bar < 0) {
+		perror("open cgroup");
+		return -1;
+	}
+	return 0;
+}
+
+static int can_open_socket(void)
+{
+	int sk = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (sk < 0)
+		return 0;
+	close(sk);
+	return 1;
+}
+
+static void test_sock_create(int foo, int bar)
+{
+	int allow_fd, deny_fd;
+
+	allow_fd = prog_load_ret(1);
+	deny_fd = prog_load_ret(0);
+	assert(allow_fd >= 0 && deny_fd >= 0);
+
+	assert(can_open_socket());
+
+	/* non-overridable program in the parent covers the subtree */
+	assert(bpf_prog_attach(deny_fd, foo,
+			       BPF_CGROUP_INET_SOCK_CREATE, 0) == 0);
+	assert(!can_open_socket() && errno == EPERM);
+	assert(bpf_prog_attach(allow_fd, bar, BPF_CGROUP_INET_SOCK_CREATE,
+			       BPF_F_ALLOW_OVERRIDE) == -1 && errno == EPERM);
+	assert(bpf_prog_attach(allow_fd, bar,
+			       BPF_CGROUP_INET_SOCK_CREATE, 0) == -1 &&
+	       errno == EPERM);
+	assert(bpf_prog_detach(foo, BPF_CGROUP_INET_SOCK_CREATE) == 0);
+	assert(can_open_socket());
+
+	/* nothing left to detach */
+	assert(bpf_prog_detach(foo, BPF_CGROUP_INET_SOCK_CREATE) == -1 &&
+	       errno == ENOENT);
+
+	/* overridable program in the parent may be replaced in the child,
+	 * but only by another overridable one
+	 */
+	assert(bpf_prog_attach(deny_fd, foo, BPF_CGROUP_INET_SOCK_CREATE,
+			       BPF_F_ALLOW_OVERRIDE) == 0);
+	assert(!can_open_socket() && errno == EPERM);
+	assert(bpf_prog_attach(allow_fd, bar,
+			       BPF_CGROUP_INET_SOCK_CREATE, 0) == -1 &&
+	       errno == EPERM);
+	assert(bpf_prog_attach(allow_fd, bar, BPF_CGROUP_INET_SOCK_CREATE,
+			       BPF_F_ALLOW_OVERRIDE) == 0);
+	assert(can_open_socket());
+
+	/* detaching the child's program brings the parent's back */
+	assert(bpf_prog_detach(bar, BPF_CGROUP_INET_SOCK_CREATE) == 0);
+	assert(!can_open_socket() && errno == EPERM);
+	assert(bpf_prog_detach(foo, BPF_CGROUP_INET_SOCK_CREATE) == 0);
+	assert(can_open_socket());
+
+	/* unknown flags and mismatching program types are refused */
+	assert(bpf_prog_attach(deny_fd, foo,
+			       BPF_CGROUP_INET_SOCK_CREATE, 0x80) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_prog_attach(deny_fd, foo,
+			       BPF_CGROUP_INET4_CONNECT, 0) == -1 &&
+	       errno == EINVAL);
+
+	close(allow_fd);
+	close(deny_fd);
+	printf("test_sock_create: OK\n");
+}
+
+static void test_connect4(int foo)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int srv, cli, acc, prog_fd;
+
+	srv = socket(AF_INET, SOCK_STREAM, 0);
+	assert(srv >= 0);
+	assert(bind(srv, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(getsockname(srv, (struct sockaddr *)&addr, &len) == 0);
+	assert(listen(srv, 1) == 0);
+
+	prog_fd = prog_load_connect4(ntohs(addr.sin_port));
+	assert(prog_fd >= 0);
+	assert(bpf_prog_attach(prog_fd, foo,
+			       BPF_CGROUP_INET4_CONNECT, 0) == 0);
+
+	/* TEST-NET-1, nothing answers there */
+	addr.sin_addr.s_addr = inet_addr("192.0.2.1");
+	addr.sin_port = htons(9);
+
+	cli = socket(AF_INET, SOCK_STREAM, 0);
+	assert(cli >= 0);
+	assert(connect(cli, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	acc = accept(srv, NULL, NULL);
+	assert(acc >= 0);
+
+	assert(bpf_prog_detach(foo, BPF_CGROUP_INET4_CONNECT) == 0);
+
+	close(acc);
+	close(cli);
+	close(srv);
+	close(prog_fd);
+	printf("test_connect4: OK\n");
+}
+
+int main(int argc, char **argv)
+{
+	int foo, bar;
+
+	if (setup_cgroups(&foo, &bar))
+		return 1;
+
+	test_sock_create(foo, bar);
+	test_connect4(foo);
+
+	close(bar);
+	close(foo);
+	return 0;
+}
@@ -16,6 +16,11 @@
 #include <assert.h>
 #include <sys/wait.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "libbpf.h"
 
 static int map_flags;
@@ -479,6 +484,257 @@ static void test_map_parallel(void)
 	assert(bpf_get_next_key(map_fd, &key, &key) == -1 && errno == ENOENT);
 }
 
+/* LRU maps never fail an insert because the map is full, they evict
+ * the least recently used element instead
+ */
+static void test_lru_map_evict(int map_type, int lru_flags)
+{
+	unsigned int nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	const int max_entries = 128;
+	long long key, next_key, value[nr_cpus];
+	int map_fd, i, cnt;
+
+	map_fd = bpf_create_map(map_type, sizeof(key), sizeof(value[0]),
+				max_entries, lru_flags);
+	if (map_fd < 0) {
+		printf("failed to create lru map '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < nr_cpus; i++)
+		value[i] = i + 100;
+
+	/* insert many more keys than the map can hold */
+	for (key = 1; key <= 4 * max_entries; key++)
+		assert(bpf_update_elem(map_fd, &key, value, BPF_NOEXIST) == 0);
+
+	/* the last inserted key must still be there */
+	key = 4 * max_entries;
+	assert(bpf_lookup_elem(map_fd, &key, value) == 0 && value[0] == 100);
+
+	/* walk the map, it can never be over-committed.  With
+	 * BPF_F_NO_COMMON_LRU max_entries is rounded up to a multiple
+	 * of the number of possible cpus.
+	 */
+	cnt = 0;
+	key = -1;
+	while (bpf_get_next_key(map_fd, &key, &next_key) == 0) {
+		assert(next_key > 0 && next_key <= 4 * max_entries);
+		key = next_key;
+		cnt++;
+	}
+	assert(errno == ENOENT);
+	assert(cnt > 0 && cnt <= max_entries + nr_cpus);
+
+	/* delete all elements */
+	for (key = 1; key <= 4 * max_entries; key++)
+		bpf_delete_elem(map_fd, &key);
+
+	key = -1;
+	assert(bpf_get_next_key(map_fd, &key, &next_key) == -1 &&
+	       errno == ENOENT);
+
+	close(map_fd);
+}
+
+static void test_lru_maps(void)
+{
+	long long key, value;
+
+	/* LRU maps are always preallocated */
+	assert(bpf_create_map(BPF_MAP_TYPE_LRU_HASH, sizeof(key), sizeof(value),
+			      2, BPF_F_NO_PREALLOC) == -1);
+
+	/* BPF_F_NO_COMMON_LRU is meaningless for a regular hash */
+	assert(bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(key), sizeof(value),
+			      2, BPF_F_NO_COMMON_LRU) == -1 && errno == EINVAL);
+
+	test_lru_map_evict(BPF_MAP_TYPE_LRU_HASH, 0);
+	test_lru_map_evict(BPF_MAP_TYPE_LRU_HASH, BPF_F_NO_COMMON_LRU);
+	test_lru_map_evict(BPF_MAP_TYPE_LRU_PERCPU_HASH, 0);
+	test_lru_map_evict(BPF_MAP_TYPE_LRU_PERCPU_HASH, BPF_F_NO_COMMON_LRU);
+}
+
+/* connect a TCP pair over loopback, cli[i] <-> srv[i] */
+static void sockmap_tcp_pairs(int *cli, int *srv, int n)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int lfd, i;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(lfd >= 0);
+	assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(lfd, n) == 0);
+	assert(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+
+	for (i = 0; i < n; i++) {
+		cli[i] = socket(AF_INET, SOCK_STREAM, 0);
+		assert(cli[i] >= 0);
+		assert(connect(cli[i], (struct sockaddr *)&addr,
+			       sizeof(addr)) == 0);
+		srv[i] = accept(lfd, NULL, NULL);
+		assert(srv[i] >= 0);
+	}
+	close(lfd);
+}
+
+static void test_sockmap(void)
+{
+	int cli[2], srv[2], map_fd, parse_fd, verdict_fd, filter_fd, fd, i;
+	char buf[64], msg[] = "hello sockmap";
+	struct pollfd pfd;
+	int key, sock;
+
+	/* parser: every chunk that arrives is one message */
+	struct bpf_insn parse_prog[] = {
+		BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+			    offsetof(struct __sk_buff, len)),
+		BPF_EXIT_INSN(),
+	};
+	/* verdict: send every message out of the sock at key 1 */
+	struct bpf_insn verdict_prog[] = {
+		BPF_LD_MAP_FD(BPF_REG_2, 0),
+		BPF_MOV64_IMM(BPF_REG_3, 1),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_sk_redirect_map),
+		BPF_EXIT_INSN(),
+	};
+	/* socks must not leak to programs through map lookups */
+	struct bpf_insn lookup_prog[] = {
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -4, 0),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, 0),
+		BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+			     BPF_FUNC_map_lookup_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_insn filter_prog[] = {
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+
+	assert(bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key), 8, 4, 0) == -1 &&
+	       errno == EINVAL);
+	assert(bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key), sizeof(sock),
+			      4, BPF_F_NO_PREALLOC) == -1 && errno == EINVAL);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_SOCKMAP, sizeof(key), sizeof(sock),
+				4, 0);
+	if (map_fd < 0) {
+		printf("failed to create sockmap '%s'\n", strerror(errno));
+		exit(1);
+	}
+
+	sockmap_tcp_pairs(cli, srv, 2);
+
+	/* only TCP socks can be added */
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(sock >= 0);
+	key = 0;
+	assert(bpf_update_elem(map_fd, &key, &sock, BPF_ANY) == -1);
+	close(sock);
+
+	/* a sock can only live in one slot */
+	key = 0;
+	assert(bpf_update_elem(map_fd, &key, &cli[0], BPF_ANY) == 0);
+	key = 1;
+	assert(bpf_update_elem(map_fd, &key, &cli[0], BPF_ANY) == -1 &&
+	       errno == EBUSY);
+	key = 0;
+	assert(bpf_update_elem(map_fd, &key, &cli[1], BPF_NOEXIST) == -1 &&
+	       errno == EEXIST);
+	key = 2;
+	assert(bpf_update_elem(map_fd, &key, &cli[1], BPF_EXIST) == -1 &&
+	       errno == ENOENT);
+	key = 4;
+	assert(bpf_update_elem(map_fd, &key, &cli[1], BPF_ANY) == -1 &&
+	       errno == E2BIG);
+
+	/* socks are never exposed through lookups */
+	key = 0;
+	assert(bpf_lookup_elem(map_fd, &key, &sock) == -1 && errno == ENOENT);
+
+	assert(bpf_delete_elem(map_fd, &key) == 0);
+	assert(bpf_delete_elem(map_fd, &key) == -1 && errno == ENOENT);
+
+	/* the verifier only accepts bpf_sk_redirect_map() on a sockmap */
+	lookup_prog[3].imm = map_fd;
+	fd = bpf_prog_load(BPF_PROG_TYPE_SK_SKB, lookup_prog,
+			   sizeof(lookup_prog), "GPL", 0);
+	assert(fd == -1);
+
+	parse_fd = bpf_prog_load(BPF_PROG_TYPE_SK_SKB, parse_prog,
+				 sizeof(parse_prog), "GPL", 0);
+	verdict_prog[0].imm = map_fd;
+	verdict_fd = bpf_prog_load(BPF_PROG_TYPE_SK_SKB, verdict_prog,
+				   sizeof(verdict_prog), "GPL", 0);
+	filter_fd = bpf_prog_load(BPF_PROG_TYPE_SOCKET_FILTER, filter_prog,
+				  sizeof(filter_prog), "GPL", 0);
+	if (parse_fd < 0 || verdict_fd < 0 || filter_fd < 0) {
+		printf("failed to load sk_skb progs '%s'\n%s",
+		       strerror(errno), bpf_log_buf);
+		exit(1);
+	}
+
+	/* only sk_skb programs can be attached */
+	assert(bpf_prog_attach(filter_fd, map_fd,
+			       BPF_SK_SKB_STREAM_PARSER, 0) == -1 &&
+	       errno == EINVAL);
+
+	assert(bpf_prog_attach(parse_fd, map_fd,
+			       BPF_SK_SKB_STREAM_PARSER, 0) == 0);
+	assert(bpf_prog_attach(verdict_fd, map_fd,
+			       BPF_SK_SKB_STREAM_VERDICT, 0) == 0);
+
+	/* data arriving on srv[0] leaves through cli[1] and shows up on
+	 * srv[1] without ever being read by user space
+	 */
+	key = 0;
+	assert(bpf_update_elem(map_fd, &key, &srv[0], BPF_ANY) == 0);
+	key = 1;
+	assert(bpf_update_elem(map_fd, &key, &cli[1], BPF_ANY) == 0);
+
+	for (i = 0; i < 10; i++) {
+		assert(send(cli[0], msg, sizeof(msg), 0) == sizeof(msg));
+
+		pfd.fd = srv[1];
+		pfd.events = POLLIN;
+		assert(poll(&pfd, 1, 1000) == 1);
+		assert(recv(srv[1], buf, sizeof(buf), MSG_DONTWAIT) ==
+		       sizeof(msg));
+		assert(memcmp(buf, msg, sizeof(msg)) == 0);
+	}
+
+	/* once out of the map the sock is back to normal */
+	key = 0;
+	assert(bpf_delete_elem(map_fd, &key) == 0);
+	assert(send(cli[0], msg, sizeof(msg), 0) == sizeof(msg));
+	pfd.fd = srv[0];
+	pfd.events = POLLIN;
+	assert(poll(&pfd, 1, 1000) == 1);
+	assert(recv(srv[0], buf, sizeof(buf), MSG_DONTWAIT) == sizeof(msg));
+
+	assert(bpf_prog_detach(map_fd, BPF_SK_SKB_STREAM_PARSER) == 0);
+	assert(bpf_prog_detach(map_fd, BPF_SK_SKB_STREAM_VERDICT) == 0);
+
+	for (i = 0; i < 2; i++) {
+		close(cli[i]);
+		close(srv[i]);
+	}
+	close(parse_fd);
+	close(verdict_fd);
+	close(filter_fd);
+	/* releases the sock still held at key 1 */
+	close(map_fd);
+}
+
 static void run_all_tests(void)
 {
 	test_hashmap_sanity(0, NULL);
@@ -498,6 +754,11 @@ int main(void)
 	run_all_tests();
 	map_flags = BPF_F_NO_PREALLOC;
 	run_all_tests();
+
+	test_lru_maps();
+
+	test_sockmap();
+
 	printf("test_maps: OK\n");
 	return 0;
 }
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Runs the crypto engine batching and fairness tests in lib/test_crypto_engine.c
+
+if ! /sbin/modprobe -q -n test_crypto_engine; then
+	echo "crypto_engine: [SKIP] module test_crypto_engine is not found"
+	exit 0
+fi
+
+if /sbin/modprobe -q test_crypto_engine; then
+	/sbin/modprobe -q -r test_crypto_engine
+	echo "crypto_engine: ok"
+else
+	echo "crypto_engine: [FAIL]"
+	exit 1
+fi
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Runs the PM QoS atomic update tests in lib/test_pm_qos.c
+
+if ! /sbin/modprobe -q -n test_pm_qos; then
+	echo "pm_qos: [SKIP] module test_pm_qos is not found"
+	exit 0
+fi
+
+if /sbin/modprobe -q test_pm_qos; then
+	/sbin/modprobe -q -r test_pm_qos
+	echo "pm_qos: ok"
+else
+	echo "pm_qos: [FAIL]"
+	exit 1
+fi
@@ -0,0 +1,106 @@
+#!/bin/sh
+# Checks the precision of the hashlimit match and reports its throughput.
+# pktgen sends UDP packets from one netns over veth to another netns, where
+# a hashlimit rule accepts them up to RATE/sec with BURST, and drops the rest.
+#
+# THREADS pktgen threads run in parallel, to hit the same entry from several
+# CPUs. COUNT is the number of packets sent per thread.
+
+RATE=${RATE:-10000}
+BURST=${BURST:-100}
+COUNT=${COUNT:-2000000}
+THREADS=${THREADS:-1}
+
+TX=hl-tx-$$
+RX=hl-rx-$$
+
+cleanup() {
+	ip netns del $TX 2>/dev/null
+	ip netns del $RX 2>/dev/null
+}
+
+pg() {
+	ip netns exec $TX sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+
+for mod in pktgen veth xt_hashlimit; do
+	if ! /sbin/modprobe -q $mod; then
+		echo "hashlimit: $mod not available [SKIP]"
+		exit 0
+	fi
+done
+if ! which iptables > /dev/null 2>&1; then
+	echo "hashlimit: iptables not available [SKIP]"
+	exit 0
+fi
+
+trap cleanup EXIT
+ip netns add $TX || exit 1
+ip netns add $RX || exit 1
+ip link add veth0 netns $TX type veth peer name veth1 netns $RX || exit 1
+ip -n $TX addr add 10.0.0.1/24 dev veth0
+ip -n $RX addr add 10.0.0.2/24 dev veth1
+ip -n $TX link set veth0 up
+ip -n $RX link set veth1 up
+mac=$(ip netns exec $RX cat /sys/class/net/veth1/address)
+
+ip netns exec $RX iptables -t raw -A PREROUTING -i veth1 -p udp \
+	-m hashlimit --hashlimit-upto $RATE/sec --hashlimit-burst $BURST \
+	--hashlimit-mode srcip --hashlimit-name hl_selftest -j ACCEPT
+ip netns exec $RX iptables -t raw -A PREROUTING -i veth1 -p udp -j DROP
+
+i=0
+while [ $i -lt $THREADS ]; do
+	dev=veth0@$i
+	pg kpktgend_$i rem_device_all
+	pg kpktgend_$i "add_device $dev"
+	pg $dev "count $COUNT"
+	pg $dev "clone_skb 0"
+	pg $dev "pkt_size 60"
+	pg $dev "delay 0"
+	pg $dev "dst 10.0.0.2"
+	pg $dev "dst_mac $mac"
+	pg $dev "udp_dst_min 9"
+	pg $dev "udp_dst_max 9"
+	i=$((i + 1))
+done
+
+pg pgctrl start
+
+# Elapsed time of the slowest thread, in usec
+usec=0
+i=0
+while [ $i -lt $THREADS ]; do
+	t=$(ip netns exec $TX cat /proc/net/pktgen/veth0@$i |
+	    sed -n 's/.*Result: OK: \([0-9]*\)(.*/\1/p')
+	[ "${t:-0}" -gt $usec ] && usec=$t
+	i=$((i + 1))
+done
+if [ $usec -eq 0 ]; then
+	echo "hashlimit: pktgen did not run [FAIL]"
+	exit 1
+fi
+
+counters=$(ip netns exec $RX iptables -t raw -L PREROUTING -v -x -n |
+	   awk 'NR > 2 { print $1 }')
+accepted=$(echo $counters | cut -d' ' -f1)
+dropped=$(echo $counters | cut -d' ' -f2)
+seen=$((accepted + dropped))
+
+# The bucket is refilled every jiffy, allow for HZ >= 100 and 5% slack
+expected=$((BURST + RATE * usec / 1000000))
+[ $expected -gt $seen ] && expected=$seen
+slack=$((expected / 20 + RATE / 50))
+
+echo "hashlimit: $THREADS thread(s), $((usec / 1000)) ms," \
+     "$((seen * 1000 / (usec / 1000 + 1))) pps through hashlimit"
+echo "hashlimit: accepted $accepted, dropped $dropped, expected $expected"
+
+diff=$((accepted - expected))
+[ $diff -lt 0 ] && diff=$((-diff))
+if [ $diff -gt $slack ]; then
+	echo "hashlimit: precision off by $diff packets [FAIL]"
+	exit 1
+fi
+echo "hashlimit: precision within $slack packets [PASS]"
+exit 0
@@ -0,0 +1,363 @@
+/*
+ * Compares the throughput of nfnetlink_queue with netlink batch verdicts
+ * against the memory mapped packet ring on /dev/nfqueue.
+ *
+ * A child process sends UDP packets to 127.0.0.1, which an iptables rule
+ * (set up by nfqueue_ring.sh) queues to userspace. The parent accepts them
+ * for the given number of seconds and reports packets per second.
+ *
+ * Usage: nfqueue_ring [-q queue] [-p port] [-t seconds] [-r] [-m]
+ *   -r  use the ring on /dev/nfqueue instead of netlink messages
+ *   -m  use the ring, but give every other verdict through netlink; the
+ *       frames of those packets must be given back to the ring as well
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_SIZE	2048
+#define FRAME_NR	1024
+#define PKT_LEN		64
+
+static int cfg_queue;
+static int cfg_port = 8889;
+static int cfg_seconds = 2;
+static int cfg_ring;
+static int cfg_mixed;
+
+static char nl_buf[1 << 16];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct nlmsghdr *nfq_hdr_put(char *buf, int type, int flags)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct nfgenmsg *nfg;
+
+	memset(buf, 0, NLMSG_SPACE(sizeof(*nfg)));
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*nfg));
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+
+	nfg = NLMSG_DATA(nlh);
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(cfg_queue);
+
+	return nlh;
+}
+
+static void nla_put(struct nlmsghdr *nlh, int type, const void *data,
+		    int len)
+{
+	struct nlattr *nla = (void *)nlh + NLMSG_ALIGN(nlh->nlmsg_len);
+
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	memcpy((void *)nla + NLA_HDRLEN, data, len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+static void nl_send(int fd, struct nlmsghdr *nlh)
+{
+	if (send(fd, nlh, nlh->nlmsg_len, 0) != nlh->nlmsg_len)
+		error(1, errno, "send netlink");
+}
+
+/* Send a request and wait for its ack */
+static void nl_request(int fd, struct nlmsghdr *nlh)
+{
+	struct nlmsgerr *err;
+	int len;
+
+	nl_send(fd, nlh);
+	len = recv(fd, nl_buf, sizeof(nl_buf), 0);
+	if (len < 0)
+		error(1, errno, "recv netlink");
+
+	nlh = (struct nlmsghdr *)nl_buf;
+	if (nlh->nlmsg_type != NLMSG_ERROR)
+		error(1, 0, "unexpected netlink message %d", nlh->nlmsg_type);
+	err = NLMSG_DATA(nlh);
+	if (err->error)
+		error(1, -err->error, "queue config");
+}
+
+static int nfq_bind(void)
+{
+	struct nfqnl_msg_config_cmd cmd = {
+		.command = NFQNL_CFG_CMD_BIND,
+		.pf = htons(AF_INET),
+	};
+	struct nfqnl_msg_config_params params = {
+		.copy_range = htonl(0xffff),
+		.copy_mode = NFQNL_COPY_PACKET,
+	};
+	struct nlmsghdr *nlh;
+	char buf[256];
+	int fd, one = 1, size = 1 << 22;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER);
+	if (fd < 0)
+		error(1, errno, "socket netlink");
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size));
+	setsockopt(fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one));
+
+	nlh = nfq_hdr_put(buf, NFQNL_MSG_CONFIG, NLM_F_ACK);
+	nla_put(nlh, NFQA_CFG_CMD, &cmd, sizeof(cmd));
+	nl_request(fd, nlh);
+
+	nlh = nfq_hdr_put(buf, NFQNL_MSG_CONFIG, NLM_F_ACK);
+	nla_put(nlh, NFQA_CFG_PARAMS, &params, sizeof(params));
+	nl_request(fd, nlh);
+
+	return fd;
+}
+
+static void nfq_verdict(int fd, int type, unsigned int id)
+{
+	struct nfqnl_msg_verdict_hdr vh = {
+		.verdict = htonl(NF_ACCEPT),
+		.id = htonl(id),
+	};
+	struct nlmsghdr *nlh;
+	char buf[256];
+
+	nlh = nfq_hdr_put(buf, type, 0);
+	nla_put(nlh, NFQA_VERDICT_HDR, &vh, sizeof(vh));
+	nl_send(fd, nlh);
+}
+
+/* Returns the highest packet id in the messages read */
+static unsigned int nfq_recv(int fd, unsigned long *count)
+{
+	unsigned int id = 0;
+	struct nlmsghdr *nlh;
+	int len;
+
+	len = recv(fd, nl_buf, sizeof(nl_buf), 0);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		error(1, errno, "recv netlink");
+	}
+
+	for (nlh = (struct nlmsghdr *)nl_buf; NLMSG_OK(nlh, len);
+	     nlh = NLMSG_NEXT(nlh, len)) {
+		struct nfqnl_msg_packet_hdr *ph;
+		struct nlattr *nla;
+		int rem;
+
+		if ((nlh->nlmsg_type & 0xff) != NFQNL_MSG_PACKET)
+			continue;
+
+		nla = NLMSG_DATA(nlh) + NLMSG_ALIGN(sizeof(struct nfgenmsg));
+		rem = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct nfgenmsg));
+		while (rem >= NLA_HDRLEN && nla->nla_len <= rem) {
+			if ((nla->nla_type & NLA_TYPE_MASK) ==
+			    NFQA_PACKET_HDR) {
+				ph = (void *)nla + NLA_HDRLEN;
+				id = ntohl(ph->packet_id);
+				(*count)++;
+				break;
+			}
+			rem -= NLA_ALIGN(nla->nla_len);
+			nla = (void *)nla + NLA_ALIGN(nla->nla_len);
+		}
+	}
+
+	return id;
+}
+
+static unsigned long run_netlink(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	unsigned long count = 0;
+	double end = now() + cfg_seconds;
+	unsigned int id;
+
+	while (now() < end) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+		id = nfq_recv(fd, &count);
+		if (id)
+			nfq_verdict(fd, NFQNL_MSG_VERDICT_BATCH, id);
+	}
+
+	return count;
+}
+
+static unsigned long run_ring(int nl_fd)
+{
+	struct nfqnl_ring_req req = {
+		.queue_num = cfg_queue,
+		.frame_size = FRAME_SIZE,
+		.frame_nr = FRAME_NR,
+	};
+	unsigned long count = 0;
+	double end = now() + cfg_seconds;
+	struct pollfd pfd;
+	unsigned int idx = 0;
+	unsigned long nr = 0;
+	char *ring;
+	int fd;
+
+	fd = open("/dev/nfqueue", O_RDWR);
+	if (fd < 0)
+		error(1, errno, "open /dev/nfqueue");
+	if (ioctl(fd, NFQNL_RING_IOC_SETUP, &req))
+		error(1, errno, "ring setup");
+	ring = mmap(NULL, FRAME_SIZE * FRAME_NR, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED)
+		error(1, errno, "mmap");
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (now() < end) {
+		struct nfqnl_ring_frame *frame;
+		int n = 0, n_nl = 0;
+
+		frame = (void *)(ring + idx * FRAME_SIZE);
+		while (__atomic_load_n(&frame->status, __ATOMIC_ACQUIRE) ==
+		       NFQNL_RING_USER) {
+			if (cfg_mixed && nr++ & 1) {
+				/* The kernel gives the frame back by itself */
+				nfq_verdict(nl_fd, NFQNL_MSG_VERDICT,
+					    frame->packet_id);
+				n_nl++;
+			} else {
+				frame->verdict = NF_ACCEPT;
+				__atomic_store_n(&frame->status,
+						 NFQNL_RING_VERDICT,
+						 __ATOMIC_RELEASE);
+				n++;
+			}
+			idx = (idx + 1) % FRAME_NR;
+			frame = (void *)(ring + idx * FRAME_SIZE);
+		}
+
+		if (n && ioctl(fd, NFQNL_RING_IOC_VERDICT) < 0)
+			error(1, errno, "ring verdict");
+		count += n + n_nl;
+		if (!n && !n_nl)
+			poll(&pfd, 1, 100);
+	}
+
+	munmap(ring, FRAME_SIZE * FRAME_NR);
+	close(fd);
+	return count;
+}
+
+static void send_loop(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(cfg_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	char data[PKT_LEN] = {0};
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		error(1, errno, "socket udp");
+
+	/* Drops on a full queue show up as errors, keep going */
+	for (;;)
+		sendto(fd, data, sizeof(data), 0, (void *)&addr, sizeof(addr));
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "q:p:t:rm")) != -1) {
+		switch (c) {
+		case 'q':
+			cfg_queue = atoi(optarg);
+			break;
+		case 'p':
+			cfg_port = atoi(optarg);
+			break;
+		case 't':
+			cfg_seconds = atoi(optarg);
+			break;
+		case 'r':
+			cfg_ring = 1;
+			break;
+		case 'm':
+			cfg_ring = 1;
+			cfg_mixed = 1;
+			break;
+		default:
+			error(1, 0, "usage: %s [-q queue] [-p port] [-t seconds] [-r] [-m]",
+			      argv[0]);
+		}
+	}
+
+	if (cfg_seconds <= 0)
+		error(1, 0, "seconds must be positive");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long count;
+	pid_t pid;
+	int fd;
+
+	parse_opts(argc, argv);
+
+	fd = nfq_bind();
+
+	pid = fork();
+	if (pid < 0)
+		error(1, errno, "fork");
+	if (pid == 0)
+		send_loop();
+
+	if (cfg_ring)
+		count = run_ring(fd);
+	else
+		count = run_netlink(fd);
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	close(fd);
+
+	fprintf(stderr, "nfqueue %s: %lu packets in %d s, %lu pps\n",
+		cfg_mixed ? "mixed" : cfg_ring ? "ring" : "netlink", count,
+		cfg_seconds, count / cfg_seconds);
+
+	/* Frames not given back after netlink verdicts stall the ring */
+	if (cfg_mixed)
+		return count > FRAME_NR ? 0 : 1;
+
+	return count ? 0 : 1;
+}
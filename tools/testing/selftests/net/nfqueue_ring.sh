@@ -0,0 +1,47 @@
+#!/bin/sh
+# Compares nfnetlink_queue throughput with netlink batch verdicts against
+# the packet ring on /dev/nfqueue. UDP packets to the loopback are queued
+# from OUTPUT in a fresh netns and accepted for SECONDS_RUN each way.
+
+SECONDS_RUN=${SECONDS_RUN:-2}
+QUEUE=${QUEUE:-0}
+PORT=${PORT:-8889}
+
+NS=nfq-$$
+
+cleanup() {
+	ip netns del $NS 2>/dev/null
+}
+
+for mod in nfnetlink_queue xt_NFQUEUE; do
+	if ! /sbin/modprobe -q $mod; then
+		echo "nfqueue_ring: $mod not available [SKIP]"
+		exit 0
+	fi
+done
+if ! which iptables > /dev/null 2>&1; then
+	echo "nfqueue_ring: iptables not available [SKIP]"
+	exit 0
+fi
+if [ ! -c /dev/nfqueue ]; then
+	echo "nfqueue_ring: /dev/nfqueue not available [SKIP]"
+	exit 0
+fi
+
+trap cleanup EXIT
+ip netns add $NS || exit 1
+ip -n $NS link set lo up
+ip netns exec $NS iptables -A OUTPUT -o lo -p udp --dport $PORT \
+	-j NFQUEUE --queue-num $QUEUE
+
+ret=0
+for mode in "" -r -m; do
+	if ! ip netns exec $NS ./nfqueue_ring -q $QUEUE -p $PORT \
+	     -t $SECONDS_RUN $mode; then
+		echo "nfqueue_ring: no packets verdicted ${mode:+with $mode} [FAIL]"
+		ret=1
+	fi
+done
+
+[ $ret -eq 0 ] && echo "nfqueue_ring: [PASS]"
+exit $ret